@@ -1,33 +1,216 @@
 #include "arc.h"
 
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
 namespace flowlessly {
 
-  int32_t Arc::get_cap() {
+  // The segments of the arcs with a piecewise linear cost of every graph.
+  // Only these arcs look them up.
+  mutex segments_lock;
+
+  template<typename CapT, typename CostT>
+  unordered_map<const Arc<CapT, CostT>*, ArcSegments<CapT, CostT>*>&
+  segmentsTable() {
+    static unordered_map<const Arc<CapT, CostT>*, ArcSegments<CapT, CostT>*>
+      segments_table;
+    return segments_table;
+  }
+
+  template<typename CapT, typename CostT>
+  CapT Arc<CapT, CostT>::get_cap() {
     return cap;
   }
 
-  int32_t Arc::get_initial_cap() {
+  template<typename CapT, typename CostT>
+  CapT Arc<CapT, CostT>::get_initial_cap() {
     return initial_cap;
   }
 
-  int64_t Arc::get_cost() {
+  template<typename CapT, typename CostT>
+  CostT Arc<CapT, CostT>::get_cost() {
     return cost;
   }
 
-  uint32_t Arc::get_src_node_id() {
+  template<typename CapT, typename CostT>
+  uint32_t Arc<CapT, CostT>::get_src_node_id() {
     return src_node_id;
   }
 
-  uint32_t Arc::get_dst_node_id() {
+  template<typename CapT, typename CostT>
+  uint32_t Arc<CapT, CostT>::get_dst_node_id() {
     return dst_node_id;
   }
 
-  Arc* Arc::get_reverse_arc() {
+  template<typename CapT, typename CostT>
+  Arc<CapT, CostT>* Arc<CapT, CostT>::get_reverse_arc() {
     return reverse_arc;
   }
 
-  void Arc::set_reverse_arc(Arc* arc) {
+  template<typename CapT, typename CostT>
+  void Arc<CapT, CostT>::set_reverse_arc(Arc<CapT, CostT>* arc) {
     reverse_arc = arc;
   }
 
+  template<typename CapT, typename CostT>
+  ArcSegments<CapT, CostT>* Arc<CapT, CostT>::get_segments() {
+    if (!has_segments) {
+      return NULL;
+    }
+    unique_lock<mutex> lock(segments_lock);
+    unordered_map<const Arc<CapT, CostT>*, ArcSegments<CapT, CostT>*>&
+      segments_table = segmentsTable<CapT, CostT>();
+    typename unordered_map<const Arc<CapT, CostT>*,
+      ArcSegments<CapT, CostT>*>::iterator it = segments_table.find(this);
+    return it == segments_table.end() ? NULL : it->second;
+  }
+
+  template<typename CapT, typename CostT>
+  void Arc<CapT, CostT>::set_segments(ArcSegments<CapT, CostT>* segments) {
+    unique_lock<mutex> lock(segments_lock);
+    unordered_map<const Arc<CapT, CostT>*, ArcSegments<CapT, CostT>*>&
+      segments_table = segmentsTable<CapT, CostT>();
+    if (segments == NULL) {
+      segments_table.erase(this);
+      segments_table.erase(reverse_arc);
+    } else {
+      segments_table[this] = segments;
+      segments_table[reverse_arc] = segments;
+    }
+    has_segments = segments != NULL;
+    reverse_arc->has_segments = has_segments;
+  }
+
+  template<typename CapT, typename CostT>
+  CapT Arc<CapT, CostT>::get_flow() {
+    if (!has_segments) {
+      return initial_cap - cap;
+    }
+    ArcSegments<CapT, CostT>* segments = get_segments();
+    return this == segments->forward_arc ? segments->flow : -segments->flow;
+  }
+
+  template<typename CapT, typename CostT>
+  void Arc<CapT, CostT>::set_flow(CapT flow) {
+    if (!has_segments) {
+      cap = initial_cap - flow;
+      reverse_arc->cap = reverse_arc->initial_cap + flow;
+    } else {
+      ArcSegments<CapT, CostT>* segments = get_segments();
+      segments->flow = this == segments->forward_arc ? flow : -flow;
+      updateSegments(segments);
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  CapT Arc<CapT, CostT>::get_segment_flow(uint32_t index) {
+    ArcSegments<CapT, CostT>* segments = get_segments();
+    CapT segment_start = 0;
+    for (uint32_t prev_index = 0; prev_index < index; ++prev_index) {
+      segment_start += segments->capacities[prev_index];
+    }
+    if (segments->flow <= segment_start) {
+      return 0;
+    }
+    return min(segments->flow - segment_start, segments->capacities[index]);
+  }
+
+  template<typename CapT, typename CostT>
+  int64_t Arc<CapT, CostT>::getFlowCost() {
+    if (!has_segments) {
+      return cap < initial_cap ?
+        (initial_cap - cap) * static_cast<int64_t>(cost) : 0;
+    }
+    ArcSegments<CapT, CostT>* segments = get_segments();
+    if (this != segments->forward_arc) {
+      return 0;
+    }
+    int64_t flow_cost = 0;
+    CapT remaining_flow = segments->flow;
+    for (uint32_t index = 0; index < segments->capacities.size() &&
+           remaining_flow > 0; ++index) {
+      CapT segment_flow = min(remaining_flow, segments->capacities[index]);
+      flow_cost += segment_flow * static_cast<int64_t>(segments->costs[index]);
+      remaining_flow -= segment_flow;
+    }
+    return flow_cost;
+  }
+
+  template<typename CapT, typename CostT>
+  bool Arc<CapT, CostT>::addSegment(CapT segment_cap, CostT segment_cost) {
+    CapT total_cap;
+    if (__builtin_add_overflow(initial_cap, segment_cap, &total_cap)) {
+      return false;
+    }
+    ArcSegments<CapT, CostT>* segments = get_segments();
+    if (segments == NULL) {
+      segments = new ArcSegments<CapT, CostT>();
+      segments->capacities.push_back(initial_cap);
+      segments->costs.push_back(cost);
+      segments->flow = initial_cap - cap;
+      segments->forward_arc = this;
+      set_segments(segments);
+    }
+    // Segments with equal costs stay in the order they were added in.
+    vector<CostT>& costs = segments->costs;
+    typename vector<CostT>::iterator it =
+      upper_bound(costs.begin(), costs.end(), segment_cost);
+    segments->capacities.insert(
+        segments->capacities.begin() + (it - costs.begin()), segment_cap);
+    costs.insert(it, segment_cost);
+    initial_cap = total_cap;
+    updateSegments(segments);
+    return true;
+  }
+
+  // The forward arc stops at the first segment that isn't full and the
+  // reverse arc walks back to the last segment that carries flow. Empty
+  // segments are skipped in both directions.
+  template<typename CapT, typename CostT>
+  void Arc<CapT, CostT>::updateSegments() {
+    updateSegments(get_segments());
+  }
+
+  template<typename CapT, typename CostT>
+  void Arc<CapT, CostT>::updateSegments(ArcSegments<CapT, CostT>* segments) {
+    Arc<CapT, CostT>* forward_arc = segments->forward_arc;
+    Arc<CapT, CostT>* backward_arc = forward_arc->reverse_arc;
+    const vector<CapT>& capacities = segments->capacities;
+    const vector<CostT>& costs = segments->costs;
+    CapT flow = segments->flow;
+    // Capacity of the segments cheaper than the index-th one.
+    CapT segment_start = 0;
+    uint32_t index = 0;
+    for (; index + 1 < capacities.size() &&
+           segment_start + capacities[index] <= flow; ++index) {
+      segment_start += capacities[index];
+    }
+    forward_arc->cap = segment_start + capacities[index] - flow;
+    forward_arc->cost = costs[index];
+    while (index > 0 && segment_start >= flow) {
+      --index;
+      segment_start -= capacities[index];
+    }
+    backward_arc->cap = flow - segment_start;
+    backward_arc->cost = -costs[index];
+  }
+
+  template<typename CapT, typename CostT>
+  void Arc<CapT, CostT>::pushSegmentFlow(CapT flow) {
+    ArcSegments<CapT, CostT>* segments = get_segments();
+    segments->flow += this == segments->forward_arc ? flow : -flow;
+    updateSegments(segments);
+  }
+
+  // The flag of the segments must not grow the 32 bit arc.
+  static_assert(sizeof(Arc<int32_t, int32_t>) ==
+                24 + sizeof(Arc<int32_t, int32_t>*),
+                "Arc<int32_t, int32_t> has grown");
+
+  template class Arc<int32_t, int32_t>;
+  template class Arc<int32_t, int64_t>;
+  template class Arc<int64_t, int32_t>;
+  template class Arc<int64_t, int64_t>;
+
 }
@@ -1,36 +1,115 @@
 #ifndef FLOWLESSLY_ARC_H
 #define FLOWLESSLY_ARC_H
 
+#include "memory_policy.h"
+
+#include <stddef.h>
 #include <stdint.h>
+#include <vector>
 
 namespace flowlessly {
 
+  using namespace std;
+
+  template<typename CapT, typename CostT>
+  class Arc;
+
+  // The pieces of a convex piecewise linear arc cost, sorted by cost. Flow
+  // fills the cheapest segment first. An arc and its reverse arc share the
+  // segments and each of them only exposes one segment as its cap and
+  // cost: the forward arc the cheapest segment that isn't full and the
+  // reverse arc the most expensive segment that carries flow. Because the
+  // costs are convex these are the cheapest residual arcs between the two
+  // nodes, so the solvers need no other change than pushing flow with
+  // pushFlow.
+  template<typename CapT, typename CostT>
+  struct ArcSegments {
+    vector<CapT> capacities;
+    vector<CostT> costs;
+    // Flow on the whole arc.
+    CapT flow;
+    Arc<CapT, CostT>* forward_arc;
+  };
+
+  // CapT is the type used to store capacities and CostT the type used to
+  // store costs. The narrow variants keep the arc small, the wide ones
+  // avoid overflows on graphs with big capacities or costs.
+  template<typename CapT, typename CostT>
   class Arc {
 
   public:
-  Arc(): cap(0), initial_cap(0), cost(0) {
+  Arc(): cap(0), initial_cap(0), cost(0), has_segments(false) {
     }
 
-  Arc(uint32_t src_id, uint32_t dst_id, int32_t capacity, int64_t cst,
+  Arc(uint32_t src_id, uint32_t dst_id, CapT capacity, CostT cst,
       Arc* rvrd_arc): src_node_id(src_id), dst_node_id(dst_id),
-      cap(capacity), initial_cap(capacity), cost(cst), reverse_arc(rvrd_arc) {
+      cap(capacity), initial_cap(capacity), cost(cst), has_segments(false),
+      reverse_arc(rvrd_arc) {
+    }
+
+    // Arcs come from the pool of the memory policy.
+    static void* operator new(size_t size) {
+      return allocatePooled(size);
     }
 
-    int32_t get_cap();
-    int32_t get_initial_cap();
-    int64_t get_cost();
+    static void operator delete(void* arc, size_t size) {
+      freePooled(arc, size);
+    }
+
+    CapT get_cap();
+    CapT get_initial_cap();
+    CostT get_cost();
     uint32_t get_src_node_id();
     uint32_t get_dst_node_id();
     Arc* get_reverse_arc();
     void set_reverse_arc(Arc* arc);
+    // NULL unless the arc has a piecewise linear cost.
+    ArcSegments<CapT, CostT>* get_segments();
+    // Gives the segments to the arc and to its reverse arc. NULL takes them
+    // away without freeing them.
+    void set_segments(ArcSegments<CapT, CostT>* segments);
+    // Flow from the source to the destination of the arc. It is negative
+    // on reverse arcs.
+    CapT get_flow();
+    void set_flow(CapT flow);
+    // Flow carried by the index-th cheapest segment.
+    CapT get_segment_flow(uint32_t index);
+    // Cost of the flow the arc carries. Reverse arcs cost nothing.
+    int64_t getFlowCost();
+
+    // Sends flow along the arc. flow must not exceed cap.
+    void pushFlow(CapT flow) {
+      if (!has_segments) {
+        cap -= flow;
+        reverse_arc->cap += flow;
+      } else {
+        pushSegmentFlow(flow);
+      }
+    }
+
+    // Splits the arc into segments if it isn't split yet and adds a new
+    // one. It must be called on the forward arc. Returns false if the total
+    // capacity overflows.
+    bool addSegment(CapT segment_cap, CostT segment_cost);
+    // Sets cap and cost of the arc and of its reverse arc from the flow on
+    // the segments.
+    void updateSegments();
 
     uint32_t src_node_id;
     uint32_t dst_node_id;
-    int32_t cap;
-    int32_t initial_cap;
-    int64_t cost;
+    CapT cap;
+    CapT initial_cap;
+    CostT cost;
+    // Set if the arc has a piecewise linear cost. The segments are kept in
+    // a table on the side because few arcs have them; the flag fits in the
+    // padding of the 32 bit arc.
+    bool has_segments;
     Arc* reverse_arc;
 
+  private:
+    void pushSegmentFlow(CapT flow);
+    void updateSegments(ArcSegments<CapT, CostT>* segments);
+
   };
 
 }
@@ -0,0 +1,257 @@
+#include "assignments.h"
+
+#include <algorithm>
+#include <glog/logging.h>
+#include <limits>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  bool compareAssignments(const TaskAssignment& left,
+                          const TaskAssignment& right) {
+    return left.task_node_id < right.task_node_id ||
+      (left.task_node_id == right.task_node_id &&
+       left.resource_node_id < right.resource_node_id);
+  }
+
+  template<typename CapT, typename CostT>
+  void extractAssignments(Graph<CapT, CostT>& graph,
+                          vector<TaskAssignment>* assignments) {
+    uint32_t num_nodes = graph.get_num_nodes();
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph.get_arcs();
+    vector<CapT>& nodes_demand = graph.get_nodes_demand();
+    assignments->clear();
+    // The arcs that carry flow, packed by source node. The flow left on
+    // them goes down as the paths are taken off.
+    vector<uint32_t> first_arc(num_nodes + 2, 0);
+    vector<uint32_t> arc_dst;
+    vector<int64_t> arc_flow;
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      first_arc[node_id] = arc_dst.size();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        CapT flow = it->second->get_flow();
+        if (flow > 0) {
+          arc_dst.push_back(it->first);
+          arc_flow.push_back(flow);
+        }
+      }
+    }
+    first_arc[num_nodes + 1] = arc_dst.size();
+    // The next arc of every node that may still carry flow.
+    vector<uint32_t> current_arc(first_arc);
+    vector<int64_t> demand_left(num_nodes + 1, 0);
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      if (nodes_demand[node_id] < 0) {
+        demand_left[node_id] = -static_cast<int64_t>(nodes_demand[node_id]);
+      }
+    }
+    const uint32_t kNotOnPath = numeric_limits<uint32_t>::max();
+    vector<uint32_t> path_position(num_nodes + 1, kNotOnPath);
+    // The arcs of the current path; path_nodes[i] is the source of
+    // path_arcs[i].
+    vector<uint32_t> path_arcs;
+    vector<uint32_t> path_nodes;
+    for (uint32_t task_id = 1; task_id <= num_nodes; ++task_id) {
+      int64_t supply_left = nodes_demand[task_id];
+      uint32_t task_start = assignments->size();
+      while (supply_left > 0) {
+        uint32_t node_id = task_id;
+        path_position[task_id] = 0;
+        while (demand_left[node_id] == 0) {
+          uint32_t& arc_index = current_arc[node_id];
+          while (arc_index < first_arc[node_id + 1] &&
+                 arc_flow[arc_index] == 0) {
+            arc_index++;
+          }
+          if (arc_index == first_arc[node_id + 1]) {
+            break;
+          }
+          path_arcs.push_back(arc_index);
+          path_nodes.push_back(node_id);
+          node_id = arc_dst[arc_index];
+          if (path_position[node_id] == kNotOnPath) {
+            path_position[node_id] = path_arcs.size();
+            continue;
+          }
+          // The flow goes round a cycle. The cycle doesn't reach a demand
+          // node, so it is taken off the flow and the walk goes on from
+          // where it started.
+          uint32_t cycle_start = path_position[node_id];
+          int64_t cycle_flow = numeric_limits<int64_t>::max();
+          for (uint32_t index = cycle_start; index < path_arcs.size();
+               ++index) {
+            cycle_flow = min(cycle_flow, arc_flow[path_arcs[index]]);
+          }
+          for (uint32_t index = cycle_start; index < path_arcs.size();
+               ++index) {
+            arc_flow[path_arcs[index]] -= cycle_flow;
+            if (index > cycle_start) {
+              path_position[path_nodes[index]] = kNotOnPath;
+            }
+          }
+          path_arcs.resize(cycle_start);
+          path_nodes.resize(cycle_start);
+        }
+        if (demand_left[node_id] == 0) {
+          // The supply that is left is not routed. A flow that doesn't
+          // respect the demands may also stop on the way.
+          if (!path_arcs.empty()) {
+            LOG(WARNING) << "The flow of node "
+                         << graph.get_original_node_id(task_id)
+                         << " doesn't reach a demand node";
+          }
+          path_position[node_id] = kNotOnPath;
+          for (vector<uint32_t>::iterator it = path_nodes.begin();
+               it != path_nodes.end(); ++it) {
+            path_position[*it] = kNotOnPath;
+          }
+          path_arcs.clear();
+          path_nodes.clear();
+          break;
+        }
+        int64_t path_flow = min(supply_left, demand_left[node_id]);
+        for (vector<uint32_t>::iterator it = path_arcs.begin();
+             it != path_arcs.end(); ++it) {
+          path_flow = min(path_flow, arc_flow[*it]);
+        }
+        for (vector<uint32_t>::iterator it = path_arcs.begin();
+             it != path_arcs.end(); ++it) {
+          arc_flow[*it] -= path_flow;
+        }
+        supply_left -= path_flow;
+        demand_left[node_id] -= path_flow;
+        // A task sends at most a few paths, so its earlier assignments
+        // are searched linearly.
+        uint32_t resource_id =
+          graph.get_original_node_id(path_nodes.back());
+        uint32_t index = task_start;
+        while (index < assignments->size() &&
+               (*assignments)[index].resource_node_id != resource_id) {
+          index++;
+        }
+        if (index == assignments->size()) {
+          TaskAssignment assignment;
+          assignment.task_node_id = graph.get_original_node_id(task_id);
+          assignment.resource_node_id = resource_id;
+          assignment.flow = 0;
+          assignments->push_back(assignment);
+        }
+        (*assignments)[index].flow += path_flow;
+        path_position[node_id] = kNotOnPath;
+        for (vector<uint32_t>::iterator it = path_nodes.begin();
+             it != path_nodes.end(); ++it) {
+          path_position[*it] = kNotOnPath;
+        }
+        path_arcs.clear();
+        path_nodes.clear();
+      }
+    }
+    sort(assignments->begin(), assignments->end(), compareAssignments);
+  }
+
+  void appendAssignment(char type, const TaskAssignment& assignment,
+                        AssignmentFormat format, string* output) {
+    if (format == BINARY_ASSIGNMENTS) {
+      BinaryAssignmentRecord record;
+      memset(&record, 0, sizeof(record));
+      record.type = type;
+      record.task_node_id = assignment.task_node_id;
+      record.resource_node_id = assignment.resource_node_id;
+      record.flow = assignment.flow;
+      output->append(reinterpret_cast<char*>(&record), sizeof(record));
+      return;
+    }
+    char line[64];
+    int length;
+    if (type == 't') {
+      length = snprintf(line, sizeof(line), "t %u %u %jd\n",
+                        assignment.task_node_id, assignment.resource_node_id,
+                        static_cast<intmax_t>(assignment.flow));
+    } else if (type == 'u') {
+      length = snprintf(line, sizeof(line), "u %u %u\n",
+                        assignment.task_node_id,
+                        assignment.resource_node_id);
+    } else {
+      length = snprintf(line, sizeof(line), "s %jd\n",
+                        static_cast<intmax_t>(assignment.flow));
+    }
+    output->append(line, length);
+  }
+
+  // Walks the two sorted lists side by side.
+  void formatAssignments(const vector<TaskAssignment>& previous,
+                         const vector<TaskAssignment>& current,
+                         int64_t flow_cost, AssignmentFormat format,
+                         bool only_changes, string* output) {
+    vector<TaskAssignment>::const_iterator previous_it = previous.begin();
+    for (vector<TaskAssignment>::const_iterator it = current.begin();
+         it != current.end(); ++it) {
+      while (only_changes && previous_it != previous.end() &&
+             compareAssignments(*previous_it, *it)) {
+        appendAssignment('u', *previous_it, format, output);
+        ++previous_it;
+      }
+      if (only_changes && previous_it != previous.end() &&
+          !compareAssignments(*it, *previous_it)) {
+        bool unchanged = previous_it->flow == it->flow;
+        ++previous_it;
+        if (unchanged) {
+          continue;
+        }
+      }
+      appendAssignment('t', *it, format, output);
+    }
+    for (; only_changes && previous_it != previous.end(); ++previous_it) {
+      appendAssignment('u', *previous_it, format, output);
+    }
+    TaskAssignment cost;
+    memset(&cost, 0, sizeof(cost));
+    cost.flow = flow_cost;
+    appendAssignment('s', cost, format, output);
+  }
+
+  AssignmentWriter::~AssignmentWriter() {
+    pool.wait();
+  }
+
+  void AssignmentWriter::write(vector<TaskAssignment>& assignments,
+                               int64_t flow_cost, AssignmentFormat format,
+                               bool only_changes,
+                               const function<bool(const string&)>& output) {
+    shared_ptr<vector<TaskAssignment> > current(
+        new vector<TaskAssignment>());
+    current->swap(assignments);
+    pool.schedule([this, current, flow_cost, format, only_changes, output] {
+        string formatted;
+        formatAssignments(previous_assignments, *current, flow_cost, format,
+                          only_changes, &formatted);
+        if (!output(formatted)) {
+          failed = true;
+        }
+        previous_assignments.swap(*current);
+      });
+  }
+
+  bool AssignmentWriter::flush() {
+    pool.wait();
+    return !failed.exchange(false);
+  }
+
+  template void extractAssignments(Graph<int32_t, int32_t>& graph,
+                                   vector<TaskAssignment>* assignments);
+  template void extractAssignments(Graph<int32_t, int64_t>& graph,
+                                   vector<TaskAssignment>* assignments);
+  template void extractAssignments(Graph<int64_t, int32_t>& graph,
+                                   vector<TaskAssignment>* assignments);
+  template void extractAssignments(Graph<int64_t, int64_t>& graph,
+                                   vector<TaskAssignment>* assignments);
+
+}
@@ -0,0 +1,91 @@
+#ifndef FLOWLESSLY_ASSIGNMENTS_H
+#define FLOWLESSLY_ASSIGNMENTS_H
+
+#include "graph.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Flow a supply node (a task) sends to a resource. The resource is the
+  // node the flow leaves from on its last arc, the one into a demand node;
+  // in a scheduling graph that is the machine or the unscheduled
+  // aggregator in front of the sink. Nodes have their ids from the input
+  // file.
+  struct TaskAssignment {
+    uint32_t task_node_id;
+    uint32_t resource_node_id;
+    int64_t flow;
+  };
+
+  // A binary assignment stream is a sequence of records with the same
+  // meaning as the text lines: 't' (task_node_id, resource_node_id, flow)
+  // assigns flow, 'u' (task_node_id, resource_node_id) drops an assignment
+  // of the previous solve and 's' (flow = cost of the flow) ends the
+  // solve. The records use the byte order of the host.
+  struct BinaryAssignmentRecord {
+    uint32_t type;
+    uint32_t task_node_id;
+    uint32_t resource_node_id;
+    uint32_t padding;
+    int64_t flow;
+  };
+
+  enum AssignmentFormat {
+    TEXT_ASSIGNMENTS,
+    BINARY_ASSIGNMENTS
+  };
+
+  // Decomposes the flow held by the graph into paths from the supply nodes
+  // to the demand nodes and sums the flow of the paths by task and
+  // resource. Every arc is advanced past once it runs out of flow, so the
+  // work is linear in the number of arcs plus the length of the paths.
+  // Cycles of flow are cancelled on the way. The assignments are sorted by
+  // task and resource.
+  template<typename CapT, typename CostT>
+  void extractAssignments(Graph<CapT, CostT>& graph,
+                          vector<TaskAssignment>* assignments);
+
+  // Formats the assignments of successive solves and writes them out on a
+  // thread of its own, so that the solver can go on with the next graph
+  // while the previous assignments are written. The assignments are handed
+  // over in the order of the solves and written in that order.
+  class AssignmentWriter {
+
+  public:
+  AssignmentWriter(): pool(1), failed(false) {
+    }
+
+    // Blocks until everything handed over has been written.
+    ~AssignmentWriter();
+
+    // Takes the assignments of a solve and leaves assignments empty. If
+    // only_changes is set, only the assignments that differ from the ones
+    // of the previous solve are written: a 't' for every new or changed
+    // one and a 'u' for every dropped one. output is called on the writer
+    // thread with all the lines or records of the solve at once and
+    // returns false if they could not be written.
+    void write(vector<TaskAssignment>& assignments, int64_t flow_cost,
+               AssignmentFormat format, bool only_changes,
+               const function<bool(const string&)>& output);
+    // Blocks until everything handed over has been written. Returns false
+    // if an output failed since the last flush.
+    bool flush();
+
+  private:
+    ThreadPool pool;
+    // Only used on the writer thread.
+    vector<TaskAssignment> previous_assignments;
+    atomic<bool> failed;
+
+  };
+
+}
+#endif
@@ -0,0 +1,154 @@
+#include "batch_solver.h"
+
+#include "compressed_input.h"
+
+#include <atomic>
+#include <chrono>
+#include <glog/logging.h>
+#include <stdlib.h>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  template<typename CapT, typename CostT>
+  bool BatchSolver<CapT, CostT>::solveFiles(
+      const vector<string>& graph_files) {
+    return solveAll(graph_files.size(),
+                    [&graph_files](uint32_t index) {
+                      return openGraphFile(graph_files[index]);
+                    },
+                    [&graph_files](uint32_t index,
+                                   Graph<CapT, CostT>& graph) {
+                      FILE* out_file =
+                        fopen((graph_files[index] + ".out").c_str(), "w");
+                      if (out_file == NULL) {
+                        return false;
+                      }
+                      graph.writeGraph(out_file);
+                      fclose(out_file);
+                      return true;
+                    });
+  }
+
+  template<typename CapT, typename CostT>
+  bool BatchSolver<CapT, CostT>::solveStream(const string& stream_file,
+                                             const string& out_graph_file) {
+    FILE* in_file = openGraphFile(stream_file);
+    if (in_file == NULL) {
+      LOG(ERROR) << "Failed to open graph stream: " << stream_file;
+      return false;
+    }
+    // Every problem line but the first starts a new graph.
+    vector<string> graphs(1);
+    bool has_problem_line = false;
+    char* line = NULL;
+    size_t line_size = 0;
+    while (getline(&line, &line_size, in_file) != -1) {
+      if (line[0] == 'p') {
+        if (has_problem_line) {
+          graphs.push_back(string());
+        }
+        has_problem_line = true;
+      }
+      graphs.back().append(line);
+    }
+    free(line);
+    bool read = !ferror(in_file);
+    fclose(in_file);
+    if (!read) {
+      LOG(ERROR) << "Failed to read graph stream: " << stream_file;
+      return false;
+    }
+    vector<string> flows(graphs.size());
+    bool solved_all = solveAll(
+        graphs.size(),
+        [&graphs](uint32_t index) {
+          return fmemopen(&graphs[index][0], graphs[index].size(), "r");
+        },
+        [&flows](uint32_t index, Graph<CapT, CostT>& graph) {
+          char* buffer = NULL;
+          size_t buffer_size = 0;
+          FILE* flows_file = open_memstream(&buffer, &buffer_size);
+          graph.writeGraph(flows_file);
+          fclose(flows_file);
+          flows[index].assign(buffer, buffer_size);
+          free(buffer);
+          return true;
+        });
+    FILE* out_file = fopen(out_graph_file.c_str(), "w");
+    if (out_file == NULL) {
+      LOG(ERROR) << "Could no open graph file for writing: " << out_graph_file;
+      return false;
+    }
+    for (vector<string>::iterator it = flows.begin(); it != flows.end();
+         ++it) {
+      fwrite(it->data(), 1, it->size(), out_file);
+    }
+    fclose(out_file);
+    return solved_all;
+  }
+
+  template<typename CapT, typename CostT>
+  bool BatchSolver<CapT, CostT>::solveAll(
+      uint32_t num_graphs, const function<FILE*(uint32_t)>& open_graph,
+      const function<bool(uint32_t, Graph<CapT, CostT>&)>& write_flows) {
+    atomic<uint32_t> next_graph(0);
+    atomic<uint64_t> num_arcs(0);
+    atomic<uint32_t> num_failed(0);
+    chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+    for (uint32_t worker = 0; worker < pool_.get_num_threads(); ++worker) {
+      pool_.schedule([&] {
+          Graph<CapT, CostT> graph;
+          SolverWorkspace workspace;
+          workspace.set_stats(&stats_);
+          SolveBudget budget(budget_);
+          for (uint32_t index = next_graph++; index < num_graphs;
+               index = next_graph++) {
+            FILE* graph_file = open_graph(index);
+            // A graph without a problem line must not end up in the
+            // previous graph.
+            graph.initNodes(0, 0);
+            bool read;
+            {
+              ScopedStatsTimer parse_timer(stats_, PARSE_TIMER);
+              read = graph_file != NULL && graph.readGraph(graph_file);
+            }
+            if (graph_file != NULL) {
+              fclose(graph_file);
+            }
+            if (!read) {
+              LOG(ERROR) << "Failed to read graph " << index;
+              num_failed++;
+              continue;
+            }
+            num_arcs += graph.get_num_arcs();
+            budget.restart();
+            {
+              ScopedStatsTimer solve_timer(stats_, SOLVE_TIMER);
+              solve_(graph, workspace, budget);
+            }
+            ScopedStatsTimer output_timer(stats_, OUTPUT_TIMER);
+            if (!write_flows(index, graph)) {
+              LOG(ERROR) << "Failed to write the flows of graph " << index;
+              num_failed++;
+            }
+          }
+        });
+    }
+    pool_.wait();
+    double elapsed_sec = chrono::duration_cast<chrono::duration<double> >(
+        chrono::steady_clock::now() - start_time).count();
+    LOG(INFO) << "Solved " << num_graphs - num_failed << " of " << num_graphs
+              << " graphs in " << elapsed_sec << " s: "
+              << num_graphs / elapsed_sec << " graphs/s, "
+              << num_arcs / elapsed_sec << " arcs/s";
+    return num_failed == 0;
+  }
+
+  template class BatchSolver<int32_t, int32_t>;
+  template class BatchSolver<int32_t, int64_t>;
+  template class BatchSolver<int64_t, int32_t>;
+  template class BatchSolver<int64_t, int64_t>;
+
+}
@@ -0,0 +1,61 @@
+#ifndef FLOWLESSLY_BATCH_SOLVER_H
+#define FLOWLESSLY_BATCH_SOLVER_H
+
+#include "graph.h"
+#include "solve_budget.h"
+#include "solver_workspace.h"
+#include "thread_pool.h"
+
+#include <functional>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Solves many independent graphs on a thread pool. Every worker keeps one
+  // graph and one workspace and reuses them for all the graphs it solves.
+  // Workers claim the next unsolved graph when they are done with one, so
+  // a few large graphs don't hold up the small ones. Every graph gets its
+  // own copy of the budget.
+  template<typename CapT, typename CostT>
+  class BatchSolver {
+
+  public:
+  // All the workers feed stats.
+  BatchSolver(ThreadPool& pool,
+              const function<void(Graph<CapT, CostT>&, SolverWorkspace&,
+                                  SolveBudget&)>& solve,
+              const SolveBudget& budget, SolverStats& stats):
+    pool_(pool), solve_(solve), budget_(budget), stats_(stats) {
+    }
+
+    // Writes the flows of every graph file to the file name followed by
+    // ".out". Returns false if a graph could not be read or written.
+    bool solveFiles(const vector<string>& graph_files);
+    // Solves a stream of concatenated DIMACS graphs, each of which starts
+    // with its problem line, and writes their flows to out_graph_file in
+    // the same order.
+    bool solveStream(const string& stream_file, const string& out_graph_file);
+
+  private:
+    ThreadPool& pool_;
+    function<void(Graph<CapT, CostT>&, SolverWorkspace&,
+                  SolveBudget&)> solve_;
+    SolveBudget budget_;
+    SolverStats& stats_;
+
+    // open_graph returns the input of a graph or NULL. write_flows returns
+    // false if the flows of a graph could not be written.
+    bool solveAll(uint32_t num_graphs,
+                  const function<FILE*(uint32_t)>& open_graph,
+                  const function<bool(uint32_t,
+                                      Graph<CapT, CostT>&)>& write_flows);
+
+  };
+
+}
+#endif
@@ -0,0 +1,156 @@
+#include "certificate.h"
+
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <glog/logging.h>
+
+namespace flowlessly {
+
+  using namespace std;
+  using boost::lexical_cast;
+
+  // Only the first violations are described; a broken solver can violate
+  // the conditions on every arc.
+  const uint32_t kMaxDescribedViolations = 100;
+
+  // The names are only built for violations, which keeps the pass cheap.
+  template<typename CapT, typename CostT>
+  string describeArc(Graph<CapT, CostT>& graph, uint32_t src_node_id,
+                     uint32_t dst_node_id) {
+    return "arc (" +
+      lexical_cast<string>(graph.get_original_node_id(src_node_id)) + ", " +
+      lexical_cast<string>(graph.get_original_node_id(dst_node_id)) + ")";
+  }
+
+  template<typename CapT, typename CostT>
+  bool CertificateChecker<CapT, CostT>::check() {
+    uint32_t num_nodes = graph_.get_num_nodes();
+    num_violations = 0;
+    violations.clear();
+    if (graph_.get_potentials().size() <= num_nodes) {
+      violations.push_back("the solver exported no potentials");
+      num_violations++;
+    }
+    if (!graph_.get_fixed_arcs().empty()) {
+      violations.push_back(
+          lexical_cast<string>(graph_.get_fixed_arcs().size()) +
+          " arcs are still fixed");
+      num_violations++;
+    }
+    // Every range reports its violations on its own so that they can be
+    // merged in node order.
+    uint32_t num_threads = max(1U, pool_.get_num_threads());
+    uint32_t range_size = num_nodes / num_threads + 1;
+    uint32_t num_ranges = (num_nodes + range_size - 1) / range_size;
+    vector<vector<string> > range_violations(num_ranges);
+    vector<uint64_t> range_num_violations(num_ranges, 0);
+    for (uint32_t range = 0; range < num_ranges; ++range) {
+      uint32_t range_start = 1 + range * range_size;
+      uint32_t range_end = min(num_nodes + 1, range_start + range_size);
+      pool_.schedule([this, &range_violations, &range_num_violations, range,
+                      range_start, range_end] {
+          range_num_violations[range] =
+            checkNodes(range_start, range_end, range_violations[range]);
+        });
+    }
+    pool_.wait();
+    for (uint32_t range = 0; range < num_ranges; ++range) {
+      num_violations += range_num_violations[range];
+      for (vector<string>::iterator it = range_violations[range].begin();
+           it != range_violations[range].end() &&
+             violations.size() < kMaxDescribedViolations; ++it) {
+        violations.push_back(*it);
+      }
+    }
+    return num_violations == 0;
+  }
+
+  template<typename CapT, typename CostT>
+  uint64_t CertificateChecker<CapT, CostT>::checkNodes(
+      uint32_t range_start, uint32_t range_end,
+      vector<string>& range_violations) {
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    vector<CapT>& nodes_demand = graph_.get_nodes_demand();
+    const vector<int64_t>& potentials = graph_.get_potentials();
+    bool has_potentials = potentials.size() > graph_.get_num_nodes();
+    uint64_t range_num_violations = 0;
+    for (uint32_t node_id = range_start; node_id < range_end; ++node_id) {
+      // The reverse of an arc that enters the node has a negative flow, so
+      // it counts as negative outflow.
+      int64_t outflow = 0;
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        Arc<CapT, CostT>* arc = it->second;
+        CapT flow = arc->get_flow();
+        outflow += flow;
+        if (arc->initial_cap > 0 && (flow < 0 || flow > arc->initial_cap)) {
+          range_num_violations++;
+          if (range_violations.size() < kMaxDescribedViolations) {
+            range_violations.push_back(
+                describeArc(graph_, node_id, it->first) + ": flow " +
+                lexical_cast<string>(flow) + " outside of [0, " +
+                lexical_cast<string>(arc->initial_cap) + "]");
+          }
+        }
+        // Piecewise linear arcs only expose one segment in each direction,
+        // so their residual capacities don't add up to the total one.
+        if (!arc->has_segments &&
+            static_cast<int64_t>(arc->cap) + arc->reverse_arc->cap !=
+            static_cast<int64_t>(arc->initial_cap) +
+            arc->reverse_arc->initial_cap) {
+          range_num_violations++;
+          if (range_violations.size() < kMaxDescribedViolations) {
+            range_violations.push_back(
+                describeArc(graph_, node_id, it->first) +
+                ": residual capacity " + lexical_cast<string>(arc->cap) +
+                " doesn't match the flow of its reverse arc");
+          }
+        }
+        if (has_potentials && arc->cap > 0) {
+          int64_t reduced_cost = arc->cost + potentials[node_id] -
+            potentials[it->first];
+          if (reduced_cost < 0) {
+            range_num_violations++;
+            if (range_violations.size() < kMaxDescribedViolations) {
+              range_violations.push_back(
+                  describeArc(graph_, node_id, it->first) + ": reduced cost " +
+                  lexical_cast<string>(reduced_cost) +
+                  " with residual capacity " +
+                  lexical_cast<string>(arc->cap));
+            }
+          }
+        }
+      }
+      if (outflow != nodes_demand[node_id]) {
+        range_num_violations++;
+        if (range_violations.size() < kMaxDescribedViolations) {
+          range_violations.push_back(
+              "node " +
+              lexical_cast<string>(graph_.get_original_node_id(node_id)) +
+              ": net outflow " + lexical_cast<string>(outflow) +
+              " but supply " + lexical_cast<string>(nodes_demand[node_id]));
+        }
+      }
+    }
+    return range_num_violations;
+  }
+
+  template<typename CapT, typename CostT>
+  uint64_t CertificateChecker<CapT, CostT>::get_num_violations() {
+    return num_violations;
+  }
+
+  template<typename CapT, typename CostT>
+  const vector<string>& CertificateChecker<CapT, CostT>::get_violations() {
+    return violations;
+  }
+
+  template class CertificateChecker<int32_t, int32_t>;
+  template class CertificateChecker<int32_t, int64_t>;
+  template class CertificateChecker<int64_t, int32_t>;
+  template class CertificateChecker<int64_t, int64_t>;
+
+}
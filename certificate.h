@@ -0,0 +1,51 @@
+#ifndef FLOWLESSLY_CERTIFICATE_H
+#define FLOWLESSLY_CERTIFICATE_H
+
+#include "graph.h"
+#include "thread_pool.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Checks that the flow held by a graph is a min cost flow, using the
+  // potentials the solver exported as a certificate. A flow is optimal if
+  // it respects the capacities, routes exactly the supply and demand of
+  // every node and no arc with residual capacity has a negative reduced
+  // cost. All three are checked in one pass over the arcs, with the nodes
+  // split across the thread pool.
+  template<typename CapT, typename CostT>
+  class CertificateChecker {
+
+  public:
+  CertificateChecker(Graph<CapT, CostT>& graph, ThreadPool& pool):
+    graph_(graph), pool_(pool), num_violations(0) {
+    }
+
+    // Returns true if the flow passes all the checks. A graph without
+    // potentials fails the reduced cost check.
+    bool check();
+    uint64_t get_num_violations();
+    // Describes the first violations found, in node order. Nodes have their
+    // ids from the input file.
+    const vector<string>& get_violations();
+
+  private:
+    Graph<CapT, CostT>& graph_;
+    ThreadPool& pool_;
+    uint64_t num_violations;
+    vector<string> violations;
+
+    // Checks the nodes in [range_start, range_end) and their outgoing arcs.
+    // Returns the number of violations and describes the first ones.
+    uint64_t checkNodes(uint32_t range_start, uint32_t range_end,
+                        vector<string>& range_violations);
+
+  };
+
+}
+#endif
@@ -0,0 +1,286 @@
+#include "compressed_input.h"
+
+#include <condition_variable>
+#include <glog/logging.h>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+#ifdef FLOWLESSLY_ZSTD
+#include <zstd.h>
+#endif
+
+namespace flowlessly {
+
+  const uint32_t kNumRingBuffers = 4;
+  const size_t kRingBufferSize = 1 << 20;
+  const size_t kCompressedChunkSize = 1 << 18;
+
+  enum CompressionFormat {
+    GZIP_COMPRESSION,
+    ZSTD_COMPRESSION
+  };
+
+  class DecompressingReader {
+
+  public:
+    DecompressingReader(FILE* compressed_file, CompressionFormat format);
+    // Stops the producer and closes the compressed file.
+    ~DecompressingReader();
+
+    // Returns the number of bytes read, 0 at the end of the data and -1 if
+    // the data is corrupt or truncated.
+    ssize_t read(char* data, size_t length);
+
+  private:
+    FILE* compressed_file_;
+    CompressionFormat format_;
+    vector<vector<char> > buffers;
+    vector<size_t> buffer_sizes;
+    // The producer fills buffers[write_index] while the consumer drains
+    // the num_full buffers from read_index on.
+    uint32_t read_index;
+    size_t read_offset;
+    uint32_t write_index;
+    uint32_t num_full;
+    bool finished;
+    bool failed;
+    bool stopping;
+    mutex ring_lock;
+    condition_variable buffer_filled;
+    condition_variable buffer_emptied;
+    thread producer;
+
+    void runProducer();
+    // Return false if the data is corrupt or truncated.
+    bool decompressGzip();
+    bool decompressZstd();
+    // Waits for the buffer at write_index to be free. Returns NULL if the
+    // reader is closed before.
+    char* acquireBuffer();
+    void publishBuffer(size_t size);
+
+  };
+
+  DecompressingReader::DecompressingReader(FILE* compressed_file,
+                                           CompressionFormat format):
+    compressed_file_(compressed_file), format_(format),
+    buffers(kNumRingBuffers, vector<char>(kRingBufferSize)),
+    buffer_sizes(kNumRingBuffers, 0), read_index(0), read_offset(0),
+    write_index(0), num_full(0), finished(false), failed(false),
+    stopping(false) {
+    producer = thread(&DecompressingReader::runProducer, this);
+  }
+
+  DecompressingReader::~DecompressingReader() {
+    {
+      unique_lock<mutex> lock(ring_lock);
+      stopping = true;
+    }
+    buffer_emptied.notify_one();
+    producer.join();
+    fclose(compressed_file_);
+  }
+
+  ssize_t DecompressingReader::read(char* data, size_t length) {
+    unique_lock<mutex> lock(ring_lock);
+    while (num_full == 0 && !finished) {
+      buffer_filled.wait(lock);
+    }
+    if (num_full == 0) {
+      return failed ? -1 : 0;
+    }
+    size_t num_copied =
+      min(length, buffer_sizes[read_index] - read_offset);
+    memcpy(data, &buffers[read_index][read_offset], num_copied);
+    read_offset += num_copied;
+    if (read_offset == buffer_sizes[read_index]) {
+      read_index = (read_index + 1) % kNumRingBuffers;
+      read_offset = 0;
+      num_full--;
+      buffer_emptied.notify_one();
+    }
+    return num_copied;
+  }
+
+  void DecompressingReader::runProducer() {
+    bool decompressed = format_ == GZIP_COMPRESSION ? decompressGzip() :
+      decompressZstd();
+    unique_lock<mutex> lock(ring_lock);
+    finished = true;
+    failed = !decompressed;
+    buffer_filled.notify_one();
+  }
+
+  char* DecompressingReader::acquireBuffer() {
+    unique_lock<mutex> lock(ring_lock);
+    while (num_full == kNumRingBuffers && !stopping) {
+      buffer_emptied.wait(lock);
+    }
+    return stopping ? NULL : &buffers[write_index][0];
+  }
+
+  void DecompressingReader::publishBuffer(size_t size) {
+    if (size == 0) {
+      return;
+    }
+    unique_lock<mutex> lock(ring_lock);
+    buffer_sizes[write_index] = size;
+    write_index = (write_index + 1) % kNumRingBuffers;
+    num_full++;
+    buffer_filled.notify_one();
+  }
+
+  bool DecompressingReader::decompressGzip() {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 32 lets zlib detect the gzip header.
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+      LOG(ERROR) << "Failed to set up gzip decompression";
+      return false;
+    }
+    vector<char> input(kCompressedChunkSize);
+    char* output = acquireBuffer();
+    stream.next_out = reinterpret_cast<Bytef*>(output);
+    stream.avail_out = kRingBufferSize;
+    // Whether the input ended in the middle of a gzip member.
+    bool in_member = false;
+    bool decompressed = true;
+    while (output != NULL) {
+      // A full output buffer may leave output behind in zlib, so more
+      // input is only read once the output didn't fill up.
+      if (stream.avail_in == 0 && stream.avail_out > 0) {
+        size_t num_read = fread(&input[0], 1, input.size(),
+                                compressed_file_);
+        if (num_read == 0) {
+          if (in_member || ferror(compressed_file_)) {
+            LOG(ERROR) << "The gzip input is truncated";
+            decompressed = false;
+          }
+          publishBuffer(kRingBufferSize - stream.avail_out);
+          break;
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(&input[0]);
+        stream.avail_in = num_read;
+      }
+      int status = inflate(&stream, Z_NO_FLUSH);
+      if (status == Z_STREAM_END) {
+        // Concatenated gzip files decompress to the concatenated data.
+        inflateReset(&stream);
+        in_member = false;
+      } else if (status == Z_OK) {
+        in_member = true;
+      } else if (status != Z_BUF_ERROR) {
+        LOG(ERROR) << "Corrupt gzip input: "
+                   << (stream.msg != NULL ? stream.msg : "unknown error");
+        decompressed = false;
+        break;
+      }
+      if (stream.avail_out == 0) {
+        publishBuffer(kRingBufferSize);
+        output = acquireBuffer();
+        stream.next_out = reinterpret_cast<Bytef*>(output);
+        stream.avail_out = kRingBufferSize;
+      }
+    }
+    inflateEnd(&stream);
+    return decompressed;
+  }
+
+#ifdef FLOWLESSLY_ZSTD
+  bool DecompressingReader::decompressZstd() {
+    ZSTD_DStream* stream = ZSTD_createDStream();
+    if (stream == NULL || ZSTD_isError(ZSTD_initDStream(stream))) {
+      LOG(ERROR) << "Failed to set up zstd decompression";
+      ZSTD_freeDStream(stream);
+      return false;
+    }
+    vector<char> input(kCompressedChunkSize);
+    ZSTD_inBuffer in_buffer = {&input[0], 0, 0};
+    char* output = acquireBuffer();
+    ZSTD_outBuffer out_buffer = {output, kRingBufferSize, 0};
+    // Non zero while a frame is not complete.
+    size_t frame_left = 0;
+    bool decompressed = true;
+    while (output != NULL) {
+      // Like zlib, zstd may hold back output when the output is full.
+      if (in_buffer.pos == in_buffer.size &&
+          out_buffer.pos < out_buffer.size) {
+        size_t num_read = fread(&input[0], 1, input.size(),
+                                compressed_file_);
+        if (num_read == 0) {
+          if (frame_left != 0 || ferror(compressed_file_)) {
+            LOG(ERROR) << "The zstd input is truncated";
+            decompressed = false;
+          }
+          publishBuffer(out_buffer.pos);
+          break;
+        }
+        in_buffer.size = num_read;
+        in_buffer.pos = 0;
+      }
+      frame_left = ZSTD_decompressStream(stream, &out_buffer, &in_buffer);
+      if (ZSTD_isError(frame_left)) {
+        LOG(ERROR) << "Corrupt zstd input: "
+                   << ZSTD_getErrorName(frame_left);
+        decompressed = false;
+        break;
+      }
+      if (out_buffer.pos == out_buffer.size) {
+        publishBuffer(kRingBufferSize);
+        output = acquireBuffer();
+        out_buffer.dst = output;
+        out_buffer.pos = 0;
+      }
+    }
+    ZSTD_freeDStream(stream);
+    return decompressed;
+  }
+#else
+  bool DecompressingReader::decompressZstd() {
+    LOG(ERROR) << "Flowlessly was built without zstd support";
+    return false;
+  }
+#endif
+
+  ssize_t readDecompressed(void* reader, char* data, size_t length) {
+    return static_cast<DecompressingReader*>(reader)->read(data, length);
+  }
+
+  int closeDecompressed(void* reader) {
+    delete static_cast<DecompressingReader*>(reader);
+    return 0;
+  }
+
+  FILE* openGraphFile(const string& graph_file_path) {
+    FILE* graph_file = fopen(graph_file_path.c_str(), "r");
+    if (graph_file == NULL) {
+      return NULL;
+    }
+    unsigned char magic[4];
+    size_t magic_size = fread(magic, 1, sizeof(magic), graph_file);
+    rewind(graph_file);
+    CompressionFormat format;
+    if (magic_size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+      format = GZIP_COMPRESSION;
+    } else if (magic_size == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+               magic[2] == 0x2f && magic[3] == 0xfd) {
+      format = ZSTD_COMPRESSION;
+    } else {
+      return graph_file;
+    }
+    DecompressingReader* reader = new DecompressingReader(graph_file, format);
+    cookie_io_functions_t functions;
+    memset(&functions, 0, sizeof(functions));
+    functions.read = &readDecompressed;
+    functions.close = &closeDecompressed;
+    FILE* decompressed_file = fopencookie(reader, "r", functions);
+    if (decompressed_file == NULL) {
+      delete reader;
+    }
+    return decompressed_file;
+  }
+
+}
@@ -0,0 +1,22 @@
+#ifndef FLOWLESSLY_COMPRESSED_INPUT_H
+#define FLOWLESSLY_COMPRESSED_INPUT_H
+
+#include <stdio.h>
+#include <string>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Opens a graph file for reading. Gzip and, if built with
+  // FLOWLESSLY_ZSTD, zstd compressed files are recognised by their magic
+  // bytes and decompressed on the fly: a producer thread decompresses into
+  // a bounded ring of buffers that the returned stream reads from, so the
+  // parser runs while the next buffers are decompressed and nothing is
+  // written to disk. A corrupt or truncated file sets the error indicator
+  // of the stream. fclose stops the producer. Returns NULL if the file
+  // could not be opened.
+  FILE* openGraphFile(const string& graph_file_path);
+
+}
+#endif
@@ -1,10 +1,14 @@
 #include "cost_scaling.h"
 
+#include "graph_snapshot.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <algorithm>
 #include <cmath>
+#include <iterator>
 #include <limits>
+#include <memory>
 #include <queue>
 #include <stdint.h>
 
@@ -12,35 +16,74 @@ namespace flowlessly {
 
   using namespace std;
 
-  void CostScaling::discharge(queue<uint32_t>& active_nodes,
-                              vector<int64_t>& potentials,
-                              vector<int32_t>& nodes_demand, int64_t eps) {
+  // By how much the work of a phase may grow before the adaptive schedule
+  // turns around, which absorbs the noise between phases.
+  const double kPhaseWorkTolerance = 1.25;
+  // The adaptive divisor stays between alpha and this many times alpha.
+  // Larger divisors save phases but make the phases at small eps costly.
+  const int64_t kMaxEpsDivisorGrowth = 2;
+  // Buckets of the parallel global update with fewer nodes are relaxed on
+  // the calling thread: handing them to the pool costs more than it saves.
+  const uint32_t kMinParallelBucket = 256;
+
+  bool parseCostScalingPasses(const string& passes, uint32_t* pass_mask) {
+    *pass_mask = 0;
+    size_t start = 0;
+    while (start < passes.size()) {
+      size_t end = passes.find(',', start);
+      if (end == string::npos) {
+        end = passes.size();
+      }
+      string pass = passes.substr(start, end - start);
+      if (!pass.compare("saturation")) {
+        *pass_mask |= SATURATION_PASS;
+      } else if (!pass.compare("arc_fixing")) {
+        *pass_mask |= ARC_FIXING_PASS;
+      } else if (!pass.compare("global_update")) {
+        *pass_mask |= GLOBAL_UPDATE_PASS;
+      } else if (!pass.empty()) {
+        LOG(ERROR) << "Unknown cost scaling pass: " << pass;
+        return false;
+      }
+      start = end + 1;
+    }
+    return true;
+  }
+
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::discharge(queue<uint32_t>& active_nodes,
+                                           vector<int64_t>& potentials,
+                                           vector<CapT>& nodes_excess,
+                                           int64_t eps) {
     uint32_t node_id = active_nodes.front();
     active_nodes.pop();
-    vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
-    while (nodes_demand[node_id] > 0) {
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    while (nodes_excess[node_id] > 0) {
       bool has_neg_cost_arc = false;
-      map<uint32_t, Arc*>::const_iterator it = arcs[node_id].begin();
-      map<uint32_t, Arc*>::const_iterator end_it = arcs[node_id].end();
+      arc_scans_cnt += arcs[node_id].size();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
       for (; it != end_it; ++it) {
-        LOG(INFO) << "Cost: (" << node_id << ", " << it->first << "): "
-                  << it->second->cost + potentials[node_id] - potentials[it->first];
-        if (it->second->cost + potentials[node_id] - potentials[it->first] < 0) {
+        TRACE(TRACE_ARC, TRACE_ARC_SCAN, node_id, it->first,
+              scaledCost(it->second) + potentials[node_id] -
+              potentials[it->first]);
+        if (scaledCost(it->second) + potentials[node_id] -
+            potentials[it->first] < 0) {
           if (it->second->cap > 0) {
             has_neg_cost_arc = true;
             // Push flow.
             pushes_cnt++;
-            int32_t min_flow = min(nodes_demand[node_id], it->second->cap);
-            LOG(INFO) << "Pushing flow " << min_flow << " on (" << node_id
-                      << ", " << it->first << ")";
-            it->second->cap -= min_flow;
-            arcs[it->first][node_id]->cap += min_flow;
-            nodes_demand[node_id] -= min_flow;
+            CapT min_flow = min(nodes_excess[node_id], it->second->cap);
+            TRACE(TRACE_ARC, TRACE_PUSH, node_id, it->first, min_flow);
+            it->second->pushFlow(min_flow);
+            nodes_excess[node_id] -= min_flow;
             // If node doesn't have any excess then it will be activated.
-            if (nodes_demand[it->first] <= 0) {
+            if (nodes_excess[it->first] <= 0) {
               active_nodes.push(it->first);
             }
-            nodes_demand[it->first] += min_flow;
+            nodes_excess[it->first] += min_flow;
           }
         }
       }
@@ -48,119 +91,490 @@ namespace flowlessly {
         // Relabel vertex.
         relabel_cnt++;
         potentials[node_id] -= eps;
-        LOG(INFO) << "Potential of " << node_id << " : " << potentials[node_id];
+        TRACE(TRACE_ARC, TRACE_RELABEL, node_id, potentials[node_id], 0);
       }
     }
   }
 
-  void CostScaling::refine(vector<int64_t>& potentials, int64_t eps) {
-    // Saturate arcs with negative reduced cost.
+  template<typename CapT, typename CostT>
+  bool CostScaling<CapT, CostT>::refine(vector<int64_t>& potentials,
+                                        int64_t eps, bool interruptible) {
     uint32_t num_nodes = graph_.get_num_nodes() + 1;
-    vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
-    vector<int32_t>& nodes_demand = graph_.get_nodes_demand();
-    // Saturate all the arcs with negative cost.
-    for (uint32_t node_id = 1; node_id < num_nodes; ++node_id) {
-      map<uint32_t, Arc*>::const_iterator it = arcs[node_id].begin();
-      map<uint32_t, Arc*>::const_iterator end_it = arcs[node_id].end();
-      for (; it != end_it; ++it) {
-        if (it->second->cost + potentials[node_id] - potentials[it->first] < 0) {
-          nodes_demand[node_id] -= it->second->cap;
-          nodes_demand[it->first] += it->second->cap;
-          arcs[it->first][node_id]->cap += it->second->cap;
-          it->second->cap = 0;
-        }
+    SolverStats& stats = workspace_.get_stats();
+    {
+      ScopedStatsTimer saturation_timer(stats, SATURATION_TIMER);
+      if (isParallel(SATURATION_PASS)) {
+        parallelSaturateArcs(potentials);
+      } else {
+        saturateArcs(potentials);
+      }
+    }
+    TRACE_CALL(TRACE_ITERATION, graph_.traceArcs());
+    if (global_update_) {
+      ScopedStatsTimer global_update_timer(stats, GLOBAL_UPDATE_TIMER);
+      if (isParallel(GLOBAL_UPDATE_PASS)) {
+        parallelGlobalPotentialsUpdate(potentials, eps);
+      } else {
+        globalPotentialsUpdate(potentials, eps);
       }
     }
-    graph_.logGraph();
     queue<uint32_t> active_nodes;
     for (uint32_t node_id = 1; node_id < num_nodes; ++node_id) {
-      if (nodes_demand[node_id] > 0) {
+      if (nodes_excess[node_id] > 0) {
         active_nodes.push(node_id);
       }
     }
+    uint32_t num_discharges = 0;
     while (!active_nodes.empty()) {
-      discharge(active_nodes, potentials, nodes_demand, eps);
+      // Reading the clock on every discharge would be too expensive.
+      if ((++num_discharges & 1023) == 0 && (budget_.isStopped() ||
+          (interruptible && budget_.isPastDeadline()))) {
+        return false;
+      }
+      discharge(active_nodes, potentials, nodes_excess, eps);
+    }
+    return true;
+  }
+
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::saturateArcs(vector<int64_t>& potentials) {
+    uint32_t num_nodes = graph_.get_num_nodes();
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        // Saturating a segment exposes the next, more expensive, one.
+        while (it->second->cap > 0 &&
+               scaledCost(it->second) + potentials[node_id] -
+               potentials[it->first] < 0) {
+          CapT flow = it->second->cap;
+          nodes_excess[node_id] -= flow;
+          nodes_excess[it->first] += flow;
+          it->second->pushFlow(flow);
+        }
+      }
     }
   }
 
-  // Scales up costs by alpha * num_nodes
-  // It returns the value from where eps should start.
-  int64_t CostScaling::scaleUpCosts() {
+  // The arcs to saturate are picked before any flow is pushed, as pushing
+  // changes the reverse arcs, which other threads scan. An arc and its
+  // reverse never both have a negative reduced cost, so every thread then
+  // pushes on arcs no other thread touches. The excess changes are kept by
+  // thread and summed by the owners of the nodes.
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::parallelSaturateArcs(
+      vector<int64_t>& potentials) {
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    runOnThreads([&](uint32_t thread_index) {
+        vector<Arc<CapT, CostT>*>& saturated_arcs = thread_arcs[thread_index];
+        saturated_arcs.clear();
+        uint32_t end_node_id = getFirstNode(thread_index + 1);
+        for (uint32_t node_id = getFirstNode(thread_index);
+             node_id < end_node_id; ++node_id) {
+          typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+            arcs[node_id].begin();
+          typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+            arcs[node_id].end();
+          for (; it != end_it; ++it) {
+            if (it->second->cap > 0 &&
+                scaledCost(it->second) + potentials[node_id] -
+                potentials[it->first] < 0) {
+              saturated_arcs.push_back(it->second);
+            }
+          }
+        }
+      }, true);
+    runOnThreads([&](uint32_t thread_index) {
+        vector<CapT>& excess_delta = excess_deltas[thread_index];
+        vector<Arc<CapT, CostT>*>& saturated_arcs = thread_arcs[thread_index];
+        for (typename vector<Arc<CapT, CostT>*>::iterator it =
+               saturated_arcs.begin(); it != saturated_arcs.end(); ++it) {
+          Arc<CapT, CostT>* arc = *it;
+          while (arc->cap > 0 &&
+                 scaledCost(arc) + potentials[arc->src_node_id] -
+                 potentials[arc->dst_node_id] < 0) {
+            CapT flow = arc->cap;
+            excess_delta[arc->src_node_id] -= flow;
+            excess_delta[arc->dst_node_id] += flow;
+            arc->pushFlow(flow);
+          }
+        }
+      }, true);
+    uint32_t num_threads = pool_->get_num_threads();
+    runOnThreads([&](uint32_t thread_index) {
+        uint32_t end_node_id = getFirstNode(thread_index + 1);
+        for (uint32_t node_id = getFirstNode(thread_index);
+             node_id < end_node_id; ++node_id) {
+          for (uint32_t sender = 0; sender < num_threads; ++sender) {
+            nodes_excess[node_id] += excess_deltas[sender][node_id];
+            excess_deltas[sender][node_id] = 0;
+          }
+        }
+      }, true);
+  }
+
+  template<typename CapT, typename CostT>
+  inline int64_t CostScaling<CapT, CostT>::scaledCost(
+      const Arc<CapT, CostT>* arc) const {
+    return arc->cost * cost_scale_;
+  }
+
+  template<typename CapT, typename CostT>
+  int64_t CostScaling<CapT, CostT>::setUpCostScale() {
     uint32_t num_nodes = graph_.get_num_nodes();
-    const vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
-    int64_t max_cost_arc = numeric_limits<int64_t>::min();
-    int64_t scale_up = FLAGS_alpha_scaling_factor * num_nodes;
+    const vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    // Every arc comes with its reverse, so this is the largest magnitude.
+    int64_t max_cost_arc = 0;
     for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
-      map<uint32_t, Arc*>::const_iterator it = arcs[node_id].begin();
-      map<uint32_t, Arc*>::const_iterator end_it = arcs[node_id].end();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
       for (; it != end_it; ++it) {
-        it->second->cost *= scale_up;
-        if (it->second->cost > max_cost_arc) {
-          max_cost_arc = it->second->cost;
+        Arc<CapT, CostT>* arc = it->second;
+        // The arc cost of a piecewise linear arc is the one of its current
+        // segment, so the whole range of segment costs is looked at.
+        if (arc->has_segments) {
+          const vector<CostT>& costs = arc->get_segments()->costs;
+          max_cost_arc = max(max_cost_arc,
+                             max(static_cast<int64_t>(costs.back()),
+                                 -static_cast<int64_t>(costs.front())));
+        } else if (arc->cost > max_cost_arc) {
+          max_cost_arc = arc->cost;
         }
       }
     }
+    cost_scale_ = FLAGS_alpha_scaling_factor * num_nodes;
+    // We still refuse to silently wrap around.
+    int64_t max_scaled_cost;
+    if (__builtin_mul_overflow(max_cost_arc, cost_scale_, &max_scaled_cost)) {
+      LOG(FATAL) << "Scaling up the cost " << max_cost_arc << " by "
+                 << cost_scale_ << " overflows";
+    }
     return pow(FLAGS_alpha_scaling_factor,
-               ceil(log(max_cost_arc) / log(FLAGS_alpha_scaling_factor)));
+               ceil(log(max_scaled_cost) / log(FLAGS_alpha_scaling_factor)));
   }
 
-  void CostScaling::costScaling() {
+  template<typename CapT, typename CostT>
+  int64_t CostScaling<CapT, CostT>::nextEpsDivisor(int64_t eps_divisor,
+                                                   uint64_t phase_work) {
+    // A larger divisor means fewer phases but more work in each of them.
+    // The work is compared per halving of eps, and the divisor keeps
+    // moving in the same direction while that work doesn't grow.
+    double halving_work = static_cast<double>(phase_work) /
+      (graph_.get_num_nodes() * log2(eps_divisor));
+    double last_halving_work = last_halving_work_;
+    last_halving_work_ = halving_work;
+    if (last_halving_work > 0) {
+      if (halving_work > last_halving_work * kPhaseWorkTolerance) {
+        growing_divisor_ = !growing_divisor_;
+      } else if (halving_work > last_halving_work) {
+        return eps_divisor;
+      }
+    }
+    if (growing_divisor_) {
+      return min(eps_divisor * 2,
+                 kMaxEpsDivisorGrowth * FLAGS_alpha_scaling_factor);
+    }
+    return max(eps_divisor / 2, FLAGS_alpha_scaling_factor);
+  }
+
+  template<typename CapT, typename CostT>
+  int64_t CostScaling<CapT, CostT>::loadWarmStart(
+      vector<int64_t>& potentials) {
+    uint32_t num_nodes = graph_.get_num_nodes();
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    const vector<int64_t>& start_potentials = graph_.get_potentials();
+    if (start_potentials.size() == num_nodes + 1) {
+      for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+        if (__builtin_mul_overflow(start_potentials[node_id], cost_scale_,
+                                   &potentials[node_id])) {
+          LOG(WARNING) << "Scaling up the potentials overflows, starting "
+                       << "from zero potentials";
+          fill(potentials.begin(), potentials.begin() + num_nodes + 1, 0);
+          break;
+        }
+      }
+    }
+    // The excess is the demand the flow doesn't route yet.
+    int64_t eps = 1;
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        CapT flow = it->second->get_flow();
+        if (flow > 0) {
+          nodes_excess[node_id] -= flow;
+          nodes_excess[it->first] += flow;
+        }
+        if (it->second->cap > 0) {
+          eps = max(eps, -(scaledCost(it->second) + potentials[node_id] -
+                           potentials[it->first]));
+        }
+      }
+    }
+    return eps;
+  }
+
+  // Brings the potentials back to the original cost units. They are
+  // rounded down: the scaled reduced costs are at least -1 at the end, so
+  // the rounded ones are at least -1 as well and exportPotentials only has
+  // a few arcs to fix.
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::scaleDownPotentials(
+      vector<int64_t>& potentials) {
+    uint32_t num_nodes = graph_.get_num_nodes();
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      int64_t potential = potentials[node_id];
+      potentials[node_id] = potential >= 0 ? potential / cost_scale_ :
+        -((-potential + cost_scale_ - 1) / cost_scale_);
+    }
+  }
+
+  // Returns the part of the duality gap that comes from an arc with the
+  // given scaled reduced cost.
+  inline double arcDualityGap(int64_t reduced_cost, int64_t flow,
+                              int64_t residual_cap) {
+    return reduced_cost > 0 ? static_cast<double>(reduced_cost) * flow :
+      -static_cast<double>(reduced_cost) * residual_cap;
+  }
+
+  // For any potentials, a flow x that meets the demands costs at most the
+  // sum of its positive reduced costs times the flow and of its negative
+  // reduced costs times the residual capacity more than an optimal flow.
+  // An eps-optimal flow only has terms on the arcs whose reduced cost is
+  // within eps of zero, so the bound is much tighter than eps times the
+  // total capacity.
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::recordOptimalityGap(
+      const vector<int64_t>& potentials) {
+    uint32_t num_nodes = graph_.get_num_nodes();
+    const vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    double duality_gap = 0;
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        Arc<CapT, CostT>* arc = it->second;
+        int64_t potential_diff = potentials[node_id] - potentials[it->first];
+        if (!arc->has_segments) {
+          // Reverse arcs are covered by the residual capacity of their
+          // forward arc.
+          if (arc->initial_cap > 0) {
+            duality_gap += arcDualityGap(
+                scaledCost(arc) + potential_diff,
+                arc->initial_cap - arc->cap, arc->cap);
+          }
+          continue;
+        }
+        ArcSegments<CapT, CostT>* segments = arc->get_segments();
+        for (uint32_t index = 0; arc == segments->forward_arc &&
+               index < segments->capacities.size(); ++index) {
+          int64_t flow = arc->get_segment_flow(index);
+          duality_gap += arcDualityGap(
+              segments->costs[index] * cost_scale_ + potential_diff, flow,
+              segments->capacities[index] - flow);
+        }
+      }
+    }
+    SolutionQuality& quality = graph_.get_solution_quality();
+    quality.optimal = false;
+    quality.cost_gap = ceil(duality_gap / cost_scale_);
+  }
+
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::set_warm_start(bool warm_start) {
+    warm_start_ = warm_start;
+  }
+
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::set_global_update(bool global_update) {
+    global_update_ = global_update;
+  }
+
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::set_parallel_passes(ThreadPool* pool,
+                                                     uint32_t passes) {
+    pool_ = pool;
+    parallel_passes_ = passes;
+  }
+
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::costScaling() {
     //    eps = max arc cost
     //    potential(v) = 0
     //    Establish a feasible flow x in the network
     //    while eps >= 1/n do
     //      (e, f, p) = refine(e, f p)
     uint32_t num_nodes = graph_.get_num_nodes() + 1;
-    vector<int64_t> potentials(num_nodes, 0);
+    workspace_.reserveNodes(num_nodes - 1);
+    vector<int64_t>& potentials = workspace_.get_potentials();
+    fill(potentials.begin(), potentials.begin() + num_nodes, 0);
+    // The algorithm works on a copy of the demands so that the graph keeps
+    // its supplies and can be solved again.
+    nodes_excess = graph_.get_nodes_demand();
     relabel_cnt = 0;
     pushes_cnt = 0;
-    for (int64_t eps = scaleUpCosts() / FLAGS_alpha_scaling_factor; eps >= 1;
-         eps = eps < FLAGS_alpha_scaling_factor && eps > 1 ?
-           1 : eps / FLAGS_alpha_scaling_factor) {
-      graph_.logGraph();
-      //    globalPotentialsUpdate(potentials, eps);
-      if (eps <= pow(FLAGS_alpha_scaling_factor,
-                     log(num_nodes) / log(FLAGS_alpha_scaling_factor))) {
-        //if (!priceRefinement(potentials, eps)) {
-        refine(potentials, eps);
-        //      }
-      } else {
-        refine(potentials, eps);
+    arc_scans_cnt = 0;
+    if (pool_ != NULL) {
+      uint32_t num_threads = pool_->get_num_threads();
+      if (isParallel(SATURATION_PASS)) {
+        excess_deltas.assign(num_threads, vector<CapT>(num_nodes, 0));
+      }
+      thread_arcs.resize(num_threads);
+      thread_unfixed_arcs.resize(num_threads);
+      rank_buckets.resize(num_threads);
+      frontiers.resize(num_threads);
+      thread_counts.resize(num_threads);
+      rank_updates.assign(num_threads,
+                          vector<vector<RankUpdate> >(num_threads));
+    }
+    SolverStats& stats = workspace_.get_stats();
+    graph_.get_solution_quality() = SolutionQuality();
+    // When a deadline or a stop flag can cut a phase short, the state at
+    // the start of the phase is kept so that the phase can be undone. The
+    // flow is then the eps-optimal one left by the previous phase, for the
+    // potentials of that phase. An iteration limit alone only ends the
+    // solve between phases, so it doesn't pay for the O(m) capture.
+    unique_ptr<GraphSnapshot<CapT, CostT> > phase_start;
+    vector<CapT> phase_start_excess;
+    vector<int64_t> phase_start_potentials;
+    uint64_t num_phases = 0;
+    int64_t last_eps = 0;
+    bool out_of_budget = false;
+    bool abandoned = false;
+    int64_t start_eps = setUpCostScale() / FLAGS_alpha_scaling_factor;
+    if (warm_start_) {
+      start_eps = min(start_eps, loadWarmStart(potentials));
+      LOG(INFO) << "Warm start at eps = " << start_eps;
+    }
+    // The fixed schedule divides eps by alpha. The adaptive one starts
+    // there and adjusts the divisor after every phase.
+    bool adaptive_schedule = !FLAGS_eps_schedule.compare("adaptive");
+    int64_t eps_divisor = FLAGS_alpha_scaling_factor;
+    last_halving_work_ = 0;
+    growing_divisor_ = true;
+    for (int64_t eps = start_eps; eps >= 1;
+         eps = eps < eps_divisor && eps > 1 ? 1 : eps / eps_divisor) {
+      // The first phase always completes because it establishes the
+      // feasible flow.
+      if (num_phases > 0 && budget_.isExhausted(num_phases)) {
+        out_of_budget = true;
+        break;
       }
+      bool interruptible = budget_.canInterrupt() && num_phases > 0;
+      if (interruptible) {
+        if (phase_start) {
+          phase_start->capture();
+        } else {
+          phase_start.reset(new GraphSnapshot<CapT, CostT>(graph_));
+        }
+        phase_start_excess = nodes_excess;
+        phase_start_potentials.assign(potentials.begin(),
+                                      potentials.begin() + num_nodes);
+      }
+      TRACE(TRACE_ITERATION, TRACE_PHASE, eps, 0, 0);
+      uint32_t phase_start_pushes = pushes_cnt;
+      uint32_t phase_start_relabels = relabel_cnt;
+      bool completed;
+      int64_t refine_time_us;
+      {
+        ScopedStatsTimer refine_timer(stats, REFINE_TIMER);
+        if (eps <= pow(FLAGS_alpha_scaling_factor,
+                       log(num_nodes) / log(FLAGS_alpha_scaling_factor))) {
+          //if (!priceRefinement(potentials, eps)) {
+          completed = refine(potentials, eps, interruptible);
+          //      }
+        } else {
+          completed = refine(potentials, eps, interruptible);
+        }
+        refine_time_us = refine_timer.get_elapsed_us();
+      }
+      if (!completed && !interruptible) {
+        // Only a stopped solve gives up on a phase it can't undo.
+        abandoned = true;
+        break;
+      }
+      if (!completed) {
+        phase_start->restore();
+        nodes_excess = phase_start_excess;
+        copy(phase_start_potentials.begin(), phase_start_potentials.end(),
+             potentials.begin());
+        out_of_budget = true;
+        break;
+      }
+      stats.addPhase(eps, refine_time_us, pushes_cnt - phase_start_pushes,
+                     relabel_cnt - phase_start_relabels);
+      last_eps = eps;
+      num_phases++;
+      // The work of the first phase includes finding a feasible flow.
+      if (adaptive_schedule && num_phases > 1) {
+        eps_divisor = nextEpsDivisor(eps_divisor,
+                                     pushes_cnt - phase_start_pushes +
+                                     relabel_cnt - phase_start_relabels);
+      }
+      ScopedStatsTimer arc_fixing_timer(stats, ARC_FIXING_TIMER);
       arcsFixing(potentials, 2 * (num_nodes - 1) * eps);
     }
-    arcsUnfixing(potentials, numeric_limits<int64_t>::max());
+    {
+      ScopedStatsTimer arc_fixing_timer(stats, ARC_FIXING_TIMER);
+      arcsUnfixing(potentials, numeric_limits<int64_t>::max());
+    }
+    // The gap is bounded with the scaled potentials, before they are
+    // rounded.
+    if (out_of_budget) {
+      recordOptimalityGap(potentials);
+    }
+    scaleDownPotentials(potentials);
+    stats.addCount(PUSHES, pushes_cnt);
+    stats.addCount(RELABELS, relabel_cnt);
+    stats.addCount(ARC_SCANS, arc_scans_cnt);
+    if (abandoned) {
+      SolutionQuality& quality = graph_.get_solution_quality();
+      quality.optimal = false;
+      quality.cost_gap = -1;
+      LOG(ERROR) << "Stopped after " << num_phases << " phases";
+    } else if (out_of_budget) {
+      LOG(ERROR) << "Out of budget after " << num_phases << " phases, eps = "
+                 << last_eps;
+    }
+    exportPotentials(graph_, potentials);
     LOG(ERROR) << "Num relables: " << relabel_cnt;
     LOG(ERROR) << "Num pushes: " << pushes_cnt;
   }
 
-  void CostScaling::globalPotentialsUpdate(vector<int64_t>& potential,
-                                           int64_t eps) {
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::globalPotentialsUpdate(
+      vector<int64_t>& potential, int64_t eps) {
     uint32_t num_nodes = graph_.get_num_nodes();
-    // Variable used to denote an empty bucket.
     uint32_t max_rank = FLAGS_alpha_scaling_factor * num_nodes;
-    uint32_t bucket_end = num_nodes + 1;
-    vector<int64_t> rank(num_nodes + 1, 0);
-    vector<uint32_t> bucket(max_rank + 1, 0);
-    vector<uint32_t> bucket_prev(num_nodes + 1, 0);
-    vector<uint32_t> bucket_next(num_nodes + 1, 0);
-    vector<int32_t>& nodes_demand = graph_.get_nodes_demand();
-    vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
+    // Variable used to denote an empty bucket.
+    uint32_t bucket_end = 0;
+    workspace_.reserveNodes(num_nodes);
+    workspace_.reserveBuckets(max_rank);
+    workspace_.clearBuckets();
+    vector<int64_t>& rank = workspace_.get_rank();
+    vector<uint32_t>& bucket_prev = workspace_.get_bucket_prev();
+    vector<uint32_t>& bucket_next = workspace_.get_bucket_next();
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
     uint32_t num_active_nodes = 0;
-    // Initialize buckets.
-    for (uint32_t cur_rank = 0; cur_rank <= max_rank; ++cur_rank) {
-      bucket[cur_rank] = bucket_end;
-    }
     // Put nodes with negative excess in bucket[0].
     for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
-      if (nodes_demand[node_id] < 0) {
+      if (nodes_excess[node_id] < 0) {
         rank[node_id] = 0;
-        bucket_next[node_id] = bucket[0];
-        bucket_prev[bucket[0]] = node_id;
-        bucket[0] = node_id;
+        bucket_next[node_id] = workspace_.get_bucket(0);
+        bucket_prev[workspace_.get_bucket(0)] = node_id;
+        workspace_.set_bucket(0, node_id);
       } else {
         rank[node_id] = max_rank + 1;
-        if (nodes_demand[node_id] > 0) {
+        if (nodes_excess[node_id] > 0) {
           num_active_nodes++;
         }
       }
@@ -171,26 +585,29 @@ namespace flowlessly {
     if (num_active_nodes == 0) {
       return;
     }
-    int32_t bucket_index = 0;
+    int64_t bucket_index = 0;
     for ( ; num_active_nodes > 0 && bucket_index <= max_rank; ++bucket_index) {
-      while (bucket[bucket_index] != bucket_end) {
-        uint32_t node_id = bucket[bucket_index];
-        bucket[bucket_index] = bucket_next[node_id];
-        map<uint32_t, Arc*>::const_iterator it = arcs[node_id].begin();
-        map<uint32_t, Arc*>::const_iterator end_it = arcs[node_id].end();
+      while (workspace_.get_bucket(bucket_index) != bucket_end) {
+        uint32_t node_id = workspace_.get_bucket(bucket_index);
+        workspace_.set_bucket(bucket_index, bucket_next[node_id]);
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+          arcs[node_id].begin();
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+          arcs[node_id].end();
         for (; it != end_it; ++it) {
-          Arc* rev_arc = it->second->reverse_arc;
+          Arc<CapT, CostT>* rev_arc = it->second->reverse_arc;
           if (rev_arc->cap > 0 && bucket_index < rank[it->first]) {
-            int64_t k = floor((rev_arc->cost + potential[it->first] -
+            int64_t k = floor((scaledCost(rev_arc) + potential[it->first] -
                                potential[node_id]) / eps) + 1 + bucket_index;
             int64_t old_rank = rank[it->first];
-            if (k < rank[it->first]) {
+            // Nodes past the last bucket end up with the last rank.
+            if (k < rank[it->first] && k <= max_rank) {
               rank[it->first] = k;
               // Remove node from the old bucket.
               if (old_rank <= max_rank) {
                 // Check if node is first element.
-                if (bucket[old_rank] == it->first) {
-                  bucket[old_rank] = bucket_next[it->first];
+                if (workspace_.get_bucket(old_rank) == it->first) {
+                  workspace_.set_bucket(old_rank, bucket_next[it->first]);
                 } else {
                   uint32_t prev = bucket_prev[it->first];
                   uint32_t next = bucket_next[it->first];
@@ -199,13 +616,13 @@ namespace flowlessly {
                 }
               }
               // Insert into the new bucket.
-              bucket_next[it->first] = bucket[k];
-              bucket_prev[bucket[k]] = it->first;
-              bucket[k] = it->first;
+              bucket_next[it->first] = workspace_.get_bucket(k);
+              bucket_prev[workspace_.get_bucket(k)] = it->first;
+              workspace_.set_bucket(k, it->first);
             }
           }
         }
-        if (nodes_demand[node_id] > 0) {
+        if (nodes_excess[node_id] > 0) {
           num_active_nodes--;
         }
         if (num_active_nodes == 0) {
@@ -217,33 +634,173 @@ namespace flowlessly {
       }
     }
     for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
-      int64_t min_rank = min(rank[node_id], (int64_t)bucket_index);
+      int64_t min_rank = min(rank[node_id], bucket_index);
       if (min_rank > 0) {
         potential[node_id] -= eps * min_rank;
       }
     }
   }
 
-  bool CostScaling::priceRefinement(vector<int64_t>& potential, int64_t eps) {
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::parallelGlobalPotentialsUpdate(
+      vector<int64_t>& potential, int64_t eps) {
+    uint32_t num_nodes = graph_.get_num_nodes();
+    int64_t max_rank = FLAGS_alpha_scaling_factor * num_nodes;
+    uint32_t num_threads = pool_->get_num_threads();
+    workspace_.reserveNodes(num_nodes);
+    vector<int64_t>& rank = workspace_.get_rank();
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    // Put the nodes with a deficit in bucket 0 and count the active ones.
+    runOnThreads([&](uint32_t thread_index) {
+        rank_buckets[thread_index].clear();
+        vector<uint32_t>& bucket = rank_buckets[thread_index][0];
+        uint32_t num_active_nodes = 0;
+        uint32_t end_node_id = getFirstNode(thread_index + 1);
+        for (uint32_t node_id = getFirstNode(thread_index);
+             node_id < end_node_id; ++node_id) {
+          if (nodes_excess[node_id] < 0) {
+            rank[node_id] = 0;
+            bucket.push_back(node_id);
+          } else {
+            rank[node_id] = max_rank + 1;
+            if (nodes_excess[node_id] > 0) {
+              num_active_nodes++;
+            }
+          }
+        }
+        thread_counts[thread_index] = num_active_nodes;
+      }, true);
+    uint32_t num_active_nodes = 0;
+    for (uint32_t thread_index = 0; thread_index < num_threads;
+         ++thread_index) {
+      num_active_nodes += thread_counts[thread_index];
+    }
+    if (num_active_nodes == 0) {
+      return;
+    }
+    int64_t bucket_index = 0;
+    while (num_active_nodes > 0) {
+      bucket_index = max_rank + 1;
+      for (uint32_t thread_index = 0; thread_index < num_threads;
+           ++thread_index) {
+        if (!rank_buckets[thread_index].empty()) {
+          bucket_index = min(bucket_index,
+                             rank_buckets[thread_index].begin()->first);
+        }
+      }
+      if (bucket_index > max_rank) {
+        break;
+      }
+      // A node waits in every bucket its rank dropped to, but only the
+      // bucket of its rank counts.
+      size_t bucket_size = 0;
+      for (uint32_t thread_index = 0; thread_index < num_threads;
+           ++thread_index) {
+        vector<uint32_t>& frontier = frontiers[thread_index];
+        frontier.clear();
+        map<int64_t, vector<uint32_t> >& buckets = rank_buckets[thread_index];
+        typename map<int64_t, vector<uint32_t> >::iterator bucket_it =
+          buckets.find(bucket_index);
+        if (bucket_it == buckets.end()) {
+          continue;
+        }
+        for (vector<uint32_t>::iterator it = bucket_it->second.begin();
+             it != bucket_it->second.end(); ++it) {
+          if (rank[*it] == bucket_index) {
+            frontier.push_back(*it);
+            if (nodes_excess[*it] > 0) {
+              num_active_nodes--;
+            }
+          }
+        }
+        buckets.erase(bucket_it);
+        bucket_size += frontier.size();
+      }
+      if (num_active_nodes == 0) {
+        break;
+      }
+      bool parallel = bucket_size >= kMinParallelBucket;
+      runOnThreads([&](uint32_t thread_index) {
+          vector<vector<RankUpdate> >& updates = rank_updates[thread_index];
+          vector<uint32_t>& frontier = frontiers[thread_index];
+          for (vector<uint32_t>::iterator node_it = frontier.begin();
+               node_it != frontier.end(); ++node_it) {
+            uint32_t node_id = *node_it;
+            typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+              arcs[node_id].begin();
+            typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+              arcs[node_id].end();
+            for (; it != end_it; ++it) {
+              Arc<CapT, CostT>* rev_arc = it->second->reverse_arc;
+              if (rev_arc->cap > 0 && bucket_index < rank[it->first]) {
+                int64_t k = (scaledCost(rev_arc) + potential[it->first] -
+                             potential[node_id]) / eps + 1 + bucket_index;
+                if (k < rank[it->first] && k <= max_rank) {
+                  RankUpdate update = {it->first, k};
+                  updates[getNodeOwner(it->first)].push_back(update);
+                }
+              }
+            }
+          }
+        }, parallel);
+      runOnThreads([&](uint32_t thread_index) {
+          map<int64_t, vector<uint32_t> >& buckets =
+            rank_buckets[thread_index];
+          for (uint32_t sender = 0; sender < num_threads; ++sender) {
+            vector<RankUpdate>& updates = rank_updates[sender][thread_index];
+            for (vector<RankUpdate>::iterator it = updates.begin();
+                 it != updates.end(); ++it) {
+              if (it->rank < rank[it->node_id]) {
+                rank[it->node_id] = it->rank;
+                buckets[it->rank].push_back(it->node_id);
+              }
+            }
+            updates.clear();
+          }
+        }, parallel);
+    }
+    runOnThreads([&](uint32_t thread_index) {
+        uint32_t end_node_id = getFirstNode(thread_index + 1);
+        for (uint32_t node_id = getFirstNode(thread_index);
+             node_id < end_node_id; ++node_id) {
+          int64_t min_rank = min(rank[node_id], bucket_index);
+          if (min_rank > 0) {
+            potential[node_id] -= eps * min_rank;
+          }
+        }
+      }, true);
+  }
+
+  template<typename CapT, typename CostT>
+  bool CostScaling<CapT, CostT>::priceRefinement(vector<int64_t>& potential,
+                                                 int64_t eps) {
     uint32_t num_nodes = graph_.get_num_nodes();
     uint32_t max_rank = FLAGS_alpha_scaling_factor * num_nodes;
-    vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
-    vector<uint32_t> ordered_nodes;
-    vector<int64_t> distance(num_nodes + 1, 0);
-    uint32_t bucket_end = num_nodes + 1;
-    vector<uint32_t> bucket(max_rank + 1, 0);
-    vector<uint32_t> bucket_prev(num_nodes + 1, 0);
-    vector<uint32_t> bucket_next(num_nodes + 1, 0);
-    if (!graph_.orderTopologically(potential, ordered_nodes)) {
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    uint32_t bucket_end = 0;
+    workspace_.reserveNodes(num_nodes);
+    workspace_.reserveBuckets(max_rank);
+    workspace_.clearBuckets();
+    vector<uint32_t>& ordered_nodes = workspace_.get_node_queue();
+    ordered_nodes.clear();
+    // The ranks hold the distances in units of eps.
+    vector<int64_t>& distance = workspace_.get_rank();
+    fill(distance.begin(), distance.begin() + num_nodes + 1, 0);
+    vector<uint32_t>& bucket_prev = workspace_.get_bucket_prev();
+    vector<uint32_t>& bucket_next = workspace_.get_bucket_next();
+    if (!graph_.orderTopologically(potential, cost_scale_, ordered_nodes)) {
       // Graph contains a cycle. Cannot update potential
       return false;
     }
     for (vector<uint32_t>::iterator node_it = ordered_nodes.begin();
          node_it != ordered_nodes.end(); ++node_it) {
-      map<uint32_t, Arc*>::const_iterator it = arcs[*node_it].begin();
-      map<uint32_t, Arc*>::const_iterator end_it = arcs[*node_it].end();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[*node_it].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[*node_it].end();
       for (; it != end_it; ++it) {
-        int64_t reduced_cost = ceil((it->second->cost + potential[*node_it] -
+        int64_t reduced_cost = ceil((scaledCost(it->second) +
+                                     potential[*node_it] -
                                      potential[it->first]) / eps);
         if (distance[*node_it] + reduced_cost < distance[it->first]) {
           distance[it->first] = distance[*node_it] + reduced_cost;
@@ -253,16 +810,18 @@ namespace flowlessly {
     // Insert node_id at -distance[node_id].
     for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
       uint32_t bucket_index = -distance[node_id];
-      bucket_next[node_id] = bucket[bucket_index];
-      bucket_prev[bucket[bucket_index]] = node_id;
-      bucket[bucket_index] = node_id;
+      bucket_next[node_id] = workspace_.get_bucket(bucket_index);
+      bucket_prev[workspace_.get_bucket(bucket_index)] = node_id;
+      workspace_.set_bucket(bucket_index, node_id);
     }
     for (int32_t bucket_index = max_rank; bucket_index >= 0; --bucket_index) {
-      while (bucket[bucket_index] != bucket_end) {
-        uint32_t node_id = bucket[bucket_index];
-        bucket[bucket_index] = bucket_next[node_id];
-        map<uint32_t, Arc*>::const_iterator it = arcs[node_id].begin();
-        map<uint32_t, Arc*>::const_iterator end_it = arcs[node_id].end();
+      while (workspace_.get_bucket(bucket_index) != bucket_end) {
+        uint32_t node_id = workspace_.get_bucket(bucket_index);
+        workspace_.set_bucket(bucket_index, bucket_next[node_id]);
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+          arcs[node_id].begin();
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+          arcs[node_id].end();
         for (; it != end_it; ++it) {
         }
       }
@@ -272,21 +831,31 @@ namespace flowlessly {
 
   // NOTE: if threshold is set to a smaller value than 2*n*eps then the
   // problem may become infeasable. Check the paper.
-  void CostScaling::arcsFixing(vector<int64_t>& potential,
-                               int64_t fix_threshold) {
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::arcsFixing(vector<int64_t>& potential,
+                                            int64_t fix_threshold) {
+    if (isParallel(ARC_FIXING_PASS)) {
+      parallelArcsFixing(potential, fix_threshold);
+      return;
+    }
     uint32_t num_nodes = graph_.get_num_nodes();
-    vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
-    list<Arc*>& fixed_arcs = graph_.get_fixed_arcs();
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    list<Arc<CapT, CostT>*>& fixed_arcs = graph_.get_fixed_arcs();
     for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
-      map<uint32_t, Arc*>::iterator it = arcs[node_id].begin();
-      map<uint32_t, Arc*>::iterator end_it = arcs[node_id].end();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+        arcs[node_id].end();
       while (it != end_it) {
-        if (it->second->cost + potential[node_id] - potential[it->first] >
-            fix_threshold) {
+        // The flow on a piecewise linear arc can still move between the
+        // segments the reduced cost doesn't show, so these arcs stay.
+        if (!it->second->has_segments &&
+            scaledCost(it->second) + potential[node_id] -
+            potential[it->first] > fix_threshold) {
           // Fix node.
           fixed_arcs.push_front(it->second);
           fixed_arcs.push_front(it->second->reverse_arc);
-          map<uint32_t, Arc*>::iterator to_erase_it = it;
+          typename map<uint32_t, Arc<CapT, CostT>*>::iterator to_erase_it = it;
           uint32_t dst_node_id = it->first;
           ++it;
           arcs[node_id].erase(to_erase_it);
@@ -298,18 +867,79 @@ namespace flowlessly {
     }
   }
 
+  // The arcs to fix are picked before any is removed from the adjacency
+  // maps that other threads scan. Every thread then removes them from the
+  // maps of its nodes. The fixed arcs are listed in the same order as by
+  // the sequential pass.
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::parallelArcsFixing(vector<int64_t>& potential,
+                                                    int64_t fix_threshold) {
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    list<Arc<CapT, CostT>*>& fixed_arcs = graph_.get_fixed_arcs();
+    uint32_t num_threads = pool_->get_num_threads();
+    runOnThreads([&](uint32_t thread_index) {
+        vector<Arc<CapT, CostT>*>& arcs_to_fix = thread_arcs[thread_index];
+        arcs_to_fix.clear();
+        uint32_t end_node_id = getFirstNode(thread_index + 1);
+        for (uint32_t node_id = getFirstNode(thread_index);
+             node_id < end_node_id; ++node_id) {
+          typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+            arcs[node_id].begin();
+          typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+            arcs[node_id].end();
+          for (; it != end_it; ++it) {
+            if (!it->second->has_segments &&
+                scaledCost(it->second) + potential[node_id] -
+                potential[it->first] > fix_threshold) {
+              arcs_to_fix.push_back(it->second);
+            }
+          }
+        }
+      }, true);
+    runOnThreads([&](uint32_t thread_index) {
+        for (uint32_t sender = 0; sender < num_threads; ++sender) {
+          vector<Arc<CapT, CostT>*>& arcs_to_fix = thread_arcs[sender];
+          for (typename vector<Arc<CapT, CostT>*>::iterator it =
+                 arcs_to_fix.begin(); it != arcs_to_fix.end(); ++it) {
+            uint32_t src_node_id = (*it)->src_node_id;
+            uint32_t dst_node_id = (*it)->dst_node_id;
+            if (getNodeOwner(src_node_id) == thread_index) {
+              arcs[src_node_id].erase(dst_node_id);
+            }
+            if (getNodeOwner(dst_node_id) == thread_index) {
+              arcs[dst_node_id].erase(src_node_id);
+            }
+          }
+        }
+      }, true);
+    for (uint32_t thread_index = 0; thread_index < num_threads;
+         ++thread_index) {
+      vector<Arc<CapT, CostT>*>& arcs_to_fix = thread_arcs[thread_index];
+      for (typename vector<Arc<CapT, CostT>*>::iterator it =
+             arcs_to_fix.begin(); it != arcs_to_fix.end(); ++it) {
+        fixed_arcs.push_front(*it);
+        fixed_arcs.push_front((*it)->reverse_arc);
+      }
+    }
+  }
+
   // NOTE: if threshold is set to a smaller value than 2*n*eps then the
   // problem may become infeasable. Check the paper.
-  void CostScaling::arcsUnfixing(vector<int64_t>& potential,
-                                 int64_t fix_threshold) {
-    uint32_t num_nodes = graph_.get_num_nodes();
-    vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
-    list<Arc*>& fixed_arcs = graph_.get_fixed_arcs();
-    for (list<Arc*>::iterator it = fixed_arcs.begin(); it != fixed_arcs.end(); ) {
-      if ((*it)->cost + potential[(*it)->src_node_id] -
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::arcsUnfixing(vector<int64_t>& potential,
+                                              int64_t fix_threshold) {
+    if (isParallel(ARC_FIXING_PASS)) {
+      parallelArcsUnfixing(potential, fix_threshold);
+      return;
+    }
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    list<Arc<CapT, CostT>*>& fixed_arcs = graph_.get_fixed_arcs();
+    for (typename list<Arc<CapT, CostT>*>::iterator it = fixed_arcs.begin();
+         it != fixed_arcs.end(); ) {
+      if (scaledCost(*it) + potential[(*it)->src_node_id] -
           potential[(*it)->dst_node_id] < fix_threshold) {
         // Unfix node.
-        list<Arc*>::iterator to_erase_it = it;
+        typename list<Arc<CapT, CostT>*>::iterator to_erase_it = it;
         arcs[(*it)->src_node_id][(*it)->dst_node_id] = *it;
         ++it;
         fixed_arcs.erase(to_erase_it);
@@ -319,7 +949,109 @@ namespace flowlessly {
     }
   }
 
-  void CostScaling::pushLookahead(uint32_t src_node_id, uint32_t dst_node_id) {
+  // Every thread checks its own range of the fixed arcs. The owners of
+  // the sources then put the arcs back, and they are erased from the list
+  // on this thread.
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::parallelArcsUnfixing(
+      vector<int64_t>& potential, int64_t fix_threshold) {
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    list<Arc<CapT, CostT>*>& fixed_arcs = graph_.get_fixed_arcs();
+    uint32_t num_threads = pool_->get_num_threads();
+    uint64_t num_fixed_arcs = fixed_arcs.size();
+    vector<typename list<Arc<CapT, CostT>*>::iterator> range_starts;
+    typename list<Arc<CapT, CostT>*>::iterator range_it = fixed_arcs.begin();
+    for (uint32_t thread_index = 0; thread_index < num_threads;
+         ++thread_index) {
+      range_starts.push_back(range_it);
+      advance(range_it, (thread_index + 1) * num_fixed_arcs / num_threads -
+              thread_index * num_fixed_arcs / num_threads);
+    }
+    range_starts.push_back(fixed_arcs.end());
+    runOnThreads([&](uint32_t thread_index) {
+        vector<typename list<Arc<CapT, CostT>*>::iterator>& unfixed_arcs =
+          thread_unfixed_arcs[thread_index];
+        unfixed_arcs.clear();
+        for (typename list<Arc<CapT, CostT>*>::iterator it =
+               range_starts[thread_index];
+             it != range_starts[thread_index + 1]; ++it) {
+          if (scaledCost(*it) + potential[(*it)->src_node_id] -
+              potential[(*it)->dst_node_id] < fix_threshold) {
+            unfixed_arcs.push_back(it);
+          }
+        }
+      }, true);
+    runOnThreads([&](uint32_t thread_index) {
+        for (uint32_t sender = 0; sender < num_threads; ++sender) {
+          vector<typename list<Arc<CapT, CostT>*>::iterator>& unfixed_arcs =
+            thread_unfixed_arcs[sender];
+          for (typename vector<typename list<Arc<CapT, CostT>*>::iterator>::
+                 iterator it = unfixed_arcs.begin();
+               it != unfixed_arcs.end(); ++it) {
+            Arc<CapT, CostT>* arc = **it;
+            if (getNodeOwner(arc->src_node_id) == thread_index) {
+              arcs[arc->src_node_id][arc->dst_node_id] = arc;
+            }
+          }
+        }
+      }, true);
+    for (uint32_t thread_index = 0; thread_index < num_threads;
+         ++thread_index) {
+      vector<typename list<Arc<CapT, CostT>*>::iterator>& unfixed_arcs =
+        thread_unfixed_arcs[thread_index];
+      for (typename vector<typename list<Arc<CapT, CostT>*>::iterator>::
+             iterator it = unfixed_arcs.begin(); it != unfixed_arcs.end();
+           ++it) {
+        fixed_arcs.erase(*it);
+      }
+    }
   }
 
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::pushLookahead(uint32_t src_node_id,
+                                               uint32_t dst_node_id) {
+  }
+
+  template<typename CapT, typename CostT>
+  bool CostScaling<CapT, CostT>::isParallel(CostScalingPass pass) {
+    return pool_ != NULL && (parallel_passes_ & pass) != 0;
+  }
+
+  template<typename CapT, typename CostT>
+  uint32_t CostScaling<CapT, CostT>::getFirstNode(uint32_t thread_index) {
+    uint64_t num_nodes = graph_.get_num_nodes();
+    uint32_t num_threads = pool_->get_num_threads();
+    return (thread_index * num_nodes + num_threads - 1) / num_threads + 1;
+  }
+
+  template<typename CapT, typename CostT>
+  uint32_t CostScaling<CapT, CostT>::getNodeOwner(uint32_t node_id) {
+    return static_cast<uint64_t>(node_id - 1) * pool_->get_num_threads() /
+      graph_.get_num_nodes();
+  }
+
+  template<typename CapT, typename CostT>
+  void CostScaling<CapT, CostT>::runOnThreads(
+      const function<void(uint32_t)>& step, bool parallel) {
+    uint32_t num_threads = pool_->get_num_threads();
+    for (uint32_t thread_index = 0; thread_index < num_threads;
+         ++thread_index) {
+      if (parallel) {
+        pool_->schedule([&step, thread_index]() {
+            step(thread_index);
+          });
+      } else {
+        step(thread_index);
+      }
+    }
+    if (parallel) {
+      pool_->wait();
+    }
+  }
+
+  template class CostScaling<int32_t, int32_t>;
+  template class CostScaling<int32_t, int64_t>;
+  template class CostScaling<int64_t, int32_t>;
+  template class CostScaling<int64_t, int64_t>;
+
 }
@@ -2,39 +2,148 @@
 #define FLOWLESSLY_COST_SCALING_H
 
 #include "graph.h"
+#include "solve_budget.h"
+#include "solver_workspace.h"
+#include "thread_pool.h"
 
+#include <functional>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
+#include <list>
+#include <map>
 #include <queue>
+#include <string>
+#include <vector>
 
 DECLARE_int64(alpha_scaling_factor);
+DECLARE_string(eps_schedule);
 
 namespace flowlessly {
 
   using namespace std;
 
+  // The full graph passes of a phase that can run on a thread pool.
+  enum CostScalingPass {
+    SATURATION_PASS = 1,
+    ARC_FIXING_PASS = 2,
+    GLOBAL_UPDATE_PASS = 4
+  };
+
+  // A lower rank found for a node by the global update, sent to the
+  // thread that owns the node.
+  struct RankUpdate {
+    uint32_t node_id;
+    int64_t rank;
+  };
+
+  // Sets pass_mask from a comma separated list of saturation, arc_fixing
+  // and global_update. Returns false if a pass is unknown.
+  bool parseCostScalingPasses(const string& passes, uint32_t* pass_mask);
+
+  template<typename CapT, typename CostT>
   class CostScaling {
 
   public:
-  CostScaling(Graph graph): graph_(graph) {
+  CostScaling(Graph<CapT, CostT>& graph, SolverWorkspace& workspace,
+              SolveBudget& budget):
+    graph_(graph), workspace_(workspace), budget_(budget),
+    warm_start_(false), global_update_(false), pool_(NULL),
+    parallel_passes_(0), cost_scale_(1), last_halving_work_(0),
+    growing_divisor_(true) {
     }
 
     void costScaling();
+    // Makes costScaling start from the flow and the potentials the graph
+    // holds, see Graph::readFlow and Graph::readPotentials, instead of
+    // from no flow and zero potentials. The first phase runs at the eps
+    // for which the flow is eps-optimal, which is small if the graph
+    // changed little since the flow was found.
+    void set_warm_start(bool warm_start);
+    // Makes every phase update the potentials from the distances to the
+    // nodes with a deficit once the arcs are saturated.
+    void set_global_update(bool global_update);
+    // Runs the passes of the CostScalingPass mask on the pool. Every thread
+    // owns a range of nodes and the passes give the same flow and
+    // potentials as the sequential ones. A NULL pool runs them all
+    // sequentially.
+    void set_parallel_passes(ThreadPool* pool, uint32_t passes);
 
   private:
-    Graph graph_;
+    Graph<CapT, CostT>& graph_;
+    SolverWorkspace& workspace_;
+    SolveBudget& budget_;
+    bool warm_start_;
+    bool global_update_;
+    ThreadPool* pool_;
+    uint32_t parallel_passes_;
+    // The algorithm works on the arc costs multiplied by alpha * n, which
+    // makes eps = 1 small enough for optimality. The arc costs themselves
+    // are never changed.
+    int64_t cost_scale_;
+    // State of the adaptive eps schedule.
+    double last_halving_work_;
+    bool growing_divisor_;
+    vector<CapT> nodes_excess;
     uint32_t relabel_cnt;
     uint32_t pushes_cnt;
+    uint64_t arc_scans_cnt;
+    // Scratch of the parallel passes, by thread.
+    vector<vector<CapT> > excess_deltas;
+    vector<vector<Arc<CapT, CostT>*> > thread_arcs;
+    // The fixed arcs every thread found to unfix in its range of the list.
+    vector<vector<typename list<Arc<CapT, CostT>*>::iterator> >
+      thread_unfixed_arcs;
+    vector<uint32_t> thread_counts;
+    // The buckets of the global update by rank, of the nodes every thread
+    // owns.
+    vector<map<int64_t, vector<uint32_t> > > rank_buckets;
+    vector<vector<uint32_t> > frontiers;
+    // The updates sent by every thread to every thread.
+    vector<vector<vector<RankUpdate> > > rank_updates;
 
-    void refine(vector<int64_t>& potential, int64_t eps);
+    // Returns false if it was interrupted by the deadline or stopped. Only
+    // an interruptible refine checks the deadline.
+    bool refine(vector<int64_t>& potential, int64_t eps, bool interruptible);
     void discharge(queue<uint32_t>& active_nodes, vector<int64_t>& potential,
-                   vector<int32_t>& nodes_demand, int64_t eps);
-    int64_t scaleUpCosts();
+                   vector<CapT>& nodes_excess, int64_t eps);
+    // Pushes flow on the arcs with a negative reduced cost until they have
+    // no capacity left, which makes the flow 0-optimal.
+    void saturateArcs(vector<int64_t>& potentials);
+    void parallelSaturateArcs(vector<int64_t>& potentials);
+    int64_t scaledCost(const Arc<CapT, CostT>* arc) const;
+    // Sets cost_scale_. Returns the value from where eps should start.
+    int64_t setUpCostScale();
+    // Picks the divisor of the next eps from the pushes and relabels of
+    // the last phase, which ran at the eps eps_divisor gave.
+    int64_t nextEpsDivisor(int64_t eps_divisor, uint64_t phase_work);
+    // Takes the flow and the potentials of the graph. Returns the eps for
+    // which the flow is eps-optimal.
+    int64_t loadWarmStart(vector<int64_t>& potentials);
+    void scaleDownPotentials(vector<int64_t>& potentials);
+    // Must be called with the scaled potentials.
+    void recordOptimalityGap(const vector<int64_t>& potentials);
+    // The flow must be 0-optimal, as it is after saturateArcs. It then is
+    // eps-optimal for the new potentials.
     void globalPotentialsUpdate(vector<int64_t>& potential, int64_t eps);
+    // Processes every bucket on all the threads at once. Relaxing a bucket
+    // only fills later ones, as the reduced costs are not negative.
+    void parallelGlobalPotentialsUpdate(vector<int64_t>& potential,
+                                        int64_t eps);
     bool priceRefinement(vector<int64_t>& potential, int64_t eps);
     void arcsFixing(vector<int64_t>& potential, int64_t fix_threshold);
+    void parallelArcsFixing(vector<int64_t>& potential,
+                            int64_t fix_threshold);
     void arcsUnfixing(vector<int64_t>& potential, int64_t fix_threshold);
+    void parallelArcsUnfixing(vector<int64_t>& potential,
+                              int64_t fix_threshold);
     void pushLookahead(uint32_t src_node_id, uint32_t dst_node_id);
+    bool isParallel(CostScalingPass pass);
+    // Threads own contiguous node ranges. Returns the first node of the
+    // thread, or one past the last node for the number of threads.
+    uint32_t getFirstNode(uint32_t thread_index);
+    uint32_t getNodeOwner(uint32_t node_id);
+    // Runs the step for every thread, on the pool if parallel is true.
+    void runOnThreads(const function<void(uint32_t)>& step, bool parallel);
 
   };
 
@@ -1,5 +1,6 @@
 #include "cycle_cancelling.h"
 
+#include "trace.h"
 #include "utils.h"
 
 #include <limits>
@@ -11,48 +12,88 @@ namespace flowlessly {
   // Applies the Cycle cancelling algorithm to compute the min cost flow.
   // The complexity is O(F * M + N * M^2 * C * U)
   // NOTE: It changes the graph.
-  void CycleCancelling::cycleCancelling() {
+  template<typename CapT, typename CostT>
+  void CycleCancelling<CapT, CostT>::cycleCancelling() {
     //    Establish a feasible flow x in the network
     //    while ( Gx contains a negative cycle ) do
     //        identify a negative cycle W
     //        mr = min(r(i,j)) where (i,j) is part of W
     //        augment mr units of flow along the cycle W
     //        update Gx
+    // Adding the sink and the source changes the demands. They are restored
+    // once the flow has been computed.
+    vector<CapT> input_nodes_demand = graph_.get_nodes_demand();
+    graph_.get_solution_quality() = SolutionQuality();
     if (!graph_.hasSinkAndSource()) {
       graph_.addSinkAndSource();
     }
-    maxFlow(graph_);
+    maxFlow(graph_, workspace_);
     graph_.removeSinkAndSource();
-    graph_.logGraph();
-    uint32_t num_nodes = graph_.get_num_nodes() + 1;
-    vector<int64_t> distance(num_nodes, numeric_limits<int64_t>::max());
-    vector<uint32_t> predecessor(num_nodes, 0);
-    BellmanFord(graph_, graph_.get_source_nodes(), distance, predecessor);
-    logCosts(distance, predecessor);
-    bool removed_cycle = removeNegativeCycles(distance, predecessor);
-    graph_.logGraph();
+    TRACE_CALL(TRACE_ITERATION, graph_.traceArcs());
+    uint32_t cycle_node = findShortestPaths();
+    TRACE_CALL(TRACE_ITERATION,
+               traceCosts(workspace_, graph_.get_num_nodes()));
+    bool removed_cycle = removeNegativeCycles(cycle_node);
+    TRACE_CALL(TRACE_ITERATION, graph_.traceArcs());
+    uint64_t num_cancelled_cycles = 0;
     while (removed_cycle) {
-      fill(distance.begin(), distance.end(), numeric_limits<int64_t>::max());
-      fill(predecessor.begin(), predecessor.end(), 0);
-      BellmanFord(graph_, graph_.get_source_nodes(), distance, predecessor);
-      logCosts(distance, predecessor);
-      removed_cycle = removeNegativeCycles(distance, predecessor);
-      graph_.logGraph();
+      // The flow is feasible after every cancelled cycle, but there is no
+      // cheap bound on its distance from the optimum.
+      if (budget_.isExhausted(++num_cancelled_cycles)) {
+        graph_.get_solution_quality().optimal = false;
+        graph_.get_solution_quality().cost_gap = -1;
+        break;
+      }
+      cycle_node = findShortestPaths();
+      TRACE_CALL(TRACE_ITERATION,
+                 traceCosts(workspace_, graph_.get_num_nodes()));
+      removed_cycle = removeNegativeCycles(cycle_node);
+      TRACE_CALL(TRACE_ITERATION, graph_.traceArcs());
+    }
+    workspace_.get_stats().addCount(CANCELLED_CYCLES, num_cancelled_cycles);
+    graph_.get_nodes_demand() = input_nodes_demand;
+    exportPotentials(graph_, vector<int64_t>());
+  }
+
+  template<typename CapT, typename CostT>
+  void CycleCancelling<CapT, CostT>::set_shortest_path_pool(
+      ThreadPool* pool) {
+    delta_stepping_.reset(pool == NULL ? NULL :
+                          new DeltaStepping<CapT, CostT>(graph_, *pool));
+  }
+
+  template<typename CapT, typename CostT>
+  uint32_t CycleCancelling<CapT, CostT>::findShortestPaths() {
+    if (delta_stepping_) {
+      return delta_stepping_->findShortestPaths(graph_.get_source_nodes(),
+                                                workspace_);
     }
+    BellmanFord(graph_, graph_.get_source_nodes(), workspace_);
+    return 0;
   }
 
-  bool CycleCancelling::removeNegativeCycles(vector<int64_t>& distance,
-                                             vector<uint32_t>& predecessor) {
+  template<typename CapT, typename CostT>
+  bool CycleCancelling<CapT, CostT>::removeNegativeCycles(
+      uint32_t cycle_node) {
+    if (cycle_node != 0) {
+      augmentFlow(cycle_node, cycle_node);
+      return true;
+    }
     uint32_t num_nodes = graph_.get_num_nodes() + 1;
-    const vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
+    const vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    const vector<int64_t>& distance = workspace_.get_distance();
     for (uint32_t node_id = 1; node_id < num_nodes; ++node_id) {
-      map<uint32_t, Arc*>::const_iterator it = arcs[node_id].begin();
-      map<uint32_t, Arc*>::const_iterator end_it = arcs[node_id].end();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
       for (; it != end_it; ++it) {
+        // Nodes that were not reached don't have a predecessor.
         if (it->second->cap > 0 &&
+            distance[node_id] < numeric_limits<int64_t>::max() &&
             distance[node_id] + it->second->cost < distance[it->first]) {
           // Found negative cycle.
-          augmentFlow(predecessor, node_id, it->first);
+          augmentFlow(node_id, it->first);
           return true;
         }
       }
@@ -60,37 +101,39 @@ namespace flowlessly {
     return false;
   }
 
-  void CycleCancelling::augmentFlow(vector<uint32_t>& predecessor,
-                                    uint32_t src_node, uint32_t dst_node) {
-    LOG(INFO) << "Negative cycle closed by: (" << src_node << ", "
-              << dst_node << ")";
-    uint32_t num_nodes = graph_.get_num_nodes() + 1;
-    vector<bool> seen(num_nodes, false);
-    vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
-    vector<int32_t>& nodes_demand = graph_.get_nodes_demand();
-    int32_t min_flow = numeric_limits<int32_t>::max();
+  template<typename CapT, typename CostT>
+  void CycleCancelling<CapT, CostT>::augmentFlow(uint32_t src_node,
+                                                 uint32_t dst_node) {
+    vector<uint32_t>& predecessor = workspace_.get_predecessor();
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    vector<CapT>& nodes_demand = graph_.get_nodes_demand();
+    CapT min_flow = numeric_limits<CapT>::max();
     uint32_t cur_node = src_node;
     // Detect the node where the cycle ends.
-    for (; !seen[cur_node];
-         seen[cur_node] = true, cur_node = predecessor[cur_node]);
+    workspace_.clearMarks();
+    for (; !workspace_.isMarked(cur_node);
+         workspace_.mark(cur_node), cur_node = predecessor[cur_node]);
     dst_node = cur_node;
     // Compute the minimum residual in the cycle.
     do {
-      Arc* arc = arcs[predecessor[cur_node]][cur_node];
+      Arc<CapT, CostT>* arc = arcs[predecessor[cur_node]][cur_node];
       min_flow = min(min_flow, arc->cap);
-      LOG(INFO) << "Negative cycle: (" << predecessor[cur_node] << ", "
-                << cur_node << ")";
       cur_node = predecessor[cur_node];
     } while (cur_node != dst_node);
-    LOG(INFO) << "Augmenting negative cycle with flow: " << min_flow;
     do {
-      Arc* arc = arcs[predecessor[cur_node]][cur_node];
-      arc->cap -= min_flow;
-      arc->reverse_arc->cap += min_flow;
+      Arc<CapT, CostT>* arc = arcs[predecessor[cur_node]][cur_node];
+      TRACE(TRACE_ARC, TRACE_CYCLE_ARC, predecessor[cur_node], cur_node,
+            min_flow);
+      arc->pushFlow(min_flow);
       nodes_demand[predecessor[cur_node]] -= min_flow;
       nodes_demand[cur_node] += min_flow;
       cur_node = predecessor[cur_node];
     } while (cur_node != dst_node);
   }
 
+  template class CycleCancelling<int32_t, int32_t>;
+  template class CycleCancelling<int32_t, int64_t>;
+  template class CycleCancelling<int64_t, int32_t>;
+  template class CycleCancelling<int64_t, int64_t>;
+
 }
@@ -1,26 +1,45 @@
 #ifndef FLOWLESSLY_CYCLE_CANCELLING_H
 #define FLOWLESSLY_CYCLE_CANCELLING_H
 
+#include "delta_stepping.h"
 #include "graph.h"
+#include "solve_budget.h"
+#include "solver_workspace.h"
+#include "thread_pool.h"
+
+#include <memory>
 
 namespace flowlessly {
 
+  template<typename CapT, typename CostT>
   class CycleCancelling {
 
   public:
-  CycleCancelling(Graph graph): graph_(graph) {
+  CycleCancelling(Graph<CapT, CostT>& graph, SolverWorkspace& workspace,
+                  SolveBudget& budget):
+    graph_(graph), workspace_(workspace), budget_(budget) {
     }
 
     void cycleCancelling();
+    // Runs the shortest path searches with delta-stepping on the pool
+    // instead of Bellman-Ford.
+    void set_shortest_path_pool(ThreadPool* pool);
 
   private:
-    Graph graph_;
-
-    // Returns true if it removes a negative cycle.
-    bool removeNegativeCycles(vector<int64_t>& distance,
-                              vector<uint32_t>& predecessor);
-    void augmentFlow(vector<uint32_t>& predecessor,
-                     uint32_t src_node, uint32_t dst_node);
+    Graph<CapT, CostT>& graph_;
+    SolverWorkspace& workspace_;
+    SolveBudget& budget_;
+
+    unique_ptr<DeltaStepping<CapT, CostT> > delta_stepping_;
+
+    // Returns a node on a negative cycle if the search stopped on one,
+    // or 0.
+    uint32_t findShortestPaths();
+    // Returns true if it removes a negative cycle. It uses the distances and
+    // the predecessors left in the workspace by the last search. A search
+    // that stopped on a negative cycle gives its cycle_node.
+    bool removeNegativeCycles(uint32_t cycle_node);
+    void augmentFlow(uint32_t src_node, uint32_t dst_node);
 
   };
 
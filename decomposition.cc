@@ -0,0 +1,226 @@
+#include "decomposition.h"
+
+#include <algorithm>
+#include <glog/logging.h>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Lock-free find with path halving. A node's parent is only ever replaced
+  // by one of its ancestors, so concurrent halving steps are safe.
+  template<typename CapT, typename CostT>
+  uint32_t GraphDecomposition<CapT, CostT>::find(
+      vector<atomic<uint32_t> >& parent, uint32_t node_id) {
+    uint32_t parent_id = parent[node_id].load(memory_order_relaxed);
+    while (parent_id != node_id) {
+      uint32_t grand_parent_id = parent[parent_id].load(memory_order_relaxed);
+      if (grand_parent_id != parent_id) {
+        parent[node_id].compare_exchange_weak(parent_id, grand_parent_id,
+                                              memory_order_relaxed);
+      }
+      node_id = parent_id;
+      parent_id = parent[node_id].load(memory_order_relaxed);
+    }
+    return node_id;
+  }
+
+  // Roots are always linked under the root with the smaller id, which keeps
+  // the forest acyclic when several threads link at the same time.
+  template<typename CapT, typename CostT>
+  void GraphDecomposition<CapT, CostT>::unite(
+      vector<atomic<uint32_t> >& parent, uint32_t node_id,
+      uint32_t other_node_id) {
+    while (true) {
+      uint32_t root = find(parent, node_id);
+      uint32_t other_root = find(parent, other_node_id);
+      if (root == other_root) {
+        return;
+      }
+      if (root < other_root) {
+        swap(root, other_root);
+      }
+      uint32_t expected = root;
+      if (parent[root].compare_exchange_strong(expected, other_root)) {
+        return;
+      }
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  uint32_t GraphDecomposition<CapT, CostT>::decompose() {
+    uint32_t num_nodes = graph_.get_num_nodes();
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    vector<atomic<uint32_t> > parent(num_nodes + 1);
+    for (uint32_t node_id = 0; node_id <= num_nodes; ++node_id) {
+      parent[node_id].store(node_id, memory_order_relaxed);
+    }
+    // Every thread unites the endpoints of the arcs of a node range.
+    uint32_t num_threads = pool_.get_num_threads();
+    uint32_t range_size = num_nodes / num_threads + 1;
+    for (uint32_t range_start = 1; range_start <= num_nodes;
+         range_start += range_size) {
+      uint32_t range_end = min(num_nodes + 1, range_start + range_size);
+      pool_.schedule([this, &arcs, &parent, range_start, range_end] {
+          for (uint32_t node_id = range_start; node_id < range_end;
+               ++node_id) {
+            typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+              arcs[node_id].begin();
+            typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+              arcs[node_id].end();
+            for (; it != end_it; ++it) {
+              if (node_id < it->first) {
+                unite(parent, node_id, it->first);
+              }
+            }
+          }
+        });
+    }
+    pool_.wait();
+    // The root of a component is its smallest node, so the components are
+    // numbered in the order of their first node.
+    vector<uint32_t> component_of_root(num_nodes + 1, 0);
+    components.clear();
+    local_node_id.assign(num_nodes + 1, 0);
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      uint32_t root = find(parent, node_id);
+      if (root == node_id) {
+        component_of_root[root] = components.size();
+        components.push_back(vector<uint32_t>());
+      }
+      vector<uint32_t>& component = components[component_of_root[root]];
+      component.push_back(node_id);
+      local_node_id[node_id] = component.size();
+    }
+    uint32_t num_components = 0;
+    for (vector<vector<uint32_t> >::iterator it = components.begin();
+         it != components.end(); ++it) {
+      if (it->size() > 1) {
+        num_components++;
+      }
+    }
+    LOG(INFO) << "The graph has " << num_components << " components with arcs";
+    return num_components;
+  }
+
+  template<typename CapT, typename CostT>
+  void GraphDecomposition<CapT, CostT>::solveComponents(
+      const function<void(Graph<CapT, CostT>&, SolverWorkspace&,
+                          SolveBudget&)>& solve,
+      SolveBudget& budget, SolverStats& stats) {
+    graph_.get_solution_quality() = SolutionQuality();
+    graph_.get_potentials().clear();
+    if (graph_.get_export_potentials()) {
+      graph_.get_potentials().assign(graph_.get_num_nodes() + 1, 0);
+    }
+    for (uint32_t component = 0; component < components.size();
+         ++component) {
+      // A single node component doesn't have any arcs.
+      if (components[component].size() < 2) {
+        continue;
+      }
+      pool_.schedule([this, component, &solve, &budget, &stats] {
+          // The workspace lives as long as the worker thread.
+          static thread_local SolverWorkspace workspace;
+          workspace.set_stats(&stats);
+          Graph<CapT, CostT> subgraph;
+          buildSubgraph(component, subgraph);
+          solve(subgraph, workspace, budget);
+          addSolutionQuality(subgraph);
+          restoreArcs(component, subgraph);
+        });
+    }
+    pool_.wait();
+    if (!graph_.get_solution_quality().optimal) {
+      graph_.get_potentials().clear();
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void GraphDecomposition<CapT, CostT>::buildSubgraph(
+      uint32_t component, Graph<CapT, CostT>& subgraph) {
+    vector<uint32_t>& nodes = components[component];
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    vector<CapT>& nodes_demand = graph_.get_nodes_demand();
+    uint32_t num_arcs = 0;
+    for (vector<uint32_t>::iterator it = nodes.begin(); it != nodes.end();
+         ++it) {
+      num_arcs += arcs[*it].size();
+    }
+    subgraph.initNodes(nodes.size(), num_arcs / 2);
+    subgraph.set_export_potentials(graph_.get_export_potentials());
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& sub_arcs = subgraph.get_arcs();
+    vector<CapT>& sub_nodes_demand = subgraph.get_nodes_demand();
+    for (uint32_t index = 0; index < nodes.size(); ++index) {
+      uint32_t node_id = index + 1;
+      sub_nodes_demand[node_id] = nodes_demand[nodes[index]];
+      if (sub_nodes_demand[node_id] > 0) {
+        subgraph.get_source_nodes().push_back(node_id);
+      } else if (sub_nodes_demand[node_id] < 0) {
+        subgraph.get_sink_nodes().push_back(node_id);
+      }
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+        arcs[nodes[index]].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+        arcs[nodes[index]].end();
+      for (; it != end_it; ++it) {
+        uint32_t dst_node_id = local_node_id[it->first];
+        it->second->src_node_id = node_id;
+        it->second->dst_node_id = dst_node_id;
+        sub_arcs[node_id][dst_node_id] = it->second;
+      }
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void GraphDecomposition<CapT, CostT>::restoreArcs(
+      uint32_t component, Graph<CapT, CostT>& subgraph) {
+    vector<uint32_t>& nodes = components[component];
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& sub_arcs = subgraph.get_arcs();
+    // The components don't share nodes, so they set disjoint potentials.
+    vector<int64_t>& potentials = graph_.get_potentials();
+    vector<int64_t>& sub_potentials = subgraph.get_potentials();
+    for (uint32_t node_id = 1;
+         node_id <= nodes.size() && !sub_potentials.empty(); ++node_id) {
+      potentials[nodes[node_id - 1]] = sub_potentials[node_id];
+    }
+    for (uint32_t node_id = 1; node_id <= nodes.size(); ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+        sub_arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+        sub_arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        it->second->src_node_id = nodes[node_id - 1];
+        it->second->dst_node_id = nodes[it->first - 1];
+      }
+      // The arcs belong to the graph, not to the sub-graph.
+      sub_arcs[node_id].clear();
+    }
+  }
+
+  // A component that was solved to optimality contributes its cost to the
+  // lower bound and nothing to the gap.
+  template<typename CapT, typename CostT>
+  void GraphDecomposition<CapT, CostT>::addSolutionQuality(
+      Graph<CapT, CostT>& subgraph) {
+    SolutionQuality& sub_quality = subgraph.get_solution_quality();
+    int64_t cost_lower_bound = sub_quality.unrouted_supply > 0 ?
+      sub_quality.cost_lower_bound : subgraph.getFlowCost();
+    unique_lock<mutex> lock(quality_lock);
+    SolutionQuality& quality = graph_.get_solution_quality();
+    quality.optimal = quality.optimal && sub_quality.optimal;
+    if (quality.cost_gap < 0 || sub_quality.cost_gap < 0) {
+      quality.cost_gap = -1;
+    } else {
+      quality.cost_gap += sub_quality.cost_gap;
+    }
+    quality.unrouted_supply += sub_quality.unrouted_supply;
+    quality.cost_lower_bound += cost_lower_bound;
+  }
+
+  template class GraphDecomposition<int32_t, int32_t>;
+  template class GraphDecomposition<int32_t, int64_t>;
+  template class GraphDecomposition<int64_t, int32_t>;
+  template class GraphDecomposition<int64_t, int64_t>;
+
+}
@@ -0,0 +1,61 @@
+#ifndef FLOWLESSLY_DECOMPOSITION_H
+#define FLOWLESSLY_DECOMPOSITION_H
+
+#include "graph.h"
+#include "solve_budget.h"
+#include "solver_workspace.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Splits a graph into its weakly connected components and solves each one
+  // of them as an independent graph on a thread pool. The sub-graphs link
+  // the Arc objects of the graph instead of copying them. While a component
+  // is solved its arcs carry component-local node ids; they are restored
+  // before solveComponents returns.
+  template<typename CapT, typename CostT>
+  class GraphDecomposition {
+
+  public:
+  GraphDecomposition(Graph<CapT, CostT>& graph, ThreadPool& pool):
+    graph_(graph), pool_(pool) {
+    }
+
+    // Returns the number of components that have arcs.
+    uint32_t decompose();
+    // Every worker thread solves its components with its own workspace,
+    // which feeds stats. All the components share the budget. The solution
+    // quality of the graph sums up the ones of the components and the
+    // potentials of the graph are the ones of its components.
+    void solveComponents(const function<void(Graph<CapT, CostT>&,
+                                             SolverWorkspace&,
+                                             SolveBudget&)>& solve,
+                         SolveBudget& budget, SolverStats& stats);
+
+  private:
+    Graph<CapT, CostT>& graph_;
+    ThreadPool& pool_;
+    // The nodes of each component in increasing id order. The node at
+    // index i gets the local id i + 1.
+    vector<vector<uint32_t> > components;
+    vector<uint32_t> local_node_id;
+    mutex quality_lock;
+
+    uint32_t find(vector<atomic<uint32_t> >& parent, uint32_t node_id);
+    void unite(vector<atomic<uint32_t> >& parent, uint32_t node_id,
+               uint32_t other_node_id);
+    void buildSubgraph(uint32_t component, Graph<CapT, CostT>& subgraph);
+    void restoreArcs(uint32_t component, Graph<CapT, CostT>& subgraph);
+    void addSolutionQuality(Graph<CapT, CostT>& subgraph);
+
+  };
+
+}
+#endif
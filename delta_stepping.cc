@@ -0,0 +1,284 @@
+#include "delta_stepping.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Rounds with fewer nodes are relaxed on the calling thread: handing them
+  // to the pool costs more than it saves.
+  const uint32_t kMinParallelFrontier = 256;
+  // Number of nodes whose arcs are sampled to pick delta.
+  const uint32_t kNumDeltaSampleNodes = 1024;
+  const int64_t kNotQueued = numeric_limits<int64_t>::max();
+
+  template<typename CapT, typename CostT>
+  DeltaStepping<CapT, CostT>::DeltaStepping(Graph<CapT, CostT>& graph,
+                                            ThreadPool& pool):
+    graph_(graph), pool_(pool), num_threads(pool.get_num_threads()),
+    potentials_(NULL), delta(1), buckets(num_threads),
+    frontiers(num_threads),
+    updates(num_threads, vector<vector<DistanceUpdate> >(num_threads)),
+    num_improvements(num_threads), num_arc_scans(num_threads) {
+  }
+
+  template<typename CapT, typename CostT>
+  uint32_t DeltaStepping<CapT, CostT>::findShortestPaths(
+      const vector<uint32_t>& source_nodes, SolverWorkspace& workspace) {
+    return search(source_nodes, NULL, workspace);
+  }
+
+  template<typename CapT, typename CostT>
+  uint32_t DeltaStepping<CapT, CostT>::findShortestPaths(
+      const vector<uint32_t>& source_nodes, const vector<int64_t>& potentials,
+      SolverWorkspace& workspace) {
+    return search(source_nodes, &potentials, workspace);
+  }
+
+  template<typename CapT, typename CostT>
+  uint32_t DeltaStepping<CapT, CostT>::search(
+      const vector<uint32_t>& source_nodes, const vector<int64_t>* potentials,
+      SolverWorkspace& workspace) {
+    ScopedStatsTimer timer(workspace.get_stats(), SHORTEST_PATH_TIMER);
+    uint32_t num_nodes = graph_.get_num_nodes();
+    potentials_ = potentials;
+    distance.assign(num_nodes + 1, numeric_limits<int64_t>::max());
+    predecessor.resize(num_nodes + 1);
+    queued_bucket.assign(num_nodes + 1, kNotQueued);
+    fill(num_improvements.begin(), num_improvements.end(), 0);
+    fill(num_arc_scans.begin(), num_arc_scans.end(), 0);
+    for (uint32_t thread_index = 0; thread_index < num_threads;
+         ++thread_index) {
+      buckets[thread_index].clear();
+    }
+    pickDelta();
+    for (vector<uint32_t>::const_iterator it = source_nodes.begin();
+         it != source_nodes.end(); ++it) {
+      distance[*it] = 0;
+      predecessor[*it] = 0;
+      queueNode(*it);
+    }
+    uint32_t cycle_node = 0;
+    uint64_t num_checked_improvements = 0;
+    while (true) {
+      int64_t bucket_index = kNotQueued;
+      for (uint32_t thread_index = 0; thread_index < num_threads;
+           ++thread_index) {
+        if (!buckets[thread_index].empty()) {
+          bucket_index = min(bucket_index,
+                             buckets[thread_index].begin()->first);
+        }
+      }
+      if (bucket_index == kNotQueued) {
+        break;
+      }
+      size_t frontier_size = 0;
+      for (uint32_t thread_index = 0; thread_index < num_threads;
+           ++thread_index) {
+        takeBucket(thread_index, bucket_index);
+        frontier_size += frontiers[thread_index].size();
+      }
+      bool parallel = frontier_size >= kMinParallelFrontier;
+      runStep(&DeltaStepping::relaxFrontier, parallel);
+      runStep(&DeltaStepping::applyUpdates, parallel);
+      // Without a negative cycle the predecessors form a tree. Looking for
+      // a cycle once per num_nodes improvements keeps the cost linear.
+      uint64_t total_improvements = 0;
+      for (uint32_t thread_index = 0; thread_index < num_threads;
+           ++thread_index) {
+        total_improvements += num_improvements[thread_index];
+      }
+      if (total_improvements - num_checked_improvements > num_nodes) {
+        num_checked_improvements = total_improvements;
+        cycle_node = findPredecessorCycle();
+        if (cycle_node != 0) {
+          break;
+        }
+      }
+    }
+    workspace.reserveNodes(num_nodes);
+    workspace.startSearch();
+    uint64_t total_arc_scans = 0;
+    for (uint32_t thread_index = 0; thread_index < num_threads;
+         ++thread_index) {
+      total_arc_scans += num_arc_scans[thread_index];
+    }
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      if (distance[node_id] < numeric_limits<int64_t>::max()) {
+        workspace.set_distance(node_id, distance[node_id],
+                               predecessor[node_id]);
+      }
+    }
+    workspace.get_stats().addCount(ARC_SCANS, total_arc_scans);
+    return cycle_node;
+  }
+
+  // Meyer and Sanders pick delta around the largest cost over the degree.
+  // The mean cost is more robust to a few expensive arcs and gives about
+  // as many nodes per bucket on the generated graphs.
+  template<typename CapT, typename CostT>
+  void DeltaStepping<CapT, CostT>::pickDelta() {
+    uint32_t num_nodes = graph_.get_num_nodes();
+    const vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    uint32_t stride = max(num_nodes / kNumDeltaSampleNodes, 1U);
+    double total_cost = 0;
+    uint64_t num_sampled_arcs = 0;
+    for (uint32_t node_id = 1; node_id <= num_nodes; node_id += stride) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        if (it->second->cap > 0) {
+          int64_t cost = it->second->cost;
+          if (potentials_) {
+            cost += (*potentials_)[node_id] - (*potentials_)[it->first];
+          }
+          total_cost += cost >= 0 ? cost : -cost;
+          num_sampled_arcs++;
+        }
+      }
+    }
+    delta = num_sampled_arcs == 0 ? 1 :
+      max(static_cast<int64_t>(total_cost / num_sampled_arcs), int64_t(1));
+  }
+
+  template<typename CapT, typename CostT>
+  int64_t DeltaStepping<CapT, CostT>::getBucketIndex(int64_t node_distance) {
+    // Rounded down, negative distances included.
+    return node_distance >= 0 ? node_distance / delta :
+      -((-node_distance + delta - 1) / delta);
+  }
+
+  // Only the thread that owns the node calls it.
+  template<typename CapT, typename CostT>
+  void DeltaStepping<CapT, CostT>::queueNode(uint32_t node_id) {
+    int64_t bucket_index = getBucketIndex(distance[node_id]);
+    if (queued_bucket[node_id] != bucket_index) {
+      // A node that moves to a lower bucket leaves a stale entry behind,
+      // which takeBucket skips.
+      queued_bucket[node_id] = bucket_index;
+      buckets[node_id % num_threads][bucket_index].push_back(node_id);
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void DeltaStepping<CapT, CostT>::takeBucket(uint32_t thread_index,
+                                              int64_t bucket_index) {
+    vector<uint32_t>& frontier = frontiers[thread_index];
+    frontier.clear();
+    map<int64_t, vector<uint32_t> >& thread_buckets = buckets[thread_index];
+    typename map<int64_t, vector<uint32_t> >::iterator bucket_it =
+      thread_buckets.find(bucket_index);
+    if (bucket_it == thread_buckets.end()) {
+      return;
+    }
+    for (vector<uint32_t>::iterator it = bucket_it->second.begin();
+         it != bucket_it->second.end(); ++it) {
+      if (queued_bucket[*it] == bucket_index) {
+        queued_bucket[*it] = kNotQueued;
+        frontier.push_back(*it);
+      }
+    }
+    thread_buckets.erase(bucket_it);
+  }
+
+  // The distances only change in applyUpdates, so they can be read here
+  // without synchronization.
+  template<typename CapT, typename CostT>
+  void DeltaStepping<CapT, CostT>::relaxFrontier(uint32_t thread_index) {
+    const vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    vector<vector<DistanceUpdate> >& thread_updates = updates[thread_index];
+    const vector<uint32_t>& frontier = frontiers[thread_index];
+    for (vector<uint32_t>::const_iterator node_it = frontier.begin();
+         node_it != frontier.end(); ++node_it) {
+      uint32_t node_id = *node_it;
+      int64_t node_distance = distance[node_id];
+      num_arc_scans[thread_index] += arcs[node_id].size();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        if (it->second->cap <= 0) {
+          continue;
+        }
+        int64_t new_distance = node_distance + it->second->cost;
+        if (potentials_) {
+          new_distance += (*potentials_)[node_id] - (*potentials_)[it->first];
+        }
+        if (new_distance < distance[it->first]) {
+          DistanceUpdate update = {it->first, node_id, new_distance};
+          thread_updates[it->first % num_threads].push_back(update);
+        }
+      }
+    }
+  }
+
+  // The updates are applied in the order of the sending threads, which
+  // keeps the predecessors the same from one run to the next.
+  template<typename CapT, typename CostT>
+  void DeltaStepping<CapT, CostT>::applyUpdates(uint32_t thread_index) {
+    for (uint32_t sender = 0; sender < num_threads; ++sender) {
+      vector<DistanceUpdate>& sent_updates = updates[sender][thread_index];
+      for (vector<DistanceUpdate>::iterator it = sent_updates.begin();
+           it != sent_updates.end(); ++it) {
+        if (it->distance < distance[it->node_id]) {
+          distance[it->node_id] = it->distance;
+          predecessor[it->node_id] = it->predecessor_id;
+          num_improvements[thread_index]++;
+          queueNode(it->node_id);
+        }
+      }
+      sent_updates.clear();
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void DeltaStepping<CapT, CostT>::runStep(
+      void (DeltaStepping::*step)(uint32_t), bool parallel) {
+    for (uint32_t thread_index = 0; thread_index < num_threads;
+         ++thread_index) {
+      if (parallel) {
+        pool_.schedule([this, step, thread_index]() {
+            (this->*step)(thread_index);
+          });
+      } else {
+        (this->*step)(thread_index);
+      }
+    }
+    if (parallel) {
+      pool_.wait();
+    }
+  }
+
+  // A cycle of predecessors can only form around a negative cycle: every
+  // arc to a predecessor was tight when it was set and the distances only
+  // dropped since.
+  template<typename CapT, typename CostT>
+  uint32_t DeltaStepping<CapT, CostT>::findPredecessorCycle() {
+    uint32_t num_nodes = graph_.get_num_nodes();
+    walk_mark.assign(num_nodes + 1, 0);
+    for (uint32_t start_node = 1; start_node <= num_nodes; ++start_node) {
+      // Every walk marks the nodes it visits with its start node.
+      uint32_t node_id = start_node;
+      while (node_id != 0 && walk_mark[node_id] == 0 &&
+             distance[node_id] < numeric_limits<int64_t>::max()) {
+        walk_mark[node_id] = start_node;
+        node_id = predecessor[node_id];
+      }
+      if (node_id != 0 && walk_mark[node_id] == start_node) {
+        return node_id;
+      }
+    }
+    return 0;
+  }
+
+  template class DeltaStepping<int32_t, int32_t>;
+  template class DeltaStepping<int32_t, int64_t>;
+  template class DeltaStepping<int64_t, int32_t>;
+  template class DeltaStepping<int64_t, int64_t>;
+
+}
@@ -0,0 +1,88 @@
+#ifndef FLOWLESSLY_DELTA_STEPPING_H
+#define FLOWLESSLY_DELTA_STEPPING_H
+
+#include "graph.h"
+#include "solver_workspace.h"
+#include "thread_pool.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // A change of the tentative distance of a node, sent by the thread that
+  // relaxed the arc to the thread that owns the node.
+  struct DistanceUpdate {
+    uint32_t node_id;
+    uint32_t predecessor_id;
+    int64_t distance;
+  };
+
+  // Parallel delta-stepping shortest paths (Meyer and Sanders). The nodes
+  // are kept in buckets of width delta by tentative distance and the
+  // smallest bucket that isn't empty is relaxed by all the threads of the
+  // pool at once. Every node is owned by one thread, which alone applies
+  // the distance updates of the node, so no atomics are needed. A node
+  // whose distance drops is put back in a bucket, which makes negative
+  // costs fine as long as no negative cycle is reachable; the distances
+  // are then the ones BellmanFord finds. Like the sequential searches, it
+  // leaves the distances and the predecessors in the workspace. The
+  // scratch arrays are kept between searches.
+  template<typename CapT, typename CostT>
+  class DeltaStepping {
+
+  public:
+    DeltaStepping(Graph<CapT, CostT>& graph, ThreadPool& pool);
+
+    // Returns 0, or a node on a negative cycle if it stopped on one. The
+    // predecessors of the nodes on the cycle then go round it.
+    uint32_t findShortestPaths(const vector<uint32_t>& source_nodes,
+                               SolverWorkspace& workspace);
+    // Runs on the reduced costs cost + potential[src] - potential[dst].
+    uint32_t findShortestPaths(const vector<uint32_t>& source_nodes,
+                               const vector<int64_t>& potentials,
+                               SolverWorkspace& workspace);
+
+  private:
+    Graph<CapT, CostT>& graph_;
+    ThreadPool& pool_;
+    uint32_t num_threads;
+    const vector<int64_t>* potentials_;
+    int64_t delta;
+    vector<int64_t> distance;
+    vector<uint32_t> predecessor;
+    // The bucket a node waits in, if any.
+    vector<int64_t> queued_bucket;
+    // The buckets of the nodes of every thread, by bucket index.
+    vector<map<int64_t, vector<uint32_t> > > buckets;
+    // The nodes of every thread that are relaxed in this round.
+    vector<vector<uint32_t> > frontiers;
+    // The updates sent by every thread to every thread.
+    vector<vector<vector<DistanceUpdate> > > updates;
+    vector<uint64_t> num_improvements;
+    vector<uint64_t> num_arc_scans;
+    vector<uint32_t> walk_mark;
+
+    uint32_t search(const vector<uint32_t>& source_nodes,
+                    const vector<int64_t>* potentials,
+                    SolverWorkspace& workspace);
+    // Picks delta from the costs of a sample of the arcs.
+    void pickDelta();
+    int64_t getBucketIndex(int64_t node_distance);
+    void queueNode(uint32_t node_id);
+    // Moves the nodes of a thread that wait in the bucket to its frontier.
+    void takeBucket(uint32_t thread_index, int64_t bucket_index);
+    void relaxFrontier(uint32_t thread_index);
+    void applyUpdates(uint32_t thread_index);
+    // Runs the step for every thread, on the pool if parallel is true.
+    void runStep(void (DeltaStepping::*step)(uint32_t), bool parallel);
+    // Returns a node on a cycle of the predecessor graph, or 0.
+    uint32_t findPredecessorCycle();
+
+  };
+
+}
+#endif
@@ -0,0 +1,177 @@
+#include "double_buffered_graph.h"
+
+namespace flowlessly {
+
+  template<typename CapT, typename CostT>
+  DoubleBufferedGraph<CapT, CostT>::DoubleBufferedGraph(
+      const function<bool(Graph<CapT, CostT>&, GraphUpdate&,
+                          string*)>& apply_update):
+    apply_update_(apply_update), shadow_index(0), head(&stub), tail(&stub),
+    ingestion_sleeping(false), ingested_update(NULL), stopping(false) {
+    valid_graphs[0] = false;
+    valid_graphs[1] = false;
+    ingestion_thread = thread(&DoubleBufferedGraph::runIngestion, this);
+  }
+
+  template<typename CapT, typename CostT>
+  DoubleBufferedGraph<CapT, CostT>::~DoubleBufferedGraph() {
+    {
+      unique_lock<mutex> lock(state_lock);
+      stopping = true;
+    }
+    update_pushed.notify_all();
+    graphs_swapped.notify_all();
+    ingestion_thread.join();
+    for (GraphUpdate* update = dequeue(); update != NULL;
+         update = dequeue()) {
+      delete update;
+    }
+    for (typename vector<GraphUpdate*>::iterator it = replay_log.begin();
+         it != replay_log.end(); ++it) {
+      delete *it;
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void DoubleBufferedGraph<CapT, CostT>::push(GraphUpdate* update) {
+    enqueue(update);
+    // Only a sleeping ingestion thread needs the lock to be woken up.
+    if (ingestion_sleeping.exchange(false)) {
+      unique_lock<mutex> lock(state_lock);
+      update_pushed.notify_one();
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  Graph<CapT, CostT>* DoubleBufferedGraph<CapT, CostT>::startSolve(
+      GraphUpdate* update, string* error) {
+    unique_lock<mutex> lock(state_lock);
+    while (ingested_update != update) {
+      update_ingested.wait(lock);
+    }
+    // The update is freed once it has been replayed after the swap.
+    *error = update->error;
+    uint32_t active_index = shadow_index;
+    shadow_index = 1 - shadow_index;
+    ingested_update = NULL;
+    graphs_swapped.notify_all();
+    return valid_graphs[active_index] ? &graphs[active_index] : NULL;
+  }
+
+  template<typename CapT, typename CostT>
+  void DoubleBufferedGraph<CapT, CostT>::runIngestion() {
+    while (true) {
+      GraphUpdate* update = dequeue();
+      if (update == NULL) {
+        // Announce the nap before the last look at the queue, so that a
+        // push either shows up here or wakes us up.
+        ingestion_sleeping = true;
+        update = dequeue();
+        if (update == NULL) {
+          unique_lock<mutex> lock(state_lock);
+          while (ingestion_sleeping && !stopping) {
+            update_pushed.wait(lock);
+          }
+          if (stopping) {
+            return;
+          }
+          continue;
+        }
+        ingestion_sleeping = false;
+      }
+      // No swap happens while the shadow copy is updated: swaps wait for
+      // the ingestion thread to stop at a solved update.
+      applyUpdate(shadow_index, update);
+      replay_log.push_back(update);
+      if (!update->solve) {
+        continue;
+      }
+      uint32_t replay_index;
+      {
+        unique_lock<mutex> lock(state_lock);
+        ingested_update = update;
+        update_ingested.notify_all();
+        while (ingested_update != NULL && !stopping) {
+          graphs_swapped.wait(lock);
+        }
+        if (stopping) {
+          return;
+        }
+        replay_index = shadow_index;
+      }
+      // The new shadow copy is the graph of the previous solve. It misses
+      // the updates the new active copy got since then.
+      vector<GraphUpdate*> missed_updates;
+      missed_updates.swap(replay_log);
+      for (typename vector<GraphUpdate*>::iterator it =
+             missed_updates.begin(); it != missed_updates.end(); ++it) {
+        applyUpdate(replay_index, *it);
+        delete *it;
+      }
+    }
+  }
+
+  // A replay has the same outcome as the first application because both
+  // copies went through the same updates.
+  template<typename CapT, typename CostT>
+  void DoubleBufferedGraph<CapT, CostT>::applyUpdate(uint32_t graph_index,
+                                                     GraphUpdate* update) {
+    update->error.clear();
+    if (update->is_delta && !valid_graphs[graph_index]) {
+      update->failed = true;
+      update->error = "no graph to apply the delta to";
+    } else {
+      update->failed =
+        !apply_update_(graphs[graph_index], *update, &update->error);
+    }
+    // A failed update leaves the graph half changed, so it is dropped.
+    valid_graphs[graph_index] = !update->failed;
+  }
+
+  // The queue is Vyukov's intrusive multi producer, single consumer queue.
+  // A producer links its update with one exchange. The consumer may see a
+  // producer between the exchange and the link; it then finds the queue
+  // empty and the producer wakes it up once it's done.
+  template<typename CapT, typename CostT>
+  void DoubleBufferedGraph<CapT, CostT>::enqueue(GraphUpdate* update) {
+    update->next.store(NULL, memory_order_relaxed);
+    GraphUpdate* prev = head.exchange(update, memory_order_acq_rel);
+    prev->next.store(update, memory_order_release);
+  }
+
+  template<typename CapT, typename CostT>
+  GraphUpdate* DoubleBufferedGraph<CapT, CostT>::dequeue() {
+    GraphUpdate* first = tail;
+    GraphUpdate* next = first->next.load(memory_order_acquire);
+    if (first == &stub) {
+      if (next == NULL) {
+        return NULL;
+      }
+      tail = next;
+      first = next;
+      next = next->next.load(memory_order_acquire);
+    }
+    if (next != NULL) {
+      tail = next;
+      return first;
+    }
+    if (first != head.load(memory_order_acquire)) {
+      return NULL;
+    }
+    // first is the last update. The stub goes behind it so that first can
+    // be handed out without emptying the queue.
+    enqueue(&stub);
+    next = first->next.load(memory_order_acquire);
+    if (next != NULL) {
+      tail = next;
+      return first;
+    }
+    return NULL;
+  }
+
+  template class DoubleBufferedGraph<int32_t, int32_t>;
+  template class DoubleBufferedGraph<int32_t, int64_t>;
+  template class DoubleBufferedGraph<int64_t, int32_t>;
+  template class DoubleBufferedGraph<int64_t, int64_t>;
+
+}
@@ -0,0 +1,96 @@
+#ifndef FLOWLESSLY_DOUBLE_BUFFERED_GRAPH_H
+#define FLOWLESSLY_DOUBLE_BUFFERED_GRAPH_H
+
+#include "graph.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // A graph or a delta, in the format the daemon receives it in.
+  struct GraphUpdate {
+    GraphUpdate(): is_delta(false), is_binary(false), solve(false),
+      failed(false), next(NULL) {
+    }
+
+    bool is_delta;
+    bool is_binary;
+    vector<char> payload;
+    // The graph the update leads to is solved.
+    bool solve;
+    // Set when the update is first applied.
+    bool failed;
+    string error;
+    atomic<GraphUpdate*> next;
+  };
+
+  // Two copies of a graph. The solver works on the active copy while an
+  // ingestion thread applies the updates that producers push to the shadow
+  // copy. A solve starts by swapping the copies, so it doesn't wait for
+  // the updates to be applied or for the graph to be copied. After the
+  // swap the ingestion thread replays the updates the new shadow copy
+  // missed. The shadow copy never gets ahead of the next solve: the
+  // ingestion thread waits for the swap after every update that is
+  // solved.
+  template<typename CapT, typename CostT>
+  class DoubleBufferedGraph {
+
+  public:
+    // apply_update applies an update to a graph. It returns false and
+    // describes the error if the update failed.
+    explicit DoubleBufferedGraph(
+        const function<bool(Graph<CapT, CostT>&, GraphUpdate&,
+                            string*)>& apply_update);
+    ~DoubleBufferedGraph();
+
+    // Takes ownership of the update. Lock free; producers on any thread
+    // may push updates at any time.
+    void push(GraphUpdate* update);
+    // Waits for update, which must have solve set and be the next solved
+    // update, to be applied and swaps the copies. Returns the graph to
+    // solve, which stays untouched until the next call, or NULL and the
+    // error if the graph is not valid.
+    Graph<CapT, CostT>* startSolve(GraphUpdate* update, string* error);
+
+  private:
+    function<bool(Graph<CapT, CostT>&, GraphUpdate&, string*)> apply_update_;
+    Graph<CapT, CostT> graphs[2];
+    // A delta can only be applied to a valid graph. A graph becomes valid
+    // with a full graph update and invalid with a failed update.
+    bool valid_graphs[2];
+    uint32_t shadow_index;
+    // Multi producer, single consumer queue of updates. head is the last
+    // pushed update and tail the next one to pop. stub keeps the queue
+    // from ever being empty.
+    atomic<GraphUpdate*> head;
+    GraphUpdate* tail;
+    GraphUpdate stub;
+    // Updates applied to the shadow copy since the last swap.
+    vector<GraphUpdate*> replay_log;
+    mutex state_lock;
+    condition_variable update_pushed;
+    condition_variable update_ingested;
+    condition_variable graphs_swapped;
+    atomic<bool> ingestion_sleeping;
+    // The solved update the ingestion thread waits to be swapped in.
+    GraphUpdate* ingested_update;
+    bool stopping;
+    thread ingestion_thread;
+
+    void runIngestion();
+    void applyUpdate(uint32_t graph_index, GraphUpdate* update);
+    void enqueue(GraphUpdate* update);
+    GraphUpdate* dequeue();
+
+  };
+
+}
+#endif
@@ -0,0 +1,743 @@
+#include "delta_stepping.h"
+#include "graph.h"
+#include "graph_generator.h"
+#include "solver_workspace.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <functional>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include <map>
+#include <random>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace flowlessly;
+using boost::algorithm::is_any_of;
+using boost::lexical_cast;
+
+DEFINE_string(generators, "netgen,grid,scheduling",
+              "Comma separated generators: netgen, grid, scheduling");
+DEFINE_string(sizes, "100,200,400",
+              "Comma separated graph sizes, see generateGraph");
+DEFINE_string(algorithms,
+              "cycle_cancelling,successive_shortest_path,"
+              "successive_shortest_path_potentials,cost_scaling",
+              "Comma separated algorithms run on every graph");
+DEFINE_string(node_orderings, "none",
+              "Comma separated node orderings every algorithm is run with");
+DEFINE_string(eps_schedules, "fixed",
+              "Comma separated eps schedules cost_scaling is run with: "
+              "fixed, adaptive. The other algorithms run once");
+DEFINE_uint64(seed, 1, "Seed of the generators");
+DEFINE_string(scheduler, "./flow_scheduler", "flow_scheduler binary");
+DEFINE_string(work_dir, "/tmp",
+              "Directory the graphs, the flows and the stats are written to");
+DEFINE_int64(time_limit_ms, 0,
+             "Time limit of every run. Runs that hit it are not cross-checked");
+DEFINE_string(csv_file, "", "Also write the results to this CSV file");
+DEFINE_string(generate_graph_file, "",
+              "Only write the graph of the first generator and size to this "
+              "file");
+DEFINE_int32(repetitions, 1,
+             "Number of times every run is repeated. The median times are "
+             "reported");
+DEFINE_string(baseline_file, "",
+              "Run the graphs of this JSON baseline and fail if an algorithm "
+              "got slower than the baseline allows");
+DEFINE_bool(update_baseline, false,
+            "Write the solve times of the sweep to baseline_file instead of "
+            "checking them");
+DEFINE_double(max_slowdown, 0.2,
+              "Fraction by which the median solve time may exceed the "
+              "baseline");
+DEFINE_string(shortest_path_threads, "",
+              "Comma separated thread counts. If set, times Bellman-Ford, "
+              "Dijkstra and delta-stepping with every thread count on the "
+              "generated graphs instead of running the scheduler");
+
+inline void init(int argc, char *argv[]) {
+  string usage("Runs the flow_scheduler algorithms on generated graphs. "
+               "Sample usage:\nflow_benchmark --generators=scheduling "
+               "--sizes=100,1000");
+  google::SetUsageMessage(usage);
+  google::ParseCommandLineFlags(&argc, &argv, false);
+  google::InitGoogleLogging(argv[0]);
+}
+
+struct RunResult {
+  bool succeeded;
+  // False if the solution is not known to be optimal.
+  bool optimal;
+  int64_t cost;
+  int64_t wall_time_us;
+  // Time spent in the solver, as measured by its solve timer.
+  int64_t solve_time_us;
+  int64_t peak_rss_kb;
+  // Number of cost scaling phases.
+  int64_t num_phases;
+  map<string, int64_t> counters;
+};
+
+const char* kCounterNames[] = {
+  "pushes", "relabels", "arc_scans", "augmentations", "heap_operations",
+  "cancelled_cycles"
+};
+const uint32_t kNumCounters = sizeof(kCounterNames) / sizeof(kCounterNames[0]);
+
+// Slowdowns below this are scheduling noise, even on a quiet machine.
+const int64_t kMinSlowdownUs = 5000;
+// Largest random potential the costs of the shortest path sweep are
+// shifted by.
+const int64_t kMaxCostShift = 1000;
+
+// Median and median absolute deviation of the times of repeated runs.
+struct TimeStats {
+  int64_t median_us;
+  int64_t mad_us;
+};
+
+struct BaselineEntry {
+  string generator;
+  uint32_t size;
+  string algorithm;
+  string node_ordering;
+  string eps_schedule;
+  TimeStats solve_time;
+};
+
+vector<string> splitFlag(const string& flag) {
+  vector<string> values;
+  if (!flag.empty()) {
+    boost::split(values, flag, is_any_of(","));
+  }
+  return values;
+}
+
+bool readFile(const string& file_path, string* contents) {
+  FILE* file = fopen(file_path.c_str(), "r");
+  if (file == NULL) {
+    return false;
+  }
+  char buffer[4096];
+  size_t num_read;
+  contents->clear();
+  while ((num_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents->append(buffer, num_read);
+  }
+  fclose(file);
+  return true;
+}
+
+// Returns the number that follows "key": in the stats JSON, or -1.
+int64_t findJsonValue(const string& json, const string& key) {
+  size_t pos = json.find("\"" + key + "\": ");
+  if (pos == string::npos) {
+    return -1;
+  }
+  return strtoll(json.c_str() + pos + key.size() + 4, NULL, 10);
+}
+
+// Returns the string that follows "key": in the JSON, or an empty string.
+string findJsonString(const string& json, const string& key) {
+  size_t pos = json.find("\"" + key + "\": \"");
+  if (pos == string::npos) {
+    return "";
+  }
+  pos += key.size() + 5;
+  return json.substr(pos, json.find('"', pos) - pos);
+}
+
+int64_t getMedian(vector<int64_t> values) {
+  sort(values.begin(), values.end());
+  uint32_t middle = values.size() / 2;
+  if (values.size() % 2 == 1) {
+    return values[middle];
+  }
+  return (values[middle - 1] + values[middle]) / 2;
+}
+
+TimeStats getTimeStats(const vector<int64_t>& times_us) {
+  TimeStats stats;
+  stats.median_us = getMedian(times_us);
+  vector<int64_t> deviations;
+  for (vector<int64_t>::const_iterator it = times_us.begin();
+       it != times_us.end(); ++it) {
+    deviations.push_back(abs(*it - stats.median_us));
+  }
+  stats.mad_us = getMedian(deviations);
+  return stats;
+}
+
+// Runs the scheduler with its output thrown away and returns false if it
+// could not be started or failed.
+bool runScheduler(const vector<string>& args, RunResult* result) {
+  vector<char*> argv;
+  for (vector<string>::const_iterator it = args.begin(); it != args.end();
+       ++it) {
+    argv.push_back(const_cast<char*>(it->c_str()));
+  }
+  argv.push_back(NULL);
+  posix_spawn_file_actions_t file_actions;
+  posix_spawn_file_actions_init(&file_actions);
+  posix_spawn_file_actions_addopen(&file_actions, 1, "/dev/null", O_WRONLY,
+                                   0);
+  posix_spawn_file_actions_addopen(&file_actions, 2, "/dev/null", O_WRONLY,
+                                   0);
+  chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+  pid_t pid;
+  int error = posix_spawn(&pid, argv[0], &file_actions, NULL, &argv[0],
+                          environ);
+  posix_spawn_file_actions_destroy(&file_actions);
+  if (error != 0) {
+    LOG(ERROR) << "Could not start " << argv[0] << ": " << strerror(error);
+    return false;
+  }
+  int status;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+  result->wall_time_us = chrono::duration_cast<chrono::microseconds>(
+      chrono::steady_clock::now() - start_time).count();
+  // ru_maxrss is in kilobytes on Linux.
+  result->peak_rss_kb = usage.ru_maxrss;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+RunResult runAlgorithm(const string& graph_file, const string& algorithm,
+                       const string& node_ordering,
+                       const string& eps_schedule) {
+  RunResult result;
+  result.succeeded = false;
+  result.optimal = false;
+  result.cost = 0;
+  result.solve_time_us = -1;
+  result.num_phases = 0;
+  string out_graph_file = graph_file + "." + algorithm + "." + node_ordering +
+    "." + eps_schedule + ".out";
+  vector<string> args;
+  args.push_back(FLAGS_scheduler);
+  args.push_back("--graph_file=" + graph_file);
+  args.push_back("--out_graph_file=" + out_graph_file);
+  args.push_back("--algorithm=" + algorithm);
+  args.push_back("--node_ordering=" + node_ordering);
+  args.push_back("--eps_schedule=" + eps_schedule);
+  args.push_back("--time_limit_ms=" +
+                 lexical_cast<string>(FLAGS_time_limit_ms));
+  args.push_back("--stats");
+  args.push_back("--minloglevel=2");
+  if (!runScheduler(args, &result)) {
+    return result;
+  }
+  string flows;
+  string stats;
+  if (!readFile(out_graph_file, &flows) ||
+      !readFile(out_graph_file + ".stats.json", &stats)) {
+    return result;
+  }
+  size_t cost_pos = flows.rfind("\ns ");
+  if (cost_pos == string::npos) {
+    return result;
+  }
+  result.succeeded = true;
+  result.cost = strtoll(flows.c_str() + cost_pos + 3, NULL, 10);
+  size_t solve_pos = stats.find("\"solve\": {\"total_us\": ");
+  result.solve_time_us = solve_pos == string::npos ? -1 :
+    strtoll(stats.c_str() + solve_pos + 22, NULL, 10);
+  // Solutions that are not known to be optimal start with comment lines.
+  result.optimal = flows.compare(0, 2, "c ") != 0;
+  for (uint32_t counter = 0; counter < kNumCounters; ++counter) {
+    result.counters[kCounterNames[counter]] =
+      findJsonValue(stats, kCounterNames[counter]);
+  }
+  // Every phase has an eps.
+  for (size_t pos = stats.find("\"eps\": "); pos != string::npos;
+       pos = stats.find("\"eps\": ", pos + 1)) {
+    result.num_phases++;
+  }
+  return result;
+}
+
+// Repeats the run and returns the last result with the median wall time.
+// A failed or a differently priced repetition is returned right away.
+RunResult runRepeatedly(const string& graph_file, const string& algorithm,
+                        const string& node_ordering,
+                        const string& eps_schedule, TimeStats* solve_time) {
+  vector<int64_t> wall_times_us;
+  vector<int64_t> solve_times_us;
+  RunResult result;
+  for (int32_t repetition = 0; repetition < max(1, FLAGS_repetitions);
+       ++repetition) {
+    RunResult last_result = result;
+    result = runAlgorithm(graph_file, algorithm, node_ordering, eps_schedule);
+    if (!result.succeeded ||
+        (repetition > 0 && result.cost != last_result.cost)) {
+      result.succeeded = false;
+      return result;
+    }
+    wall_times_us.push_back(result.wall_time_us);
+    solve_times_us.push_back(result.solve_time_us);
+  }
+  result.wall_time_us = getMedian(wall_times_us);
+  *solve_time = getTimeStats(solve_times_us);
+  return result;
+}
+
+// Writes the graph to work_dir and returns its path, or an empty string.
+string writeGeneratedGraph(const string& generator, uint32_t size) {
+  string graph_file = FLAGS_work_dir + "/flowlessly_bench_" + generator +
+    "_" + lexical_cast<string>(size) + ".in";
+  FILE* file = fopen(graph_file.c_str(), "w");
+  if (file == NULL) {
+    LOG(ERROR) << "Could not write " << graph_file;
+    return "";
+  }
+  bool generated = generateGraph(generator, size, FLAGS_seed, file);
+  fclose(file);
+  if (!generated) {
+    LOG(ERROR) << "Unknown generator: " << generator;
+    return "";
+  }
+  return graph_file;
+}
+
+// The baseline has one run per line, which keeps the diffs of refreshed
+// baselines readable and lets it be read without a JSON parser.
+bool readBaseline(const string& baseline_file, vector<BaselineEntry>* entries) {
+  string baseline;
+  if (!readFile(baseline_file, &baseline)) {
+    LOG(ERROR) << "Could not read " << baseline_file;
+    return false;
+  }
+  FLAGS_seed = findJsonValue(baseline, "seed");
+  vector<string> lines;
+  boost::split(lines, baseline, is_any_of("\n"));
+  for (vector<string>::iterator it = lines.begin(); it != lines.end(); ++it) {
+    if (it->find("\"generator\"") == string::npos) {
+      continue;
+    }
+    BaselineEntry entry;
+    entry.generator = findJsonString(*it, "generator");
+    entry.size = findJsonValue(*it, "size");
+    entry.algorithm = findJsonString(*it, "algorithm");
+    entry.node_ordering = findJsonString(*it, "node_ordering");
+    entry.eps_schedule = findJsonString(*it, "eps_schedule");
+    // Older baselines only ran the fixed schedule.
+    if (entry.eps_schedule.empty()) {
+      entry.eps_schedule = "fixed";
+    }
+    entry.solve_time.median_us = findJsonValue(*it, "median_us");
+    entry.solve_time.mad_us = findJsonValue(*it, "mad_us");
+    entries->push_back(entry);
+  }
+  return true;
+}
+
+bool writeBaseline(const string& baseline_file,
+                   const vector<BaselineEntry>& entries) {
+  FILE* file = fopen(baseline_file.c_str(), "w");
+  if (file == NULL) {
+    LOG(ERROR) << "Could not write " << baseline_file;
+    return false;
+  }
+  fprintf(file, "{\n  \"seed\": %ju,\n  \"runs\": [\n",
+          static_cast<uintmax_t>(FLAGS_seed));
+  for (vector<BaselineEntry>::const_iterator it = entries.begin();
+       it != entries.end(); ++it) {
+    fprintf(file, "    {\"generator\": \"%s\", \"size\": %u, "
+            "\"algorithm\": \"%s\", \"node_ordering\": \"%s\", "
+            "\"eps_schedule\": \"%s\", \"median_us\": %jd, "
+            "\"mad_us\": %jd}%s\n",
+            it->generator.c_str(), it->size, it->algorithm.c_str(),
+            it->node_ordering.c_str(), it->eps_schedule.c_str(),
+            static_cast<intmax_t>(it->solve_time.median_us),
+            static_cast<intmax_t>(it->solve_time.mad_us),
+            it + 1 == entries.end() ? "" : ",");
+  }
+  fprintf(file, "  ]\n}\n");
+  fclose(file);
+  return true;
+}
+
+// A run regressed if its median solve time exceeds the baseline median by
+// more than max_slowdown and by more than the noise of the baseline runs.
+bool checkBaseline() {
+  vector<BaselineEntry> entries;
+  if (!readBaseline(FLAGS_baseline_file, &entries)) {
+    return false;
+  }
+  printf("%-10s %6s %-36s %-5s %-8s %12s %12s %8s %s\n", "generator",
+         "size", "algorithm", "order", "schedule", "baseline_ms", "median_ms",
+         "change", "status");
+  bool no_regressions = true;
+  for (vector<BaselineEntry>::iterator it = entries.begin();
+       it != entries.end(); ++it) {
+    string graph_file = writeGeneratedGraph(it->generator, it->size);
+    if (graph_file.empty()) {
+      return false;
+    }
+    TimeStats solve_time = {-1, -1};
+    RunResult result = runRepeatedly(graph_file, it->algorithm,
+                                     it->node_ordering, it->eps_schedule,
+                                     &solve_time);
+    int64_t slowdown_us = 0;
+    string status = "ok";
+    if (!result.succeeded) {
+      status = "failed";
+      no_regressions = false;
+    } else {
+      slowdown_us = solve_time.median_us - it->solve_time.median_us;
+      if (slowdown_us > it->solve_time.median_us * FLAGS_max_slowdown &&
+          slowdown_us > max(3 * it->solve_time.mad_us, kMinSlowdownUs)) {
+        status = "SLOWER";
+        no_regressions = false;
+      }
+    }
+    printf("%-10s %6u %-36s %-5s %-8s %12.1f %12.1f %+7.1f%% %s\n",
+           it->generator.c_str(), it->size, it->algorithm.c_str(),
+           it->node_ordering.c_str(), it->eps_schedule.c_str(),
+           it->solve_time.median_us / 1000.0,
+           solve_time.median_us / 1000.0,
+           100.0 * slowdown_us / max(it->solve_time.median_us, int64_t(1)),
+           status.c_str());
+    fflush(stdout);
+  }
+  return no_regressions;
+}
+
+// Returns the number of nodes and arcs from the problem line.
+void readProblemSize(const string& graph_file, uint32_t* num_nodes,
+                     uint32_t* num_arcs) {
+  *num_nodes = 0;
+  *num_arcs = 0;
+  FILE* file = fopen(graph_file.c_str(), "r");
+  if (file != NULL) {
+    if (fscanf(file, "p min %u %u", num_nodes, num_arcs) != 2) {
+      LOG(ERROR) << "No problem line in " << graph_file;
+    }
+    fclose(file);
+  }
+}
+
+// Adds potential[src] - potential[dst] to every cost for random
+// potentials. Some costs turn negative, but every cycle keeps its cost, so
+// there is still no negative cycle.
+void shiftCosts(Graph<int64_t, int64_t>& graph) {
+  uint32_t num_nodes = graph.get_num_nodes();
+  mt19937_64 generator(FLAGS_seed);
+  uniform_int_distribution<int64_t> potential_distribution(0, kMaxCostShift);
+  vector<int64_t> potentials(num_nodes + 1);
+  for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+    potentials[node_id] = potential_distribution(generator);
+  }
+  vector<map<uint32_t, Arc<int64_t, int64_t>*> >& arcs = graph.get_arcs();
+  for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+    for (map<uint32_t, Arc<int64_t, int64_t>*>::iterator it =
+           arcs[node_id].begin(); it != arcs[node_id].end(); ++it) {
+      it->second->cost += potentials[node_id] - potentials[it->first];
+    }
+  }
+}
+
+// Returns the median time of the repeated search.
+int64_t timeSearch(const function<void()>& search) {
+  vector<int64_t> times_us;
+  for (int32_t repetition = 0; repetition < max(1, FLAGS_repetitions);
+       ++repetition) {
+    chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+    search();
+    times_us.push_back(chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now() - start_time).count());
+  }
+  return getMedian(times_us);
+}
+
+bool sameDistances(SolverWorkspace& workspace, uint32_t num_nodes,
+                   const vector<int64_t>& expected_distance) {
+  const vector<int64_t>& distance = workspace.get_distance();
+  for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+    if (distance[node_id] != expected_distance[node_id]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void printSearchResult(FILE* csv_file, const string& generator,
+                       const string& size, uint32_t num_nodes,
+                       uint32_t num_arcs,
+                       const string& costs, const string& search,
+                       uint32_t num_threads, int64_t time_us,
+                       int64_t sequential_time_us, const string& status) {
+  double speedup = time_us > 0 ?
+    static_cast<double>(sequential_time_us) / time_us : 0;
+  printf("%-10s %6s %7u %8u %-7s %-14s %7u %10.1f %8.2f %-8s\n",
+         generator.c_str(), size.c_str(), num_nodes, num_arcs,
+         costs.c_str(), search.c_str(), num_threads, time_us / 1000.0,
+         speedup, status.c_str());
+  fflush(stdout);
+  if (csv_file != NULL) {
+    fprintf(csv_file, "%s,%s,%u,%u,%s,%s,%u,%jd,%.3f,%s\n",
+            generator.c_str(), size.c_str(), num_nodes, num_arcs,
+            costs.c_str(), search.c_str(), num_threads,
+            static_cast<intmax_t>(time_us), speedup, status.c_str());
+  }
+}
+
+// Times the sequential searches and delta-stepping with every thread count
+// on the generated graphs, first on their own costs and then on shifted
+// ones with negative costs, which Dijkstra can't search. The speedups are
+// over the fastest sequential search. Returns false if a search disagrees
+// with Bellman-Ford.
+bool runShortestPathSweep(const vector<string>& generators,
+                          const vector<string>& sizes,
+                          const vector<string>& thread_counts) {
+  FILE* csv_file = NULL;
+  if (!FLAGS_csv_file.empty()) {
+    csv_file = fopen(FLAGS_csv_file.c_str(), "w");
+    if (csv_file == NULL) {
+      LOG(ERROR) << "Could not write " << FLAGS_csv_file;
+      return false;
+    }
+    fprintf(csv_file, "generator,size,nodes,arcs,costs,search,threads,"
+            "time_us,speedup,status\n");
+  }
+  printf("%-10s %6s %7s %8s %-7s %-14s %7s %10s %8s %-8s\n", "generator",
+         "size", "nodes", "arcs", "costs", "search", "threads", "time_ms",
+         "speedup", "status");
+  bool all_agree = true;
+  for (vector<string>::const_iterator gen_it = generators.begin();
+       gen_it != generators.end(); ++gen_it) {
+    for (vector<string>::const_iterator size_it = sizes.begin();
+         size_it != sizes.end(); ++size_it) {
+      string graph_file =
+        writeGeneratedGraph(*gen_it, lexical_cast<uint32_t>(*size_it));
+      if (graph_file.empty()) {
+        if (csv_file != NULL) {
+          fclose(csv_file);
+        }
+        return false;
+      }
+      uint32_t num_nodes;
+      uint32_t num_arcs;
+      readProblemSize(graph_file, &num_nodes, &num_arcs);
+      Graph<int64_t, int64_t> graph;
+      if (!graph.readGraph(graph_file)) {
+        if (csv_file != NULL) {
+          fclose(csv_file);
+        }
+        return false;
+      }
+      num_nodes = graph.get_num_nodes();
+      const vector<uint32_t>& source_nodes = graph.get_source_nodes();
+      SolverWorkspace workspace;
+      for (uint32_t shifted = 0; shifted < 2; ++shifted) {
+        string costs = shifted ? "shifted" : "plain";
+        if (shifted) {
+          shiftCosts(graph);
+        }
+        int64_t bellman_ford_us = timeSearch([&]() {
+            BellmanFord(graph, source_nodes, workspace);
+          });
+        vector<int64_t> expected_distance(workspace.get_distance());
+        int64_t sequential_us = bellman_ford_us;
+        int64_t dijkstra_us = -1;
+        bool dijkstra_agrees = true;
+        if (!shifted) {
+          dijkstra_us = timeSearch([&]() {
+              DijkstraOptimized(graph, source_nodes, workspace);
+            });
+          dijkstra_agrees =
+            sameDistances(workspace, num_nodes, expected_distance);
+          sequential_us = min(sequential_us, dijkstra_us);
+        }
+        printSearchResult(csv_file, *gen_it, *size_it, num_nodes, num_arcs,
+                          costs, "bellman_ford", 1, bellman_ford_us,
+                          sequential_us, "ok");
+        if (!shifted) {
+          printSearchResult(csv_file, *gen_it, *size_it, num_nodes, num_arcs,
+                            costs, "dijkstra_heap", 1, dijkstra_us,
+                            sequential_us,
+                            dijkstra_agrees ? "ok" : "MISMATCH");
+          all_agree = all_agree && dijkstra_agrees;
+        }
+        for (vector<string>::const_iterator threads_it =
+               thread_counts.begin(); threads_it != thread_counts.end();
+             ++threads_it) {
+          uint32_t num_threads = lexical_cast<uint32_t>(*threads_it);
+          ThreadPool pool(num_threads);
+          DeltaStepping<int64_t, int64_t> delta_stepping(graph, pool);
+          uint32_t cycle_node = 0;
+          int64_t delta_stepping_us = timeSearch([&]() {
+              cycle_node =
+                delta_stepping.findShortestPaths(source_nodes, workspace);
+            });
+          bool agrees = cycle_node == 0 &&
+            sameDistances(workspace, num_nodes, expected_distance);
+          printSearchResult(csv_file, *gen_it, *size_it, num_nodes, num_arcs,
+                            costs, "delta_stepping", num_threads,
+                            delta_stepping_us, sequential_us,
+                            agrees ? "ok" : "MISMATCH");
+          all_agree = all_agree && agrees;
+        }
+      }
+    }
+  }
+  if (csv_file != NULL) {
+    fclose(csv_file);
+  }
+  if (!all_agree) {
+    LOG(ERROR) << "The shortest path searches disagree";
+  }
+  return all_agree;
+}
+
+int main(int argc, char *argv[]) {
+  init(argc, argv);
+  FLAGS_logtostderr = true;
+  vector<string> generators = splitFlag(FLAGS_generators);
+  vector<string> sizes = splitFlag(FLAGS_sizes);
+  vector<string> algorithms = splitFlag(FLAGS_algorithms);
+  vector<string> node_orderings = splitFlag(FLAGS_node_orderings);
+  vector<string> eps_schedules = splitFlag(FLAGS_eps_schedules);
+  if (eps_schedules.empty()) {
+    eps_schedules.push_back("fixed");
+  }
+  if (!FLAGS_generate_graph_file.empty()) {
+    FILE* graph_file = fopen(FLAGS_generate_graph_file.c_str(), "w");
+    if (graph_file == NULL || generators.empty() || sizes.empty()) {
+      LOG(ERROR) << "Could not write " << FLAGS_generate_graph_file;
+      return 1;
+    }
+    bool generated = generateGraph(generators[0],
+                                   lexical_cast<uint32_t>(sizes[0]),
+                                   FLAGS_seed, graph_file);
+    fclose(graph_file);
+    return generated ? 0 : 1;
+  }
+  if (!FLAGS_baseline_file.empty() && !FLAGS_update_baseline) {
+    return checkBaseline() ? 0 : 1;
+  }
+  vector<string> thread_counts = splitFlag(FLAGS_shortest_path_threads);
+  if (!thread_counts.empty()) {
+    return runShortestPathSweep(generators, sizes, thread_counts) ? 0 : 1;
+  }
+  vector<BaselineEntry> baseline_entries;
+  FILE* csv_file = NULL;
+  if (!FLAGS_csv_file.empty()) {
+    csv_file = fopen(FLAGS_csv_file.c_str(), "w");
+    if (csv_file == NULL) {
+      LOG(ERROR) << "Could not write " << FLAGS_csv_file;
+      return 1;
+    }
+    fprintf(csv_file, "generator,size,nodes,arcs,algorithm,node_ordering,"
+            "eps_schedule,status,cost,wall_time_us,solve_time_us,"
+            "peak_rss_kb,phases");
+    for (uint32_t counter = 0; counter < kNumCounters; ++counter) {
+      fprintf(csv_file, ",%s", kCounterNames[counter]);
+    }
+    fprintf(csv_file, "\n");
+  }
+  printf("%-10s %6s %7s %8s %-36s %-5s %-8s %-7s %12s %10s %10s %9s %6s "
+         "%10s %10s\n", "generator", "size", "nodes", "arcs", "algorithm",
+         "order", "schedule", "status", "cost", "wall_ms", "solve_ms",
+         "rss_kb", "phases", "pushes", "arc_scans");
+  bool all_agree = true;
+  for (vector<string>::iterator gen_it = generators.begin();
+       gen_it != generators.end(); ++gen_it) {
+    for (vector<string>::iterator size_it = sizes.begin();
+         size_it != sizes.end(); ++size_it) {
+      uint32_t size = lexical_cast<uint32_t>(*size_it);
+      string graph_file = writeGeneratedGraph(*gen_it, size);
+      if (graph_file.empty()) {
+        return 1;
+      }
+      uint32_t num_nodes;
+      uint32_t num_arcs;
+      readProblemSize(graph_file, &num_nodes, &num_arcs);
+      // The cost every optimal run of this graph has to agree on.
+      bool has_optimal_cost = false;
+      int64_t optimal_cost = 0;
+      for (vector<string>::iterator alg_it = algorithms.begin();
+           alg_it != algorithms.end(); ++alg_it) {
+        // Only cost scaling has an eps schedule to compare.
+        vector<string> alg_schedules = eps_schedules;
+        if (alg_it->compare("cost_scaling")) {
+          alg_schedules.resize(1);
+        }
+        for (vector<string>::iterator ord_it = node_orderings.begin();
+             ord_it != node_orderings.end(); ++ord_it) {
+          for (vector<string>::iterator sched_it = alg_schedules.begin();
+               sched_it != alg_schedules.end(); ++sched_it) {
+            TimeStats solve_time = {-1, -1};
+            RunResult result = runRepeatedly(graph_file, *alg_it, *ord_it,
+                                             *sched_it, &solve_time);
+            string status = !result.succeeded ? "failed" :
+              (!result.optimal ? "limited" : "ok");
+            if (result.succeeded && result.optimal) {
+              if (!has_optimal_cost) {
+                has_optimal_cost = true;
+                optimal_cost = result.cost;
+              } else if (result.cost != optimal_cost) {
+                status = "MISMATCH";
+                all_agree = false;
+              }
+              BaselineEntry entry = {*gen_it, size, *alg_it, *ord_it,
+                                     *sched_it, solve_time};
+              baseline_entries.push_back(entry);
+            }
+            printf("%-10s %6s %7u %8u %-36s %-5s %-8s %-7s %12jd %10.1f %10.1f "
+                   "%9jd %6jd %10jd %10jd\n", gen_it->c_str(), size_it->c_str(),
+                   num_nodes, num_arcs, alg_it->c_str(), ord_it->c_str(),
+                   sched_it->c_str(), status.c_str(),
+                   static_cast<intmax_t>(result.cost),
+                   result.wall_time_us / 1000.0,
+                   solve_time.median_us / 1000.0,
+                   static_cast<intmax_t>(result.peak_rss_kb),
+                   static_cast<intmax_t>(result.num_phases),
+                   static_cast<intmax_t>(result.counters["pushes"]),
+                   static_cast<intmax_t>(result.counters["arc_scans"]));
+            fflush(stdout);
+            if (csv_file != NULL) {
+              fprintf(csv_file, "%s,%s,%u,%u,%s,%s,%s,%s,%jd,%jd,%jd,%jd,%jd",
+                      gen_it->c_str(), size_it->c_str(), num_nodes, num_arcs,
+                      alg_it->c_str(), ord_it->c_str(), sched_it->c_str(),
+                      status.c_str(), static_cast<intmax_t>(result.cost),
+                      static_cast<intmax_t>(result.wall_time_us),
+                      static_cast<intmax_t>(solve_time.median_us),
+                      static_cast<intmax_t>(result.peak_rss_kb),
+                      static_cast<intmax_t>(result.num_phases));
+              for (uint32_t counter = 0; counter < kNumCounters; ++counter) {
+                fprintf(csv_file, ",%jd", static_cast<intmax_t>(
+                    result.counters[kCounterNames[counter]]));
+              }
+              fprintf(csv_file, "\n");
+            }
+          }
+        }
+      }
+    }
+  }
+  if (csv_file != NULL) {
+    fclose(csv_file);
+  }
+  if (!all_agree) {
+    LOG(ERROR) << "The algorithms disagree on the optimal cost";
+    return 1;
+  }
+  if (FLAGS_update_baseline && !FLAGS_baseline_file.empty()) {
+    return writeBaseline(FLAGS_baseline_file, baseline_entries) ? 0 : 1;
+  }
+  return 0;
+}
@@ -0,0 +1,213 @@
+#include "solver_daemon.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace flowlessly;
+using boost::algorithm::is_any_of;
+using boost::lexical_cast;
+using boost::token_compress_on;
+
+DEFINE_string(socket, "/tmp/flowlessly.sock",
+              "Unix domain socket the solver daemon listens on");
+DEFINE_string(graph_file, "graph.in", "File containing the input graph.");
+DEFINE_string(delta_files, "",
+              "Comma separated DIMACS deltas sent one by one after the graph");
+DEFINE_string(update_files, "",
+              "Comma separated DIMACS deltas sent without waiting for a "
+              "reply before the deltas");
+DEFINE_string(out_graph_file, "graph.out",
+              "File the last reply is written to");
+DEFINE_bool(binary, false, "Send the graph and the deltas as binary records");
+DEFINE_string(reply, "flows",
+              "What the daemon replies with: flows, assignments or changes "
+              "since the previous reply");
+DEFINE_int32(repeat, 1, "Number of times the graph is sent");
+DEFINE_bool(quit, false, "Stop the daemon once the requests are served");
+
+inline void init(int argc, char *argv[]) {
+  string usage("Sends graphs to a flow_scheduler daemon. Sample usage:\n"
+               "flow_client --socket=/tmp/flowlessly.sock "
+               "--graph_file=graph.in");
+  google::SetUsageMessage(usage);
+  google::ParseCommandLineFlags(&argc, &argv, false);
+  google::InitGoogleLogging(argv[0]);
+}
+
+bool readFile(const string& file_path, string* contents) {
+  FILE* file = fopen(file_path.c_str(), "r");
+  if (file == NULL) {
+    LOG(ERROR) << "Failed to open file: " << file_path;
+    return false;
+  }
+  char buffer[4096];
+  size_t num_read;
+  contents->clear();
+  while ((num_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    contents->append(buffer, num_read);
+  }
+  fclose(file);
+  return true;
+}
+
+// Converts DIMACS lines to the binary records understood by the daemon.
+string toBinaryRecords(const string& dimacs) {
+  string records;
+  vector<string> lines;
+  vector<string> vals;
+  boost::split(lines, dimacs, is_any_of("\n"), token_compress_on);
+  for (vector<string>::iterator it = lines.begin(); it != lines.end(); ++it) {
+    boost::split(vals, *it, is_any_of(" "), token_compress_on);
+    BinaryGraphRecord record;
+    memset(&record, 0, sizeof(record));
+    record.type = vals[0].empty() ? 0 : vals[0][0];
+    if (record.type == 'p') {
+      record.src_node_id = lexical_cast<uint32_t>(vals[2]);
+      record.dst_node_id = lexical_cast<uint32_t>(vals[3]);
+    } else if (record.type == 'n') {
+      record.src_node_id = lexical_cast<uint32_t>(vals[1]);
+      record.capacity = lexical_cast<int64_t>(vals[2]);
+    } else if (record.type == 'a') {
+      record.src_node_id = lexical_cast<uint32_t>(vals[1]);
+      record.dst_node_id = lexical_cast<uint32_t>(vals[2]);
+      record.capacity = lexical_cast<int64_t>(vals[4]);
+      record.cost = lexical_cast<int64_t>(vals[5]);
+    } else if (record.type == 'r') {
+      record.src_node_id = lexical_cast<uint32_t>(vals[1]);
+      record.dst_node_id = lexical_cast<uint32_t>(vals[2]);
+    } else {
+      continue;
+    }
+    records.append(reinterpret_cast<char*>(&record), sizeof(record));
+  }
+  return records;
+}
+
+// Sends an update request, which gets no reply.
+bool sendUpdate(int socket_fd, const string& payload) {
+  string request = string("update ") + (FLAGS_binary ? "binary " : "dimacs ") +
+    lexical_cast<string>(payload.size()) + "\n" + payload;
+  if (!writeToSocket(socket_fd, request.data(), request.size())) {
+    LOG(ERROR) << "Lost the connection to the daemon";
+    return false;
+  }
+  return true;
+}
+
+// Reads a DIMACS file and converts it if binary records are sent.
+bool readPayload(const string& file_path, string* payload) {
+  if (!readFile(file_path, payload)) {
+    return false;
+  }
+  if (FLAGS_binary) {
+    *payload = toBinaryRecords(*payload);
+  }
+  return true;
+}
+
+// Sends one request and returns the payload of the reply.
+bool sendRequest(int socket_fd, const string& kind, const string& payload,
+                 string* reply) {
+  string request = kind + " " + (FLAGS_binary ? "binary " : "dimacs ") +
+    lexical_cast<string>(payload.size()) + " " + FLAGS_reply + "\n" +
+    payload;
+  chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+  string header;
+  if (!writeToSocket(socket_fd, request.data(), request.size()) ||
+      !readLineFromSocket(socket_fd, kMaxHeaderLength, &header)) {
+    LOG(ERROR) << "Lost the connection to the daemon";
+    return false;
+  }
+  if (header.compare(0, 3, "ok ")) {
+    LOG(ERROR) << "The daemon replied: " << header;
+    return false;
+  }
+  reply->resize(lexical_cast<size_t>(header.substr(3)));
+  if (!reply->empty() &&
+      !readFromSocket(socket_fd, &(*reply)[0], reply->size())) {
+    LOG(ERROR) << "Lost the connection to the daemon";
+    return false;
+  }
+  int64_t round_trip_us = chrono::duration_cast<chrono::microseconds>(
+      chrono::steady_clock::now() - start_time).count();
+  // The first line of a text reply holds the latency measured by the
+  // daemon.
+  bool binary_reply = FLAGS_binary && FLAGS_reply.compare("flows");
+  LOG(INFO) << kind << " request: " << round_trip_us << " us round trip, "
+            << (binary_reply ? "binary reply" :
+                reply->substr(0, reply->find('\n')));
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  init(argc, argv);
+  FLAGS_logtostderr = true;
+  int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, FLAGS_socket.c_str(),
+          sizeof(address.sun_path) - 1);
+  if (connect(socket_fd, reinterpret_cast<struct sockaddr*>(&address),
+              sizeof(address)) < 0) {
+    LOG(ERROR) << "Could not connect to " << FLAGS_socket;
+    return 1;
+  }
+  string payload;
+  string reply;
+  if (!readPayload(FLAGS_graph_file, &payload)) {
+    return 1;
+  }
+  for (int32_t iter = 0; iter < FLAGS_repeat; ++iter) {
+    if (!sendRequest(socket_fd, "graph", payload, &reply)) {
+      return 1;
+    }
+  }
+  vector<string> update_files;
+  if (!FLAGS_update_files.empty()) {
+    boost::split(update_files, FLAGS_update_files, is_any_of(","));
+  }
+  for (vector<string>::iterator it = update_files.begin();
+       it != update_files.end(); ++it) {
+    if (!readPayload(*it, &payload) || !sendUpdate(socket_fd, payload)) {
+      return 1;
+    }
+  }
+  vector<string> delta_files;
+  if (!FLAGS_delta_files.empty()) {
+    boost::split(delta_files, FLAGS_delta_files, is_any_of(","));
+  }
+  for (vector<string>::iterator it = delta_files.begin();
+       it != delta_files.end(); ++it) {
+    if (!readPayload(*it, &payload)) {
+      return 1;
+    }
+    if (!sendRequest(socket_fd, "delta", payload, &reply)) {
+      return 1;
+    }
+  }
+  FILE* out_graph_file = fopen(FLAGS_out_graph_file.c_str(), "w");
+  if (out_graph_file == NULL) {
+    LOG(ERROR) << "Could no open graph file for writing: "
+               << FLAGS_out_graph_file;
+    return 1;
+  }
+  fwrite(reply.data(), 1, reply.size(), out_graph_file);
+  fclose(out_graph_file);
+  if (FLAGS_quit) {
+    string quit_request("quit\n");
+    string header;
+    writeToSocket(socket_fd, quit_request.data(), quit_request.size());
+    readLineFromSocket(socket_fd, kMaxHeaderLength, &header);
+  }
+  close(socket_fd);
+  return 0;
+}
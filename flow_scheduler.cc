@@ -1,12 +1,30 @@
+#include "assignments.h"
+#include "batch_solver.h"
+#include "certificate.h"
+#include "compressed_input.h"
 #include "cost_scaling.h"
 #include "cycle_cancelling.h"
+#include "decomposition.h"
+#include "delta_stepping.h"
 #include "graph.h"
+#include "memory_policy.h"
+#include "portfolio.h"
+#include "presolve.h"
+#include "solve_budget.h"
+#include "solver_daemon.h"
+#include "solver_stats.h"
+#include "solver_workspace.h"
 #include "successive_shortest.h"
+#include "thread_pool.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <glog/logging.h>
+#include <boost/algorithm/string.hpp>
 #include <gflags/gflags.h>
+#include <functional>
 #include <limits>
+#include <memory>
 
 using namespace flowlessly;
 
@@ -14,9 +32,96 @@ DEFINE_string(graph_file, "graph.in", "File containing the input graph.");
 DEFINE_string(out_graph_file, "graph.out",
               "File the output graph will be written");
 DEFINE_string(algorithm, "cycle_cancelling",
-              "Algorithms to run: cycle_cancelling, bellman_ford, dijkstra, dijkstra_heap, successive_shortest_path, cost_scaling");
+              "Algorithms to run: cycle_cancelling, bellman_ford, dijkstra, "
+              "dijkstra_heap, delta_stepping, successive_shortest_path, "
+              "cost_scaling, portfolio");
 DEFINE_int64(alpha_scaling_factor, 2,
              "Value by which Eps is divided in the cost scaling algorithm");
+DEFINE_string(eps_schedule, "fixed",
+              "How cost scaling lowers Eps: fixed divides it by "
+              "alpha_scaling_factor, adaptive picks the divisor from the "
+              "pushes and relabels of the previous phase");
+DEFINE_bool(wide_arc_types, false,
+            "Always store capacities and costs on 64 bits");
+DEFINE_string(node_ordering, "none",
+              "Renumber the nodes before solving: none, bfs, rcm");
+DEFINE_bool(presolve, false,
+            "Reduce the graph before solving and expand the solution after");
+DEFINE_bool(decompose, false,
+            "Solve the weakly connected components of the graph in parallel");
+DEFINE_int32(num_threads, 1, "Number of threads used by the parallel modes");
+DEFINE_int32(shortest_path_threads, 1,
+             "Threads of the parallel delta-stepping shortest path searches "
+             "of delta_stepping, successive_shortest_path and "
+             "cycle_cancelling. 1 keeps the sequential Bellman-Ford and "
+             "Dijkstra searches");
+DEFINE_bool(global_update, false,
+            "Update the cost scaling potentials from the distances to the "
+            "nodes with a deficit once the arcs of every phase are saturated");
+DEFINE_int32(cost_scaling_threads, 1,
+             "Threads of the parallel cost scaling passes. 1 runs all the "
+             "passes sequentially");
+DEFINE_string(parallel_passes, "saturation,arc_fixing,global_update",
+              "Comma separated cost scaling passes run on "
+              "cost_scaling_threads threads: saturation, arc_fixing, "
+              "global_update");
+DEFINE_string(portfolio_algorithms,
+              "cost_scaling,successive_shortest_path_potentials",
+              "Comma separated min cost flow algorithms raced by the "
+              "portfolio algorithm, each on its own thread");
+DEFINE_int64(time_limit_ms, 0,
+             "Return the best flow found so far after this many "
+             "milliseconds. 0 means no limit");
+DEFINE_uint64(max_iterations, 0,
+              "Return the best flow found so far after this many scaling "
+              "phases, augmenting paths or cancelled cycles. 0 means no limit");
+DEFINE_string(huge_pages, "none",
+              "Back the graph and the solver arrays with huge pages: none, "
+              "transparent or explicit");
+DEFINE_string(numa, "none",
+              "Place the graph and the solver arrays on NUMA nodes: none, "
+              "local or interleave");
+DEFINE_string(daemon_socket, "",
+              "Serve solve requests on this Unix domain socket instead of "
+              "solving graph_file");
+DEFINE_uint64(daemon_max_request_bytes, 1ULL << 30,
+              "Largest request payload the daemon reads");
+DEFINE_uint64(daemon_max_nodes, 1ULL << 26,
+              "Largest number of nodes of a graph sent to the daemon");
+DEFINE_bool(stats, false,
+            "Write timers and counters as JSON to out_graph_file followed by "
+            ".stats.json");
+DEFINE_bool(hardware_counters, false,
+            "Add the cycles, instructions, cache and branch misses of every "
+            "timed phase to the stats");
+DEFINE_bool(verify_solution, false,
+            "Check an optimal flow against the potentials the solver exports "
+            "and exit with 1 if it fails");
+DEFINE_string(assignments_file, "",
+              "Also write the task to resource assignments of the flow to "
+              "this file");
+DEFINE_bool(binary_assignments, false,
+            "Write the assignments as binary records instead of text lines");
+DEFINE_string(potentials_file, "",
+              "Also write the node potentials that certify an optimal flow "
+              "to this file");
+DEFINE_string(warm_start_flow_file, "",
+              "Start cost_scaling from the flow in this file, written by an "
+              "earlier run for a similar graph");
+DEFINE_string(warm_start_potentials_file, "",
+              "Start cost_scaling from the potentials in this file, written "
+              "with --potentials_file by the same run as warm_start_flow_file");
+DEFINE_string(trace_file, "",
+              "Dump the trace buffer to this file. Needs a build with "
+              "TRACE_LEVEL above 0");
+DEFINE_string(batch_graph_files, "",
+              "Comma separated graph files solved on num_threads threads "
+              "instead of graph_file. The flows of each file are written "
+              "next to it with a .out suffix");
+DEFINE_string(batch_stream_file, "",
+              "File of concatenated graphs solved on num_threads threads "
+              "instead of graph_file. The flows are written to "
+              "out_graph_file in the same order");
 
 inline void init(int argc, char *argv[]) {
   // Set up usage message.
@@ -33,58 +138,477 @@ inline void init(int argc, char *argv[]) {
   google::InitGoogleLogging(argv[0]);
 }
 
-int main(int argc, char *argv[]) {
-  init(argc, argv);
-  FLAGS_logtostderr = true;
-  FLAGS_stderrthreshold = 0;
-  Graph graph;
-  graph.readGraph(FLAGS_graph_file);
-  graph.logGraph();
-  int64_t scale_down = 1;
-  if (!FLAGS_algorithm.compare("bellman_ford")) {
-    LOG(INFO) << "------------ BellmanFord ------------";
-    uint32_t num_nodes = graph.get_num_nodes() + 1;
-    vector<int64_t> distance(num_nodes, numeric_limits<int64_t>::max());
-    vector<uint32_t> predecessor(num_nodes, 0);
-    BellmanFord(graph, graph.get_source_nodes(), distance, predecessor);
-    logCosts(distance, predecessor);
-  } else if (!FLAGS_algorithm.compare("dijkstra")) {
-    LOG(INFO) << "------------ Dijkstra ------------";
-    uint32_t num_nodes = graph.get_num_nodes() + 1;
-    vector<int64_t> distance(num_nodes, numeric_limits<int64_t>::max());
-    vector<uint32_t> predecessor(num_nodes, 0);
-    DijkstraSimple(graph, graph.get_source_nodes(), distance, predecessor);
-    logCosts(distance, predecessor);
-  } else if (!FLAGS_algorithm.compare("dijkstra_heap")) {
-    LOG(INFO) << "------------ Dijkstra with heaps ------------";
-    uint32_t num_nodes = graph.get_num_nodes() + 1;
-    vector<int64_t> distance(num_nodes, numeric_limits<int64_t>::max());
-    vector<uint32_t> predecessor(num_nodes, 0);
-    DijkstraOptimized(graph, graph.get_source_nodes(), distance, predecessor);
-    logCosts(distance, predecessor);
-  } else if (!FLAGS_algorithm.compare("cycle_cancelling")) {
+bool isMinCostFlowAlgorithm(const string& algorithm) {
+  return !algorithm.compare("cycle_cancelling") ||
+    !algorithm.compare("successive_shortest_path") ||
+    !algorithm.compare("successive_shortest_path_potentials") ||
+    !algorithm.compare("cost_scaling");
+}
+
+vector<string> getPortfolioAlgorithms() {
+  vector<string> algorithms;
+  boost::split(algorithms, FLAGS_portfolio_algorithms,
+               boost::algorithm::is_any_of(","));
+  return algorithms;
+}
+
+bool isMinCostFlowAlgorithm() {
+  if (FLAGS_algorithm.compare("portfolio")) {
+    return isMinCostFlowAlgorithm(FLAGS_algorithm);
+  }
+  vector<string> algorithms = getPortfolioAlgorithms();
+  for (vector<string>::iterator it = algorithms.begin();
+       it != algorithms.end(); ++it) {
+    if (!isMinCostFlowAlgorithm(*it)) {
+      LOG(ERROR) << "Not a min cost flow algorithm: " << *it;
+      return false;
+    }
+  }
+  return true;
+}
+
+void writeStats(SolverStats& stats) {
+  string stats_file = FLAGS_out_graph_file + ".stats.json";
+  if (!stats.writeJson(stats_file)) {
+    LOG(ERROR) << "Could no open stats file for writing: " << stats_file;
+  }
+}
+
+// Applies the cost scaling flags to the solver. The passes run sequentially
+// if the pool is NULL.
+template<typename CapT, typename CostT>
+void setUpCostScaling(CostScaling<CapT, CostT>& cost_scaling,
+                      ThreadPool* pool) {
+  // The passes are checked in main.
+  uint32_t parallel_passes = 0;
+  parseCostScalingPasses(FLAGS_parallel_passes, &parallel_passes);
+  cost_scaling.set_global_update(FLAGS_global_update);
+  cost_scaling.set_parallel_passes(pool, parallel_passes);
+}
+
+// The pools of the parallel searches, passes and portfolios. They are
+// created once and shared by all the solves of a run, which only wait for
+// the tasks they scheduled to finish. A NULL pool runs the searches or the
+// passes sequentially.
+struct SolverPools {
+  unique_ptr<ThreadPool> shortest_path;
+  unique_ptr<ThreadPool> cost_scaling;
+  unique_ptr<ThreadPool> portfolio;
+};
+
+void createSolverPools(SolverPools* pools) {
+  if (FLAGS_shortest_path_threads > 1) {
+    pools->shortest_path.reset(new ThreadPool(FLAGS_shortest_path_threads));
+  }
+  if (FLAGS_cost_scaling_threads > 1) {
+    pools->cost_scaling.reset(new ThreadPool(FLAGS_cost_scaling_threads));
+  }
+  if (!FLAGS_algorithm.compare("portfolio")) {
+    pools->portfolio.reset(new ThreadPool(getPortfolioAlgorithms().size()));
+  }
+}
+
+// Runs a min cost flow algorithm on the graph.
+template<typename CapT, typename CostT>
+void runMinCostFlowAlgorithm(const string& algorithm,
+                             Graph<CapT, CostT>& graph,
+                             SolverWorkspace& workspace, SolveBudget& budget,
+                             SolverPools& pools) {
+  if (!algorithm.compare("cycle_cancelling")) {
     LOG(INFO) << "------------ Cycle cancelling min cost flow ------------";
-    CycleCancelling cycle_cancelling(graph);
+    CycleCancelling<CapT, CostT> cycle_cancelling(graph, workspace, budget);
+    cycle_cancelling.set_shortest_path_pool(pools.shortest_path.get());
     cycle_cancelling.cycleCancelling();
-  } else if (!FLAGS_algorithm.compare("successive_shortest_path")) {
+  } else if (!algorithm.compare("successive_shortest_path")) {
     LOG(INFO) << "------------ Successive shortest path min cost flow "
               << "------------";
-    SuccessiveShortest successive_shortest(graph);
+    SuccessiveShortest<CapT, CostT> successive_shortest(graph, workspace,
+                                                         budget);
+    successive_shortest.set_shortest_path_pool(pools.shortest_path.get());
     successive_shortest.successiveShortestPath();
-  } else if (!FLAGS_algorithm.compare("successive_shortest_path_potentials")) {
+  } else if (!algorithm.compare("successive_shortest_path_potentials")) {
     LOG(INFO) << "------------ Successive shortest path with potential min"
               << " cost flow ------------";
-    SuccessiveShortest successive_shortest(graph);
+    SuccessiveShortest<CapT, CostT> successive_shortest(graph, workspace,
+                                                         budget);
+    successive_shortest.set_shortest_path_pool(pools.shortest_path.get());
     successive_shortest.successiveShortestPathPotentials();
-  } else if (!FLAGS_algorithm.compare("cost_scaling")) {
+  } else if (!algorithm.compare("cost_scaling")) {
     LOG(INFO) << "------------ Cost scaling min cost flow ------------";
-    CostScaling min_cost_flow(graph);
+    CostScaling<CapT, CostT> min_cost_flow(graph, workspace, budget);
+    setUpCostScaling(min_cost_flow, pools.cost_scaling.get());
     min_cost_flow.costScaling();
-    scale_down = FLAGS_alpha_scaling_factor * graph.get_num_nodes();
+  }
+}
+
+// Warm starts cost scaling from the flow and the potentials the graph
+// holds.
+template<typename CapT, typename CostT>
+void warmStartCostScaling(Graph<CapT, CostT>& graph,
+                          SolverWorkspace& workspace, SolveBudget& budget,
+                          SolverPools& pools) {
+  LOG(INFO) << "------------ Warm started cost scaling min cost flow "
+            << "------------";
+  CostScaling<CapT, CostT> min_cost_flow(graph, workspace, budget);
+  setUpCostScaling(min_cost_flow, pools.cost_scaling.get());
+  min_cost_flow.set_warm_start(true);
+  min_cost_flow.costScaling();
+}
+
+// Runs the min cost flow algorithm selected by --algorithm on the graph.
+template<typename CapT, typename CostT>
+void solveMinCostFlow(Graph<CapT, CostT>& graph, SolverWorkspace& workspace,
+                      SolveBudget& budget, SolverPools& pools) {
+  if (!FLAGS_algorithm.compare("portfolio")) {
+    SolverPortfolio<CapT, CostT> portfolio(graph, *pools.portfolio,
+                                           getPortfolioAlgorithms());
+    portfolio.solve(
+        [&pools](const string& algorithm, Graph<CapT, CostT>& graph,
+                 SolverWorkspace& workspace, SolveBudget& budget) {
+          runMinCostFlowAlgorithm(algorithm, graph, workspace, budget, pools);
+        }, workspace, budget);
+  } else {
+    runMinCostFlowAlgorithm(FLAGS_algorithm, graph, workspace, budget, pools);
+  }
+}
+
+// Binds the pools to solveMinCostFlow for the solvers that take a solve
+// function.
+template<typename CapT, typename CostT>
+function<void(Graph<CapT, CostT>&, SolverWorkspace&, SolveBudget&)>
+bindSolveMinCostFlow(SolverPools& pools) {
+  return [&pools](Graph<CapT, CostT>& graph, SolverWorkspace& workspace,
+                  SolveBudget& budget) {
+    solveMinCostFlow(graph, workspace, budget, pools);
+  };
+}
+
+// Logs the violations and returns false if the certificate of an optimal
+// flow doesn't hold. Flows that are not known to be optimal are not checked.
+template<typename CapT, typename CostT>
+bool verifySolution(Graph<CapT, CostT>& graph, SolverStats& stats) {
+  if (!graph.get_solution_quality().optimal) {
+    LOG(WARNING) << "The flow is not optimal, there is nothing to verify";
+    return true;
+  }
+  ScopedStatsTimer verify_timer(stats, VERIFY_TIMER);
+  ThreadPool pool(FLAGS_num_threads);
+  CertificateChecker<CapT, CostT> checker(graph, pool);
+  if (checker.check()) {
+    LOG(INFO) << "Verified the optimality certificate of the flow";
+    return true;
+  }
+  LOG(ERROR) << "The optimality certificate has "
+             << checker.get_num_violations() << " violations";
+  const vector<string>& violations = checker.get_violations();
+  for (vector<string>::const_iterator it = violations.begin();
+       it != violations.end(); ++it) {
+    LOG(ERROR) << *it;
+  }
+  return false;
+}
+
+// Returns false if the assignments could not be written.
+template<typename CapT, typename CostT>
+bool writeAssignments(Graph<CapT, CostT>& graph) {
+  FILE* assignments_file = fopen(FLAGS_assignments_file.c_str(), "w");
+  if (assignments_file == NULL) {
+    LOG(ERROR) << "Could no open assignments file for writing: "
+               << FLAGS_assignments_file;
+    return false;
+  }
+  vector<TaskAssignment> assignments;
+  extractAssignments(graph, &assignments);
+  AssignmentWriter writer;
+  writer.write(assignments, graph.getFlowCost(),
+               FLAGS_binary_assignments ? BINARY_ASSIGNMENTS :
+               TEXT_ASSIGNMENTS, false,
+               [assignments_file](const string& output) {
+                 return fwrite(output.data(), 1, output.size(),
+                               assignments_file) == output.size();
+               });
+  bool written = writer.flush();
+  return fclose(assignments_file) == 0 && written;
+}
+
+// Returns false if the potentials could not be written.
+template<typename CapT, typename CostT>
+bool writePotentials(Graph<CapT, CostT>& graph) {
+  FILE* potentials_file = fopen(FLAGS_potentials_file.c_str(), "w");
+  if (potentials_file == NULL) {
+    LOG(ERROR) << "Could no open potentials file for writing: "
+               << FLAGS_potentials_file;
+    return false;
+  }
+  if (graph.get_potentials().empty()) {
+    LOG(WARNING) << "The flow is not known to be optimal, there are no "
+                 << "potentials to write";
+  }
+  graph.writePotentials(potentials_file);
+  return fclose(potentials_file) == 0;
+}
+
+// Loads the flow and the potentials of an earlier run into the graph.
+// Returns false, and leaves the graph without flow, if cost scaling can't
+// start from them.
+template<typename CapT, typename CostT>
+bool loadWarmStart(Graph<CapT, CostT>& graph) {
+  if (FLAGS_algorithm.compare("cost_scaling") || FLAGS_presolve ||
+      FLAGS_decompose) {
+    LOG(WARNING) << "Only cost_scaling without presolve or decompose warm "
+                 << "starts, solving from scratch";
+    return false;
+  }
+  FILE* flow_file = openGraphFile(FLAGS_warm_start_flow_file);
+  if (flow_file == NULL) {
+    LOG(ERROR) << "Failed to open flow file: "
+               << FLAGS_warm_start_flow_file;
+    return false;
+  }
+  bool loaded = graph.readFlow(flow_file);
+  fclose(flow_file);
+  if (loaded && !FLAGS_warm_start_potentials_file.empty()) {
+    FILE* potentials_file = openGraphFile(FLAGS_warm_start_potentials_file);
+    if (potentials_file == NULL) {
+      LOG(ERROR) << "Failed to open potentials file: "
+                 << FLAGS_warm_start_potentials_file;
+      loaded = false;
+    } else {
+      loaded = graph.readPotentials(potentials_file);
+      fclose(potentials_file);
+    }
+  }
+  if (!loaded) {
+    LOG(ERROR) << "Could not load the warm start, solving from scratch";
+    graph.resetFlow();
+    graph.get_potentials().clear();
+  }
+  return loaded;
+}
+
+// Returns false if the graph could not be read or the solution failed
+// verification.
+template<typename CapT, typename CostT>
+bool runAlgorithm(SolverPools& pools) {
+  // The deadline covers reading the graph as well as solving it.
+  SolveBudget budget(FLAGS_time_limit_ms, FLAGS_max_iterations);
+  Graph<CapT, CostT> graph;
+  SolverWorkspace workspace;
+  SolverStats& stats = workspace.get_stats();
+  if (FLAGS_stats) {
+    stats.enable();
+  }
+  if (FLAGS_hardware_counters) {
+    stats.enableHardwareCounters();
+  }
+  {
+    ScopedStatsTimer parse_timer(stats, PARSE_TIMER);
+    // A graph that is only partly read must not be solved.
+    if (!graph.readGraph(FLAGS_graph_file)) {
+      return false;
+    }
+  }
+  ScopedStatsTimer setup_timer(stats, SETUP_TIMER);
+  graph.set_export_potentials(FLAGS_verify_solution ||
+                              !FLAGS_potentials_file.empty());
+  // The flow and the potentials use the node ids of the files, so they
+  // are loaded before the nodes are renumbered.
+  bool warm_start = !FLAGS_warm_start_flow_file.empty() &&
+    loadWarmStart(graph);
+  if (!FLAGS_node_ordering.compare("bfs")) {
+    graph.renumberNodes(false);
+  } else if (!FLAGS_node_ordering.compare("rcm")) {
+    graph.renumberNodes(true);
+  } else if (FLAGS_node_ordering.compare("none")) {
+    LOG(ERROR) << "Unknown node ordering: " << FLAGS_node_ordering;
+  }
+  Presolve<CapT, CostT> presolve(graph);
+  if (FLAGS_presolve) {
+    presolve.reduce();
+  }
+  setup_timer.stop();
+  graph.logGraph();
+  ScopedStatsTimer solve_timer(stats, SOLVE_TIMER);
+  bool verified = true;
+  if (!FLAGS_algorithm.compare("bellman_ford")) {
+    LOG(INFO) << "------------ BellmanFord ------------";
+    BellmanFord(graph, graph.get_source_nodes(), workspace);
+    logCosts(workspace, graph.get_num_nodes());
+  } else if (!FLAGS_algorithm.compare("dijkstra")) {
+    LOG(INFO) << "------------ Dijkstra ------------";
+    DijkstraSimple(graph, graph.get_source_nodes(), workspace);
+    logCosts(workspace, graph.get_num_nodes());
+  } else if (!FLAGS_algorithm.compare("dijkstra_heap")) {
+    LOG(INFO) << "------------ Dijkstra with heaps ------------";
+    DijkstraOptimized(graph, graph.get_source_nodes(), workspace);
+    logCosts(workspace, graph.get_num_nodes());
+  } else if (!FLAGS_algorithm.compare("delta_stepping")) {
+    LOG(INFO) << "------------ Delta-stepping ------------";
+    ThreadPool pool(max(FLAGS_shortest_path_threads, 1));
+    DeltaStepping<CapT, CostT> delta_stepping(graph, pool);
+    if (delta_stepping.findShortestPaths(graph.get_source_nodes(),
+                                         workspace) != 0) {
+      LOG(ERROR) << "Stopped on a negative cycle";
+    }
+    logCosts(workspace, graph.get_num_nodes());
+  } else if (isMinCostFlowAlgorithm()) {
+    if (warm_start) {
+      warmStartCostScaling(graph, workspace, budget, pools);
+    } else if (FLAGS_decompose) {
+      ThreadPool pool(FLAGS_num_threads);
+      GraphDecomposition<CapT, CostT> decomposition(graph, pool);
+      decomposition.decompose();
+      decomposition.solveComponents(bindSolveMinCostFlow<CapT, CostT>(pools),
+                                    budget, stats);
+    } else {
+      solveMinCostFlow(graph, workspace, budget, pools);
+    }
+    solve_timer.stop();
+    // The certificate is checked on the graph the solver saw, before the
+    // presolve reductions are undone.
+    if (FLAGS_verify_solution) {
+      verified = verifySolution(graph, stats);
+    }
   } else {
     LOG(ERROR) << "Unknown algorithm: " << FLAGS_algorithm;
   }
+  solve_timer.stop();
+  if (FLAGS_presolve) {
+    ScopedStatsTimer expand_timer(stats, SETUP_TIMER);
+    presolve.expand();
+  }
   LOG(INFO) << "------------ Writing flow graph ------------";
-  graph.writeGraph(FLAGS_out_graph_file, scale_down);
-  return 0;
+  {
+    ScopedStatsTimer output_timer(stats, OUTPUT_TIMER);
+    graph.writeGraph(FLAGS_out_graph_file);
+    if (!FLAGS_assignments_file.empty() && !writeAssignments(graph)) {
+      LOG(ERROR) << "Failed to write the assignments";
+    }
+    if (!FLAGS_potentials_file.empty() && !writePotentials(graph)) {
+      LOG(ERROR) << "Failed to write the potentials";
+    }
+  }
+  if (FLAGS_stats) {
+    writeStats(stats);
+  }
+  if (!FLAGS_trace_file.empty()) {
+    if (FLOWLESSLY_TRACE_LEVEL == 0) {
+      LOG(ERROR) << "Tracing was compiled out, rebuild with TRACE_LEVEL=2";
+    } else if (!dumpTrace(FLAGS_trace_file)) {
+      LOG(ERROR) << "Could no open trace file for writing: "
+                 << FLAGS_trace_file;
+    }
+  }
+  return verified;
+}
+
+int main(int argc, char *argv[]) {
+  init(argc, argv);
+  FLAGS_logtostderr = true;
+  FLAGS_stderrthreshold = 0;
+  HugePagePolicy huge_page_policy;
+  NumaPolicy numa_policy;
+  if (!parseMemoryPolicy(FLAGS_huge_pages, FLAGS_numa, &huge_page_policy,
+                         &numa_policy)) {
+    return 1;
+  }
+  setMemoryPolicy(huge_page_policy, numa_policy);
+  if (FLAGS_eps_schedule.compare("fixed") &&
+      FLAGS_eps_schedule.compare("adaptive")) {
+    LOG(ERROR) << "Unknown eps schedule: " << FLAGS_eps_schedule;
+    return 1;
+  }
+  uint32_t parallel_passes;
+  if (!parseCostScalingPasses(FLAGS_parallel_passes, &parallel_passes)) {
+    return 1;
+  }
+  SolverPools pools;
+  createSolverPools(&pools);
+  if (!FLAGS_daemon_socket.empty()) {
+    if (!isMinCostFlowAlgorithm()) {
+      LOG(ERROR) << "The daemon only runs min cost flow algorithms";
+      return 1;
+    }
+    if (FLAGS_presolve || FLAGS_decompose ||
+        FLAGS_node_ordering.compare("none")) {
+      LOG(ERROR) << "The daemon solves the graphs as they are sent, without "
+                 << "presolve, decompose or node_ordering";
+      return 1;
+    }
+    // The graphs are not known up front, so the daemon uses the wide types.
+    SolveBudget budget(FLAGS_time_limit_ms, FLAGS_max_iterations);
+    SolverDaemon<int64_t, int64_t> daemon(
+        FLAGS_daemon_socket, bindSolveMinCostFlow<int64_t, int64_t>(pools),
+        budget);
+    // Only cost scaling can start from the previous flow.
+    if (!FLAGS_algorithm.compare("cost_scaling")) {
+      daemon.set_warm_solve(
+          [&pools](Graph<int64_t, int64_t>& graph, SolverWorkspace& workspace,
+                   SolveBudget& budget) {
+            warmStartCostScaling(graph, workspace, budget, pools);
+          });
+    }
+    daemon.set_limits(FLAGS_daemon_max_request_bytes,
+                      min<uint64_t>(FLAGS_daemon_max_nodes,
+                                    numeric_limits<uint32_t>::max()));
+    return daemon.run() ? 0 : 1;
+  }
+  if (!FLAGS_batch_graph_files.empty() || !FLAGS_batch_stream_file.empty()) {
+    if (!isMinCostFlowAlgorithm()) {
+      LOG(ERROR) << "Batches are only solved by min cost flow algorithms";
+      return 1;
+    }
+    // Like the daemon's, the graphs use the wide types.
+    SolveBudget budget(FLAGS_time_limit_ms, FLAGS_max_iterations);
+    ThreadPool pool(FLAGS_num_threads);
+    SolverStats stats;
+    if (FLAGS_stats) {
+      stats.enable();
+    }
+    if (FLAGS_hardware_counters) {
+      stats.enableHardwareCounters();
+    }
+    BatchSolver<int64_t, int64_t> batch_solver(
+        pool, bindSolveMinCostFlow<int64_t, int64_t>(pools), budget, stats);
+    bool solved_all;
+    if (!FLAGS_batch_stream_file.empty()) {
+      solved_all = batch_solver.solveStream(FLAGS_batch_stream_file,
+                                            FLAGS_out_graph_file);
+    } else {
+      vector<string> graph_files;
+      boost::split(graph_files, FLAGS_batch_graph_files,
+                   boost::algorithm::is_any_of(","));
+      solved_all = batch_solver.solveFiles(graph_files);
+    }
+    if (FLAGS_stats) {
+      writeStats(stats);
+    }
+    return solved_all ? 0 : 1;
+  }
+  GraphValueRanges ranges;
+  if (!scanGraphValueRanges(FLAGS_graph_file, &ranges)) {
+    return 1;
+  }
+  // Pick the narrowest types that can hold the capacities, the demands
+  // and the costs. The algorithms keep scaled and reduced costs in 64 bit
+  // values of their own, so the arc costs never grow.
+  int64_t max_flow_value = max(ranges.max_capacity,
+                               max(ranges.max_abs_demand, ranges.total_supply));
+  bool narrow_cap = !FLAGS_wide_arc_types &&
+    max_flow_value <= numeric_limits<int32_t>::max();
+  bool narrow_cost = !FLAGS_wide_arc_types &&
+    ranges.max_abs_cost <= numeric_limits<int32_t>::max();
+  LOG(INFO) << "Using " << (narrow_cap ? 32 : 64) << " bit capacities and "
+            << (narrow_cost ? 32 : 64) << " bit costs";
+  bool succeeded;
+  if (narrow_cap && narrow_cost) {
+    succeeded = runAlgorithm<int32_t, int32_t>(pools);
+  } else if (narrow_cap) {
+    succeeded = runAlgorithm<int32_t, int64_t>(pools);
+  } else if (narrow_cost) {
+    succeeded = runAlgorithm<int64_t, int32_t>(pools);
+  } else {
+    succeeded = runAlgorithm<int64_t, int64_t>(pools);
+  }
+  return succeeded ? 0 : 1;
 }
@@ -0,0 +1,599 @@
+#include "assignments.h"
+#include "certificate.h"
+#include "compressed_input.h"
+#include "cost_scaling.h"
+#include "double_buffered_graph.h"
+#include "graph.h"
+#include "solve_budget.h"
+#include "solver_daemon.h"
+#include "solver_workspace.h"
+#include "successive_shortest.h"
+#include "thread_pool.h"
+
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <glog/logging.h>
+#include <gflags/gflags.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+using namespace flowlessly;
+using boost::lexical_cast;
+
+DEFINE_string(work_dir, "/tmp",
+              "Directory the test files and sockets are created in");
+DEFINE_int64(alpha_scaling_factor, 2,
+             "Value by which Eps is divided in the cost scaling algorithm");
+DEFINE_string(eps_schedule, "fixed",
+              "How cost scaling lowers Eps: fixed or adaptive");
+
+// Logs the failed condition and fails the test.
+#define EXPECT(condition)                                               \
+  if (!(condition)) {                                                   \
+    LOG(ERROR) << __FILE__ << ":" << __LINE__ << ": expected " #condition; \
+    return false;                                                       \
+  }
+
+// Two units go from node 1 to node 4 for a cost of 4: one over 1 2 4 and
+// one over 1 2 3 4.
+const char kGraph[] =
+  "p min 4 5\n"
+  "n 1 2\n"
+  "n 4 -2\n"
+  "a 1 2 0 2 1\n"
+  "a 1 3 0 2 2\n"
+  "a 2 3 0 1 0\n"
+  "a 2 4 0 1 1\n"
+  "a 3 4 0 2 1\n";
+const int64_t kGraphCost = 4;
+
+inline void init(int argc, char *argv[]) {
+  string usage("Runs the behavioural tests. Sample usage:\nflow_tests");
+  google::SetUsageMessage(usage);
+  google::ParseCommandLineFlags(&argc, &argv, false);
+  google::InitGoogleLogging(argv[0]);
+}
+
+bool readGraphString(const string& dimacs, Graph<int64_t, int64_t>& graph) {
+  FILE* graph_file = fmemopen(const_cast<char*>(dimacs.data()),
+                              dimacs.size(), "r");
+  bool read = graph.readGraph(graph_file);
+  fclose(graph_file);
+  return read;
+}
+
+void solveGraph(Graph<int64_t, int64_t>& graph, SolverWorkspace& workspace,
+                SolveBudget& budget) {
+  SuccessiveShortest<int64_t, int64_t> successive_shortest(graph, workspace,
+                                                           budget);
+  successive_shortest.successiveShortestPathPotentials();
+}
+
+void solveGraph(Graph<int64_t, int64_t>& graph) {
+  SolverWorkspace workspace;
+  SolveBudget budget(0, 0);
+  solveGraph(graph, workspace, budget);
+}
+
+// Returns true if checking the graph finds a violation that contains
+// description.
+bool findsViolation(Graph<int64_t, int64_t>& graph,
+                    const string& description) {
+  ThreadPool pool(2);
+  CertificateChecker<int64_t, int64_t> checker(graph, pool);
+  if (checker.check()) {
+    return false;
+  }
+  const vector<string>& violations = checker.get_violations();
+  for (vector<string>::const_iterator it = violations.begin();
+       it != violations.end(); ++it) {
+    if (it->find(description) != string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool testCertificateViolations() {
+  Graph<int64_t, int64_t> graph;
+  EXPECT(readGraphString(kGraph, graph));
+  graph.set_export_potentials(true);
+  solveGraph(graph);
+  EXPECT(graph.getFlowCost() == kGraphCost);
+  ThreadPool pool(2);
+  CertificateChecker<int64_t, int64_t> checker(graph, pool);
+  EXPECT(checker.check());
+  EXPECT(checker.get_num_violations() == 0);
+
+  // Raising the potential of node 3 gives the empty arc 1 3 a negative
+  // reduced cost.
+  vector<int64_t> potentials = graph.get_potentials();
+  graph.get_potentials()[3] += 5;
+  EXPECT(findsViolation(graph, "reduced cost"));
+  graph.get_potentials() = potentials;
+
+  // Flow that leaves node 1 without arriving anywhere.
+  Arc<int64_t, int64_t>* arc = graph.get_arcs()[1][3];
+  arc->pushFlow(1);
+  EXPECT(findsViolation(graph, "net outflow"));
+  arc->reverse_arc->pushFlow(1);
+
+  // A residual capacity that doesn't match the reverse arc.
+  arc->cap += 1;
+  EXPECT(findsViolation(graph, "doesn't match the flow"));
+  arc->cap -= 1;
+
+  graph.get_potentials().clear();
+  EXPECT(findsViolation(graph, "exported no potentials"));
+  return true;
+}
+
+bool testExportPotentialsOnRequest() {
+  Graph<int64_t, int64_t> graph;
+  EXPECT(readGraphString(kGraph, graph));
+  solveGraph(graph);
+  EXPECT(graph.get_solution_quality().optimal);
+  EXPECT(graph.get_potentials().empty());
+  return true;
+}
+
+// Returns a graph of num_tasks tasks that each need one of num_machines
+// machines, with enough distinct costs for several scaling phases.
+string assignmentGraph(uint32_t num_tasks, uint32_t num_machines) {
+  uint32_t sink_id = num_tasks + num_machines + 1;
+  string dimacs = "p min " + lexical_cast<string>(sink_id) + " " +
+    lexical_cast<string>(num_tasks * num_machines + num_machines) + "\n";
+  for (uint32_t task = 1; task <= num_tasks; ++task) {
+    dimacs += "n " + lexical_cast<string>(task) + " 1\n";
+  }
+  dimacs += "n " + lexical_cast<string>(sink_id) + " -" +
+    lexical_cast<string>(num_tasks) + "\n";
+  for (uint32_t task = 1; task <= num_tasks; ++task) {
+    for (uint32_t machine = 1; machine <= num_machines; ++machine) {
+      dimacs += "a " + lexical_cast<string>(task) + " " +
+        lexical_cast<string>(num_tasks + machine) + " 0 1 " +
+        lexical_cast<string>((task * 37 + machine * 101) % 997 + 1) + "\n";
+    }
+  }
+  for (uint32_t machine = 1; machine <= num_machines; ++machine) {
+    dimacs += "a " + lexical_cast<string>(num_tasks + machine) + " " +
+      lexical_cast<string>(sink_id) + " 0 " +
+      lexical_cast<string>(num_tasks / num_machines + 2) + " " +
+      lexical_cast<string>(machine * 13) + "\n";
+  }
+  return dimacs;
+}
+
+int64_t costScalingCost(const string& dimacs, int64_t time_limit_ms,
+                        uint64_t max_iterations, SolutionQuality* quality) {
+  Graph<int64_t, int64_t> graph;
+  if (!readGraphString(dimacs, graph)) {
+    return -1;
+  }
+  SolverWorkspace workspace;
+  SolveBudget budget(time_limit_ms, max_iterations);
+  CostScaling<int64_t, int64_t> cost_scaling(graph, workspace, budget);
+  cost_scaling.costScaling();
+  *quality = graph.get_solution_quality();
+  return graph.getFlowCost();
+}
+
+bool testBudgetedCostScaling() {
+  string dimacs = assignmentGraph(60, 7);
+  Graph<int64_t, int64_t> graph;
+  EXPECT(readGraphString(dimacs, graph));
+  solveGraph(graph);
+  int64_t optimal_cost = graph.getFlowCost();
+  SolutionQuality quality;
+  // A deadline that doesn't expire keeps every phase and its rollback
+  // state.
+  EXPECT(costScalingCost(dimacs, 100000, 0, &quality) == optimal_cost);
+  EXPECT(quality.optimal);
+  // An iteration limit ends the solve between phases with a bounded gap.
+  int64_t cost = costScalingCost(dimacs, 0, 3, &quality);
+  EXPECT(quality.unrouted_supply == 0);
+  EXPECT(cost >= optimal_cost);
+  EXPECT(quality.cost_gap >= cost - optimal_cost);
+  EXPECT(costScalingCost(dimacs, 100000, 3, &quality) == cost);
+  return true;
+}
+
+bool testExtractAssignments() {
+  Graph<int64_t, int64_t> graph;
+  EXPECT(readGraphString(kGraph, graph));
+  solveGraph(graph);
+  vector<TaskAssignment> assignments;
+  extractAssignments(graph, &assignments);
+  // The unit that goes over node 3 leaves it for node 4.
+  EXPECT(assignments.size() == 2);
+  EXPECT(assignments[0].task_node_id == 1);
+  EXPECT(assignments[0].resource_node_id == 2);
+  EXPECT(assignments[0].flow == 1);
+  EXPECT(assignments[1].task_node_id == 1);
+  EXPECT(assignments[1].resource_node_id == 3);
+  EXPECT(assignments[1].flow == 1);
+
+  // The path from node 2 first follows the cycle of flow 2 3 4 2, which is
+  // cancelled before the path goes on to the demand.
+  Graph<int64_t, int64_t> cycle_graph;
+  EXPECT(readGraphString("p min 5 5\n"
+                         "n 1 1\n"
+                         "n 5 -1\n"
+                         "a 1 2 0 1 1\n"
+                         "a 2 3 0 1 1\n"
+                         "a 3 4 0 1 1\n"
+                         "a 4 2 0 1 1\n"
+                         "a 2 5 0 1 1\n", cycle_graph));
+  vector<map<uint32_t, Arc<int64_t, int64_t>*> >& arcs =
+    cycle_graph.get_arcs();
+  arcs[1][2]->pushFlow(1);
+  arcs[2][3]->pushFlow(1);
+  arcs[3][4]->pushFlow(1);
+  arcs[4][2]->pushFlow(1);
+  arcs[2][5]->pushFlow(1);
+  extractAssignments(cycle_graph, &assignments);
+  EXPECT(assignments.size() == 1);
+  EXPECT(assignments[0].task_node_id == 1);
+  EXPECT(assignments[0].resource_node_id == 2);
+  EXPECT(assignments[0].flow == 1);
+  return true;
+}
+
+// Returns true if graph reads the flow and the potentials.
+bool readsWarmStart(Graph<int64_t, int64_t>& graph, string flow,
+                    string potentials) {
+  FILE* flow_file = fmemopen(&flow[0], flow.size(), "r");
+  bool read = graph.readFlow(flow_file);
+  fclose(flow_file);
+  if (!read) {
+    return false;
+  }
+  FILE* potentials_file = fmemopen(&potentials[0], potentials.size(), "r");
+  read = graph.readPotentials(potentials_file);
+  fclose(potentials_file);
+  return read;
+}
+
+bool testWarmStartReaders() {
+  Graph<int64_t, int64_t> graph;
+  EXPECT(readGraphString(kGraph, graph));
+  EXPECT(readsWarmStart(graph, "f 1 2 2\nf 2 3 1\nf 2 4 1\nf 3 4 1\n",
+                        "d 1 0\nd 2 1\nd 3 1\nd 4 2\n"));
+  EXPECT(graph.getFlowCost() == kGraphCost);
+  EXPECT(graph.get_potentials()[4] == 2);
+  // Malformed lines fail the read instead of aborting.
+  EXPECT(!readsWarmStart(graph, "f 1 2\n", "d 1 0\n"));
+  EXPECT(!readsWarmStart(graph, "f 1 2 x\n", "d 1 0\n"));
+  EXPECT(!readsWarmStart(graph, "f 1 2 1\n", "d 1\n"));
+  EXPECT(!readsWarmStart(graph, "f 1 2 1\n", "d 1 99999999999999999999\n"));
+  EXPECT(graph.get_potentials().empty());
+  return true;
+}
+
+bool applyDimacsUpdate(Graph<int64_t, int64_t>& graph, GraphUpdate& update,
+                       string* error) {
+  if (!update.is_delta) {
+    graph.initNodes(0, 0);
+  }
+  FILE* graph_file = fmemopen(&update.payload[0], update.payload.size(), "r");
+  bool applied = update.is_delta ? graph.updateGraph(graph_file) :
+    graph.readGraph(graph_file);
+  fclose(graph_file);
+  if (!applied) {
+    *error = "invalid DIMACS payload";
+  }
+  return applied;
+}
+
+GraphUpdate* createUpdate(bool is_delta, bool solve, const string& dimacs) {
+  GraphUpdate* update = new GraphUpdate();
+  update->is_delta = is_delta;
+  update->solve = solve;
+  update->payload.assign(dimacs.begin(), dimacs.end());
+  return update;
+}
+
+bool testDoubleBufferedGraphReplay() {
+  DoubleBufferedGraph<int64_t, int64_t> graphs(&applyDimacsUpdate);
+  string error;
+  GraphUpdate* update = createUpdate(false, true, kGraph);
+  graphs.push(update);
+  Graph<int64_t, int64_t>* first = graphs.startSolve(update, &error);
+  EXPECT(first != NULL);
+  EXPECT(first->get_num_arcs() == 5);
+
+  // The update that isn't solved and the delta land in the other copy.
+  graphs.push(createUpdate(true, false, "a 1 3 0 2 0\n"));
+  update = createUpdate(true, true, "r 2 3\n");
+  graphs.push(update);
+  Graph<int64_t, int64_t>* second = graphs.startSolve(update, &error);
+  EXPECT(second != NULL);
+  EXPECT(second != first);
+  EXPECT(second->get_arcs()[1][3]->cost == 0);
+  EXPECT(second->get_arcs()[2].count(3) == 0);
+  solveGraph(*second);
+  EXPECT(second->getFlowCost() == 2);
+
+  // The first copy missed both updates; they are replayed before the
+  // new delta.
+  update = createUpdate(true, true, "a 3 4 0 1 1\n");
+  graphs.push(update);
+  Graph<int64_t, int64_t>* third = graphs.startSolve(update, &error);
+  EXPECT(third == first);
+  EXPECT(third->get_arcs()[1][3]->cost == 0);
+  EXPECT(third->get_arcs()[2].count(3) == 0);
+  EXPECT(third->get_arcs()[3][4]->initial_cap == 1);
+  solveGraph(*third);
+  EXPECT(third->getFlowCost() == 3);
+
+  // A failed delta drops the graph until a full graph arrives.
+  update = createUpdate(true, true, "a 1 9 0 1 1\n");
+  graphs.push(update);
+  EXPECT(graphs.startSolve(update, &error) == NULL);
+  EXPECT(error == "invalid DIMACS payload");
+  update = createUpdate(true, true, "a 1 2 0 2 1\n");
+  graphs.push(update);
+  EXPECT(graphs.startSolve(update, &error) == NULL);
+  update = createUpdate(false, true, kGraph);
+  graphs.push(update);
+  EXPECT(graphs.startSolve(update, &error) != NULL);
+  return true;
+}
+
+// Returns the socket of a new connection to the daemon, or -1.
+int connectToDaemon(const string& socket_path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socket_path.c_str(),
+          sizeof(address.sun_path) - 1);
+  // The daemon may not be listening yet.
+  for (uint32_t attempt = 0; attempt < 100; ++attempt) {
+    int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(socket_fd, reinterpret_cast<struct sockaddr*>(&address),
+                sizeof(address)) == 0) {
+      return socket_fd;
+    }
+    close(socket_fd);
+    this_thread::sleep_for(chrono::milliseconds(10));
+  }
+  return -1;
+}
+
+// Sends a request and reads the reply header and its payload, if any.
+bool sendRequest(int socket_fd, const string& request, string* header,
+                 string* payload) {
+  payload->clear();
+  if (!writeToSocket(socket_fd, request.data(), request.size()) ||
+      !readLineFromSocket(socket_fd, kMaxHeaderLength, header)) {
+    return false;
+  }
+  if (header->compare(0, 3, "ok ")) {
+    return true;
+  }
+  payload->resize(lexical_cast<size_t>(header->substr(3)));
+  return payload->empty() ||
+    readFromSocket(socket_fd, &(*payload)[0], payload->size());
+}
+
+string dimacsRequest(const string& kind, const string& dimacs) {
+  return kind + " dimacs " + lexical_cast<string>(dimacs.size()) + "\n" +
+    dimacs;
+}
+
+bool testDaemonProtocolErrors() {
+  string socket_path = FLAGS_work_dir + "/flow_tests." +
+    lexical_cast<string>(getpid()) + ".sock";
+  SolverDaemon<int64_t, int64_t> daemon(
+      socket_path,
+      [](Graph<int64_t, int64_t>& graph, SolverWorkspace& workspace,
+         SolveBudget& budget) {
+        solveGraph(graph, workspace, budget);
+      }, SolveBudget(0, 0));
+  daemon.set_limits(1 << 20, 100);
+  bool served = false;
+  thread daemon_thread([&daemon, &served] { served = daemon.run(); });
+  string header;
+  string payload;
+  // The payload length of a malformed header is unknown, so the daemon
+  // hangs up.
+  int socket_fd = connectToDaemon(socket_path);
+  EXPECT(socket_fd >= 0);
+  EXPECT(sendRequest(socket_fd, "graph dimacs abc\n", &header, &payload));
+  EXPECT(header == "error malformed request header");
+  close(socket_fd);
+  socket_fd = connectToDaemon(socket_path);
+  EXPECT(sendRequest(socket_fd, "graph dimacs 99999999\n", &header,
+                     &payload));
+  EXPECT(header == "error malformed request header");
+  close(socket_fd);
+
+  // Bad payloads only fail their request.
+  socket_fd = connectToDaemon(socket_path);
+  EXPECT(sendRequest(socket_fd,
+                     dimacsRequest("graph", "p min 2 1\na 1 2 0 x 3\n"),
+                     &header, &payload));
+  EXPECT(header == "error invalid DIMACS payload");
+  EXPECT(sendRequest(socket_fd, dimacsRequest("graph", "p min 1000 0\n"),
+                     &header, &payload));
+  EXPECT(header == "error too many nodes");
+  EXPECT(sendRequest(socket_fd, dimacsRequest("delta", "a 1 2 0 1 1\n"),
+                     &header, &payload));
+  EXPECT(header.compare(0, 6, "error ") == 0);
+  // Lines may be longer than any buffer of the parser.
+  EXPECT(sendRequest(socket_fd,
+                     dimacsRequest("graph", "c " + string(300, 'x') + "\n" +
+                                   kGraph), &header, &payload));
+  EXPECT(header.compare(0, 3, "ok ") == 0);
+  EXPECT(payload.find("s " + lexical_cast<string>(kGraphCost) + "\n") !=
+         string::npos);
+  EXPECT(sendRequest(socket_fd, "quit\n", &header, &payload));
+  EXPECT(header == "ok 0");
+  close(socket_fd);
+  daemon_thread.join();
+  EXPECT(served);
+  EXPECT(access(socket_path.c_str(), F_OK) != 0);
+  return true;
+}
+
+bool writeGzipFile(const string& path, const string& contents) {
+  gzFile gzip_file = gzopen(path.c_str(), "wb");
+  if (gzip_file == NULL) {
+    return false;
+  }
+  bool written = gzwrite(gzip_file, contents.data(), contents.size()) ==
+    static_cast<int>(contents.size());
+  return gzclose(gzip_file) == Z_OK && written;
+}
+
+bool testCompressedInput() {
+  string graph_path = FLAGS_work_dir + "/flow_tests." +
+    lexical_cast<string>(getpid()) + ".in.gz";
+  // Comments make the file span several buffers of the decompressor.
+  string dimacs(kGraph);
+  for (uint32_t line = 0; line < 20000; ++line) {
+    dimacs += "c padding line " + lexical_cast<string>(line) + "\n";
+  }
+  EXPECT(writeGzipFile(graph_path, dimacs));
+  GraphValueRanges ranges;
+  EXPECT(scanGraphValueRanges(graph_path, &ranges));
+  EXPECT(ranges.num_nodes == 4);
+  EXPECT(ranges.max_abs_cost == 2);
+  Graph<int64_t, int64_t> graph;
+  EXPECT(graph.readGraph(graph_path));
+  EXPECT(graph.get_num_nodes() == 4);
+  EXPECT(graph.get_num_arcs() == 5);
+  solveGraph(graph);
+  EXPECT(graph.getFlowCost() == kGraphCost);
+
+  // A truncated file is an error, not a shorter graph.
+  FILE* gzip_file = fopen(graph_path.c_str(), "r+");
+  EXPECT(gzip_file != NULL);
+  fseek(gzip_file, 0, SEEK_END);
+  long size = ftell(gzip_file);
+  fclose(gzip_file);
+  EXPECT(truncate(graph_path.c_str(), size / 2) == 0);
+  FILE* graph_file = openGraphFile(graph_path);
+  EXPECT(graph_file != NULL);
+  Graph<int64_t, int64_t> truncated_graph;
+  bool read = truncated_graph.readGraph(graph_file);
+  fclose(graph_file);
+  bool scanned = scanGraphValueRanges(graph_path, &ranges);
+  unlink(graph_path.c_str());
+  EXPECT(!read);
+  EXPECT(!scanned);
+  return true;
+}
+
+// Returns true if scanning a file that holds dimacs succeeds.
+bool scansGraph(const string& dimacs, GraphValueRanges* ranges) {
+  string graph_path = FLAGS_work_dir + "/flow_tests." +
+    lexical_cast<string>(getpid()) + ".in";
+  FILE* graph_file = fopen(graph_path.c_str(), "w");
+  if (graph_file == NULL) {
+    return false;
+  }
+  fputs(dimacs.c_str(), graph_file);
+  fclose(graph_file);
+  bool scanned = scanGraphValueRanges(graph_path, ranges);
+  unlink(graph_path.c_str());
+  return scanned;
+}
+
+bool testValueRangeScan() {
+  GraphValueRanges ranges;
+  EXPECT(scansGraph(kGraph, &ranges));
+  EXPECT(!scansGraph("p min 2 1\na 1 2 0 5\n", &ranges));
+  EXPECT(!scansGraph("p min 2 1\na 1 2 0 5 x\n", &ranges));
+  EXPECT(!scansGraph("p min 2\n", &ranges));
+  // Parallel arcs become one arc that holds their summed capacity.
+  EXPECT(scansGraph("p min 2 2\n"
+                    "a 1 2 0 2000000000 1\n"
+                    "a 1 2 0 2000000000 2\n", &ranges));
+  EXPECT(ranges.max_capacity == 4000000000LL);
+  return true;
+}
+
+// Three units go from node 1 to node 2: over the cheap and the expensive
+// segment of the parallel arcs and over node 3.
+const char kParallelArcsGraph[] =
+  "p min 3 4\n"
+  "n 1 3\n"
+  "n 2 -3\n"
+  "a 1 2 0 1 5\n"
+  "a 1 3 0 1 1\n"
+  "a 3 2 0 1 2\n"
+  "a 1 2 0 1 1\n";
+const int64_t kParallelArcsGraphCost = 9;
+
+bool testParallelArcs() {
+  Graph<int32_t, int32_t> graph;
+  string dimacs(kParallelArcsGraph);
+  FILE* graph_file = fmemopen(&dimacs[0], dimacs.size(), "r");
+  bool read = graph.readGraph(graph_file);
+  fclose(graph_file);
+  EXPECT(read);
+  EXPECT(graph.get_num_arcs() == 3);
+  Arc<int32_t, int32_t>* arc = graph.get_arcs()[1][2];
+  EXPECT(arc->has_segments);
+  EXPECT(arc->reverse_arc->get_segments() == arc->get_segments());
+  EXPECT(arc->cost == 1);
+  // A copy gets segments of its own.
+  Graph<int32_t, int32_t> copy(graph);
+  Arc<int32_t, int32_t>* copy_arc = copy.get_arcs()[1][2];
+  EXPECT(copy_arc->get_segments() != arc->get_segments());
+  EXPECT(copy_arc->get_segments()->forward_arc == copy_arc);
+  SolverWorkspace workspace;
+  SolveBudget budget(0, 0);
+  SuccessiveShortest<int32_t, int32_t> successive_shortest(copy, workspace,
+                                                           budget);
+  successive_shortest.successiveShortestPathPotentials();
+  EXPECT(copy.getFlowCost() == kParallelArcsGraphCost);
+  EXPECT(copy_arc->get_flow() == 2);
+  EXPECT(copy_arc->get_segment_flow(1) == 1);
+  EXPECT(graph.getFlowCost() == 0);
+  // Replacing the arc drops its segments.
+  copy.setArc(1, 2, 4, 3);
+  EXPECT(!copy_arc->has_segments);
+  EXPECT(!copy_arc->reverse_arc->has_segments);
+  return true;
+}
+
+struct Test {
+  const char* name;
+  bool (*run)();
+};
+
+int main(int argc, char *argv[]) {
+  init(argc, argv);
+  FLAGS_logtostderr = true;
+  const Test tests[] = {
+    {"certificate_violations", &testCertificateViolations},
+    {"export_potentials_on_request", &testExportPotentialsOnRequest},
+    {"budgeted_cost_scaling", &testBudgetedCostScaling},
+    {"extract_assignments", &testExtractAssignments},
+    {"warm_start_readers", &testWarmStartReaders},
+    {"double_buffered_graph_replay", &testDoubleBufferedGraphReplay},
+    {"daemon_protocol_errors", &testDaemonProtocolErrors},
+    {"compressed_input", &testCompressedInput},
+    {"value_range_scan", &testValueRangeScan},
+    {"parallel_arcs", &testParallelArcs},
+  };
+  uint32_t num_tests = sizeof(tests) / sizeof(tests[0]);
+  uint32_t num_failed = 0;
+  for (uint32_t index = 0; index < num_tests; ++index) {
+    bool passed = tests[index].run();
+    printf("%s %s\n", passed ? "PASS" : "FAIL", tests[index].name);
+    if (!passed) {
+      num_failed++;
+    }
+  }
+  printf("%u of %u tests failed\n", num_failed, num_tests);
+  return num_failed == 0 ? 0 : 1;
+}
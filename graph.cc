@@ -1,10 +1,17 @@
 #include "graph.h"
 
+#include "compressed_input.h"
+#include "trace.h"
+
 #include <boost/algorithm/string.hpp>
 #include <boost/lexical_cast.hpp>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
+#include <algorithm>
+#include <limits>
+#include <queue>
 #include <stack>
+#include <stdlib.h>
 
 namespace flowlessly {
 
@@ -12,116 +19,685 @@ namespace flowlessly {
   using boost::lexical_cast;
   using boost::token_compress_on;
 
-  void Graph::allocateGraphMemory(uint32_t num_nodes, uint32_t num_arcs) {
+  // Reads lines of any length, which untrusted payloads may contain, into
+  // a buffer that is reused from line to line.
+  class LineReader {
+
+  public:
+    explicit LineReader(FILE* file): file(file), line(NULL), capacity(0) {
+    }
+
+    ~LineReader() {
+      free(line);
+    }
+
+    // Returns the next non-empty line without its newline, or NULL at the
+    // end of the file or on a read error.
+    const char* next() {
+      ssize_t length;
+      while ((length = getline(&line, &capacity, file)) >= 0) {
+        if (length > 0 && line[length - 1] == '\n') {
+          line[--length] = '\0';
+        }
+        if (length > 0) {
+          return line;
+        }
+      }
+      return NULL;
+    }
+
+  private:
+    FILE* file;
+    char* line;
+    size_t capacity;
+
+  };
+
+  // Returns true if a DIMACS line has all the values of its kind.
+  bool hasDimacsValues(const vector<string>& vals) {
+    size_t num_values = vals[0].compare("a") == 0 ? 6 :
+      vals[0].compare("p") == 0 || vals[0].compare("f") == 0 ? 4 :
+      vals[0].compare("c") == 0 ? 1 : 3;
+    return vals.size() >= num_values;
+  }
+
+  bool scanGraphValueRanges(const string& graph_file_path,
+                            GraphValueRanges* ranges) {
+    FILE* graph_file = NULL;
+    if ((graph_file = openGraphFile(graph_file_path)) == NULL) {
+      LOG(ERROR) << "Failed to open graph file: " << graph_file_path;
+      return false;
+    }
+    ranges->num_nodes = 0;
+    ranges->num_arcs = 0;
+    ranges->max_capacity = 0;
+    ranges->max_abs_cost = 0;
+    ranges->max_abs_demand = 0;
+    ranges->total_supply = 0;
+    LineReader reader(graph_file);
+    const char* line;
+    uint32_t line_num = 0;
+    vector<string> vals;
+    // Capacity of the arcs from the source to the destination in the high
+    // and the low 32 bits of the key.
+    unordered_map<uint64_t, int64_t> arcs_capacity;
+    bool scanned = true;
+    try {
+      while (scanned && (line = reader.next()) != NULL) {
+        line_num++;
+        boost::split(vals, line, is_any_of(" "), token_compress_on);
+        if (!hasDimacsValues(vals)) {
+          LOG(ERROR) << "Missing values on line: " << line_num;
+          scanned = false;
+        } else if (vals[0].compare("a") == 0) {
+          uint64_t arc_key =
+            static_cast<uint64_t>(lexical_cast<uint32_t>(vals[1])) << 32 |
+            lexical_cast<uint32_t>(vals[2]);
+          int64_t capacity = lexical_cast<int64_t>(vals[4]);
+          int64_t cost = lexical_cast<int64_t>(vals[5]);
+          int64_t& arc_capacity = arcs_capacity[arc_key];
+          if (__builtin_add_overflow(arc_capacity, capacity, &arc_capacity)) {
+            arc_capacity = numeric_limits<int64_t>::max();
+          }
+          ranges->max_capacity = max(ranges->max_capacity, arc_capacity);
+          ranges->max_abs_cost = max(ranges->max_abs_cost,
+                                     cost < 0 ? -cost : cost);
+        } else if (vals[0].compare("n") == 0) {
+          int64_t demand = lexical_cast<int64_t>(vals[2]);
+          ranges->max_abs_demand = max(ranges->max_abs_demand,
+                                       demand < 0 ? -demand : demand);
+          if (demand > 0) {
+            ranges->total_supply += demand;
+          }
+        } else if (vals[0].compare("p") == 0) {
+          ranges->num_nodes = lexical_cast<uint32_t>(vals[2]);
+          ranges->num_arcs = lexical_cast<uint32_t>(vals[3]);
+        }
+      }
+    } catch (const boost::bad_lexical_cast&) {
+      LOG(ERROR) << "Invalid number on line: " << line_num;
+      scanned = false;
+    }
+    if (scanned && ferror(graph_file)) {
+      LOG(ERROR) << "Failed to scan the graph after line: " << line_num;
+      scanned = false;
+    }
+    fclose(graph_file);
+    return scanned;
+  }
+
+  template<typename CapT, typename CostT>
+  Graph<CapT, CostT>::Graph(const Graph<CapT, CostT>& copy):
+    num_nodes(copy.num_nodes), num_arcs(copy.num_arcs),
+    nodes_demand(copy.nodes_demand), arcs(copy.arcs.size()),
+    source_nodes(copy.source_nodes), sink_nodes(copy.sink_nodes),
+    single_source_node(copy.single_source_node),
+    single_sink_node(copy.single_sink_node),
+    added_sink_and_source(copy.added_sink_and_source),
+    original_node_id(copy.original_node_id),
+    solution_quality(copy.solution_quality), potentials(copy.potentials),
+    export_potentials(copy.export_potentials) {
+    unordered_map<Arc<CapT, CostT>*, Arc<CapT, CostT>*> clones;
+    for (uint32_t node_id = 0; node_id < copy.arcs.size(); ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        copy.arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        copy.arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        arcs[node_id][it->first] = cloneArc(it->second, clones);
+      }
+    }
+    for (typename list<Arc<CapT, CostT>*>::const_iterator it =
+           copy.fixed_arcs.begin(); it != copy.fixed_arcs.end(); ++it) {
+      fixed_arcs.push_back(cloneArc(*it, clones));
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  Graph<CapT, CostT>::~Graph() {
+    deleteArcs();
+  }
+
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::deleteArcs() {
+    for (uint32_t node_id = 0; node_id < arcs.size(); ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        deleteSegments(it->second);
+        delete it->second;
+      }
+    }
+    for (typename list<Arc<CapT, CostT>*>::iterator it = fixed_arcs.begin();
+         it != fixed_arcs.end(); ++it) {
+      deleteSegments(*it);
+      delete *it;
+    }
+  }
+
+  // Both arcs lose the segments, so the arc that is deleted second doesn't
+  // see them.
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::deleteSegments(Arc<CapT, CostT>* arc) {
+    ArcSegments<CapT, CostT>* segments = arc->get_segments();
+    if (segments != NULL) {
+      arc->set_segments(NULL);
+      delete segments;
+    }
+  }
+
+  // Clones an arc together with its reverse arc.
+  template<typename CapT, typename CostT>
+  Arc<CapT, CostT>* Graph<CapT, CostT>::cloneArc(
+      Arc<CapT, CostT>* arc,
+      unordered_map<Arc<CapT, CostT>*, Arc<CapT, CostT>*>& clones) {
+    typename unordered_map<Arc<CapT, CostT>*, Arc<CapT, CostT>*>::iterator
+      clone_it = clones.find(arc);
+    if (clone_it != clones.end()) {
+      return clone_it->second;
+    }
+    Arc<CapT, CostT>* clone = new Arc<CapT, CostT>(*arc);
+    Arc<CapT, CostT>* reverse_clone = new Arc<CapT, CostT>(*arc->reverse_arc);
+    clone->set_reverse_arc(reverse_clone);
+    reverse_clone->set_reverse_arc(clone);
+    ArcSegments<CapT, CostT>* arc_segments = arc->get_segments();
+    if (arc_segments != NULL) {
+      ArcSegments<CapT, CostT>* segments =
+        new ArcSegments<CapT, CostT>(*arc_segments);
+      segments->forward_arc =
+        arc_segments->forward_arc == arc ? clone : reverse_clone;
+      clone->set_segments(segments);
+    }
+    clones[arc] = clone;
+    clones[arc->reverse_arc] = reverse_clone;
+    return clone;
+  }
+
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::allocateGraphMemory(uint32_t num_nodes,
+                                               uint32_t num_arcs) {
     arcs.resize(num_nodes + 1);
     nodes_demand.resize(num_nodes + 1);
+    applyMemoryPolicy(arcs);
+    applyMemoryPolicy(nodes_demand);
+  }
+
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::initNodes(uint32_t num_nodes, uint32_t num_arcs) {
+    deleteArcs();
+    this->num_nodes = num_nodes;
+    this->num_arcs = num_arcs;
+    arcs.clear();
+    nodes_demand.clear();
+    fixed_arcs.clear();
+    source_nodes.clear();
+    sink_nodes.clear();
+    single_source_node.clear();
+    single_sink_node.clear();
+    original_node_id.clear();
+    solution_quality = SolutionQuality();
+    potentials.clear();
+    added_sink_and_source = false;
+    allocateGraphMemory(num_nodes, num_arcs);
   }
 
-  void Graph::readGraph(const string& graph_file_path) {
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::readGraph(const string& graph_file_path) {
     FILE* graph_file = NULL;
-    if ((graph_file = fopen(graph_file_path.c_str(), "r")) == NULL) {
+    if ((graph_file = openGraphFile(graph_file_path)) == NULL) {
       LOG(ERROR) << "Failed to open graph file: " << graph_file_path;
-      return;
+      return false;
     }
-    char line[100];
+    bool read = readGraph(graph_file);
+    fclose(graph_file);
+    return read;
+  }
+
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::readGraph(FILE* graph_file) {
+    return parseGraph(graph_file, false);
+  }
+
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::updateGraph(FILE* delta_file) {
+    return parseGraph(delta_file, true);
+  }
+
+  // Reads DIMACS lines. A delta can't contain a problem line; it can
+  // contain "r src dst" lines that remove arcs.
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::parseGraph(FILE* graph_file, bool is_delta) {
+    LineReader reader(graph_file);
+    const char* line;
     uint32_t line_num = 0;
     vector<string> vals;
-    while (!feof(graph_file)) {
-      if (fscanf(graph_file, "%[^\n]%*[\n]", &line[0]) > 0) {
+    // lexical_cast throws on a malformed number.
+    try {
+      while ((line = reader.next()) != NULL) {
         line_num++;
         boost::split(vals, line, is_any_of(" "), token_compress_on);
-        if (vals[0].compare("a") == 0) {
+        if (!hasDimacsValues(vals)) {
+          LOG(ERROR) << "Missing values on line: " << line_num;
+          return false;
+        }
+        if (vals[0].compare("a") == 0 || vals[0].compare("r") == 0) {
           uint32_t src_node = lexical_cast<uint32_t>(vals[1]);
           uint32_t dst_node = lexical_cast<uint32_t>(vals[2]);
+          if (src_node == 0 || src_node > num_nodes || dst_node == 0 ||
+              dst_node > num_nodes) {
+            LOG(ERROR) << "Unknown node on line: " << line_num;
+            return false;
+          }
+          if (vals[0].compare("r") == 0) {
+            removeArc(src_node, dst_node);
+            continue;
+          }
           int32_t arc_min_flow = lexical_cast<uint32_t>(vals[3]);
-          uint32_t arc_capacity = lexical_cast<uint32_t>(vals[4]);
-          int64_t arc_cost = lexical_cast<int64_t>(vals[5]);
-          Arc* arc = new Arc(src_node, dst_node, arc_capacity, arc_cost, NULL);
-          Arc* reverse_arc = new Arc(dst_node, src_node, 0, -arc_cost, arc);
-          arc->set_reverse_arc(reverse_arc);
-          arcs[src_node][dst_node] = arc;
-          arcs[dst_node][src_node] = reverse_arc;
+          CapT arc_capacity = lexical_cast<CapT>(vals[4]);
+          CostT arc_cost = lexical_cast<CostT>(vals[5]);
+          if (is_delta) {
+            setArc(src_node, dst_node, arc_capacity, arc_cost);
+          } else if (!addArcSegment(src_node, dst_node, arc_capacity,
+                                    arc_cost)) {
+            LOG(ERROR) << "The capacity of the parallel arcs overflows on "
+                       << "line: " << line_num;
+            return false;
+          }
         } else if (vals[0].compare("n") == 0) {
           uint32_t node_id = lexical_cast<uint32_t>(vals[1]);
-          nodes_demand[node_id] = lexical_cast<int32_t>(vals[2]);
-          if (nodes_demand[node_id] > 0) {
-            source_nodes.push_back(node_id);
-          } else if (nodes_demand[node_id] < 0) {
-            sink_nodes.push_back(node_id);
+          if (node_id == 0 || node_id > num_nodes) {
+            LOG(ERROR) << "Unknown node on line: " << line_num;
+            return false;
           }
-        } else if (vals[0].compare("p") == 0) {
-          num_nodes = lexical_cast<uint32_t>(vals[2]);
-          num_arcs = lexical_cast<uint32_t>(vals[3]);
-          allocateGraphMemory(num_nodes, num_arcs);
+          setNodeDemand(node_id, lexical_cast<CapT>(vals[2]));
+        } else if (vals[0].compare("p") == 0 && !is_delta) {
+          // setArc counts the arcs as they are added.
+          initNodes(lexical_cast<uint32_t>(vals[2]), 0);
         } else if (vals[0].compare("c") == 0) {
           // Comment line. Ignore it.
         } else {
           LOG(ERROR) << "The file doesn't respect the DIMACS format on line: "
                      << line_num;
+          return false;
         }
       }
+    } catch (const boost::bad_lexical_cast&) {
+      LOG(ERROR) << "Invalid number on line: " << line_num;
+      return false;
     }
-    fclose(graph_file);
+    if (ferror(graph_file)) {
+      LOG(ERROR) << "Failed to read the graph after line: " << line_num;
+      return false;
+    }
+    return true;
   }
 
-  void Graph::writeGraph(const string& out_graph_file, int64_t scale_down) {
-    int64_t min_cost = 0;
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::setArc(uint32_t src_node_id, uint32_t dst_node_id,
+                                  CapT capacity, CostT cost) {
+    typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+      arcs[src_node_id].find(dst_node_id);
+    if (it != arcs[src_node_id].end()) {
+      Arc<CapT, CostT>* arc = it->second;
+      deleteSegments(arc);
+      arc->cap = capacity;
+      arc->initial_cap = capacity;
+      arc->cost = cost;
+      arc->reverse_arc->cap = 0;
+      arc->reverse_arc->initial_cap = 0;
+      arc->reverse_arc->cost = -cost;
+      return false;
+    }
+    Arc<CapT, CostT>* arc =
+      new Arc<CapT, CostT>(src_node_id, dst_node_id, capacity, cost, NULL);
+    Arc<CapT, CostT>* reverse_arc =
+      new Arc<CapT, CostT>(dst_node_id, src_node_id, 0, -cost, arc);
+    arc->set_reverse_arc(reverse_arc);
+    arcs[src_node_id][dst_node_id] = arc;
+    arcs[dst_node_id][src_node_id] = reverse_arc;
+    num_arcs++;
+    return true;
+  }
+
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::addArcSegment(uint32_t src_node_id,
+                                         uint32_t dst_node_id, CapT capacity,
+                                         CostT cost) {
+    typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+      arcs[src_node_id].find(dst_node_id);
+    if (it == arcs[src_node_id].end()) {
+      setArc(src_node_id, dst_node_id, capacity, cost);
+      return true;
+    }
+    return it->second->addSegment(capacity, cost);
+  }
+
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::removeArc(uint32_t src_node_id,
+                                     uint32_t dst_node_id) {
+    typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+      arcs[src_node_id].find(dst_node_id);
+    if (it == arcs[src_node_id].end()) {
+      return false;
+    }
+    Arc<CapT, CostT>* arc = it->second;
+    arcs[src_node_id].erase(it);
+    arcs[dst_node_id].erase(src_node_id);
+    deleteSegments(arc);
+    delete arc->reverse_arc;
+    delete arc;
+    num_arcs--;
+    return true;
+  }
+
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::setNodeDemand(uint32_t node_id, CapT demand) {
+    if (nodes_demand[node_id] > 0) {
+      source_nodes.erase(find(source_nodes.begin(), source_nodes.end(),
+                              node_id));
+    } else if (nodes_demand[node_id] < 0) {
+      sink_nodes.erase(find(sink_nodes.begin(), sink_nodes.end(), node_id));
+    }
+    nodes_demand[node_id] = demand;
+    if (demand > 0) {
+      source_nodes.push_back(node_id);
+    } else if (demand < 0) {
+      sink_nodes.push_back(node_id);
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::resetFlow() {
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        if (!it->second->has_segments) {
+          it->second->cap = it->second->initial_cap;
+        } else {
+          it->second->set_flow(0);
+        }
+      }
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::copyFlow(Graph<CapT, CostT>& solved) {
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      // Both maps hold the same keys, so they are walked side by side.
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+        arcs[node_id].end();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator solved_it =
+        solved.arcs[node_id].begin();
+      for (; it != end_it; ++it, ++solved_it) {
+        if (!it->second->has_segments) {
+          it->second->cap = solved_it->second->cap;
+        } else {
+          it->second->set_flow(solved_it->second->get_flow());
+        }
+      }
+    }
+    solution_quality = solved.solution_quality;
+    potentials = solved.potentials;
+  }
+
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::writeGraph(const string& out_graph_file) {
     FILE *graph_file = NULL;
     if ((graph_file = fopen(out_graph_file.c_str(), "w")) == NULL) {
       LOG(ERROR) << "Could no open graph file for writing: " << out_graph_file;
+      return;
+    }
+    writeGraph(graph_file);
+    fclose(graph_file);
+  }
+
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::writeGraph(FILE* graph_file) {
+    if (!solution_quality.optimal) {
+      if (solution_quality.unrouted_supply > 0) {
+        fprintf(graph_file, "c unrouted_supply %jd\n",
+                solution_quality.unrouted_supply);
+        fprintf(graph_file, "c cost_lower_bound %jd\n",
+                solution_quality.cost_lower_bound);
+      } else if (solution_quality.cost_gap >= 0) {
+        fprintf(graph_file, "c optimality_gap %jd\n",
+                solution_quality.cost_gap);
+      } else {
+        fprintf(graph_file, "c optimality_gap unknown\n");
+      }
     }
     for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
-      map<uint32_t, Arc*>::iterator it = arcs[node_id].begin();
-      map<uint32_t, Arc*>::iterator end_it = arcs[node_id].end();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+        arcs[node_id].end();
       for (; it != end_it; ++it) {
-        if (it->second->cap < it->second->initial_cap) {
-          int32_t flow = it->second->initial_cap - it->second->cap;
-          fprintf(graph_file, "f %u %u %d\n",
-                  node_id, it->first, flow);
-          min_cost += flow * it->second->cost;
+        Arc<CapT, CostT>* arc = it->second;
+        ArcSegments<CapT, CostT>* segments = arc->get_segments();
+        if (segments != NULL) {
+          // Every segment gets its own line, like the parallel arcs it
+          // was read from.
+          for (uint32_t index = 0; arc == segments->forward_arc &&
+                 index < segments->capacities.size(); ++index) {
+            int64_t flow = arc->get_segment_flow(index);
+            if (flow > 0) {
+              fprintf(graph_file, "f %u %u %jd\n",
+                      get_original_node_id(node_id),
+                      get_original_node_id(it->first), flow);
+            }
+          }
+        } else if (arc->cap < arc->initial_cap) {
+          int64_t flow = arc->initial_cap - arc->cap;
+          fprintf(graph_file, "f %u %u %jd\n",
+                  get_original_node_id(node_id),
+                  get_original_node_id(it->first), flow);
         }
       }
     }
-    fprintf(graph_file, "s %jd\n", min_cost / scale_down);
-    fclose(graph_file);
+    fprintf(graph_file, "s %jd\n", getFlowCost());
+  }
+
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::readFlow(FILE* flow_file) {
+    resetFlow();
+    LineReader reader(flow_file);
+    const char* line;
+    uint32_t line_num = 0;
+    uint32_t num_cut = 0;
+    uint32_t num_dropped = 0;
+    vector<string> vals;
+    // lexical_cast throws on a malformed number.
+    try {
+      while ((line = reader.next()) != NULL) {
+        line_num++;
+        boost::split(vals, line, is_any_of(" "), token_compress_on);
+        if (vals[0].compare("f") != 0) {
+          continue;
+        }
+        if (!hasDimacsValues(vals)) {
+          LOG(ERROR) << "Missing values on line: " << line_num;
+          return false;
+        }
+        uint32_t src_node = lexical_cast<uint32_t>(vals[1]);
+        uint32_t dst_node = lexical_cast<uint32_t>(vals[2]);
+        int64_t flow = lexical_cast<int64_t>(vals[3]);
+        if (src_node == 0 || src_node > num_nodes || dst_node == 0 ||
+            dst_node > num_nodes || flow < 0) {
+          LOG(ERROR) << "Invalid flow on line: " << line_num;
+          return false;
+        }
+        typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+          arcs[src_node].find(dst_node);
+        // Reverse arcs have no capacity of their own.
+        int64_t capacity = 0;
+        if (it != arcs[src_node].end() && !it->second->has_segments) {
+          capacity = it->second->initial_cap;
+        } else if (it != arcs[src_node].end() &&
+                   it->second == it->second->get_segments()->forward_arc) {
+          const vector<CapT>& capacities =
+            it->second->get_segments()->capacities;
+          for (typename vector<CapT>::const_iterator cap_it =
+                 capacities.begin(); cap_it != capacities.end(); ++cap_it) {
+            capacity += *cap_it;
+          }
+        }
+        if (capacity == 0) {
+          num_dropped++;
+          continue;
+        }
+        // Every segment of a convex arc has its own line.
+        int64_t arc_flow = it->second->get_flow() + flow;
+        if (arc_flow > capacity) {
+          num_cut++;
+          arc_flow = capacity;
+        }
+        it->second->set_flow(arc_flow);
+      }
+    } catch (const boost::bad_lexical_cast&) {
+      LOG(ERROR) << "Invalid number on line: " << line_num;
+      return false;
+    }
+    if (ferror(flow_file)) {
+      LOG(ERROR) << "Failed to read the flow after line: " << line_num;
+      return false;
+    }
+    if (num_cut > 0 || num_dropped > 0) {
+      LOG(WARNING) << "Cut the flow of " << num_cut << " arcs down to their "
+                   << "capacity and dropped the flow of " << num_dropped
+                   << " missing arcs";
+    }
+    return true;
   }
 
-  void Graph::logGraph() {
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::writePotentials(FILE* potentials_file) {
+    for (uint32_t node_id = 1;
+         node_id <= num_nodes && node_id < potentials.size(); ++node_id) {
+      fprintf(potentials_file, "d %u %jd\n", get_original_node_id(node_id),
+              static_cast<intmax_t>(potentials[node_id]));
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::readPotentials(FILE* potentials_file) {
+    potentials.assign(num_nodes + 1, 0);
+    LineReader reader(potentials_file);
+    const char* line;
+    uint32_t line_num = 0;
+    vector<string> vals;
+    // lexical_cast throws on a malformed number.
+    try {
+      while ((line = reader.next()) != NULL) {
+        line_num++;
+        boost::split(vals, line, is_any_of(" "), token_compress_on);
+        if (vals[0].compare("d") != 0) {
+          continue;
+        }
+        if (!hasDimacsValues(vals)) {
+          LOG(ERROR) << "Missing values on line: " << line_num;
+          potentials.clear();
+          return false;
+        }
+        uint32_t node_id = lexical_cast<uint32_t>(vals[1]);
+        if (node_id == 0 || node_id > num_nodes) {
+          LOG(ERROR) << "Unknown node on line: " << line_num;
+          potentials.clear();
+          return false;
+        }
+        potentials[node_id] = lexical_cast<int64_t>(vals[2]);
+      }
+    } catch (const boost::bad_lexical_cast&) {
+      LOG(ERROR) << "Invalid number on line: " << line_num;
+      potentials.clear();
+      return false;
+    }
+    if (ferror(potentials_file)) {
+      LOG(ERROR) << "Failed to read the potentials after line: " << line_num;
+      potentials.clear();
+      return false;
+    }
+    return true;
+  }
+
+  template<typename CapT, typename CostT>
+  int64_t Graph<CapT, CostT>::getFlowCost() {
+    int64_t flow_cost = 0;
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        flow_cost += it->second->getFlowCost();
+      }
+    }
+    return flow_cost;
+  }
+
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::logGraph() {
     int64_t min_cost = 0;
     LOG(INFO) << "src dst flow cap cost";
     for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
-      map<uint32_t, Arc*>::iterator it = arcs[node_id].begin();
-      map<uint32_t, Arc*>::iterator end_it = arcs[node_id].end();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+        arcs[node_id].end();
       for (; it != end_it; ++it) {
-        int32_t flow = it->second->initial_cap - it->second->cap;
-        LOG(INFO) << "f " << node_id << " " << it->first << " "
+        int64_t flow = it->second->get_flow();
+        LOG(INFO) << "f " << get_original_node_id(node_id) << " "
+                  << get_original_node_id(it->first) << " "
                   << flow << " " << it->second->initial_cap << " "
                   << it->second->cost;
-        if (flow > 0) {
-          min_cost += flow * it->second->cost;
-        }
+        min_cost += it->second->getFlowCost();
       }
     }
     LOG(INFO) << "s " << min_cost;
   }
 
-  uint32_t Graph::get_num_nodes() {
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::traceArcs() {
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        traceRecord(TRACE_GRAPH_ARC, node_id, it->first,
+                    it->second->get_flow());
+      }
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  uint32_t Graph<CapT, CostT>::get_num_nodes() {
     return num_nodes;
   }
 
-  uint32_t Graph::get_num_arcs() {
+  template<typename CapT, typename CostT>
+  uint32_t Graph<CapT, CostT>::get_num_arcs() {
     return num_arcs;
   }
 
-  vector<map<uint32_t, Arc*> >& Graph::get_arcs() {
+  template<typename CapT, typename CostT>
+  vector<map<uint32_t, Arc<CapT, CostT>*> >& Graph<CapT, CostT>::get_arcs() {
     return arcs;
   }
 
-  list<Arc*>& Graph::get_fixed_arcs() {
+  template<typename CapT, typename CostT>
+  list<Arc<CapT, CostT>*>& Graph<CapT, CostT>::get_fixed_arcs() {
     return fixed_arcs;
   }
 
-  vector<uint32_t>& Graph::get_source_nodes() {
+  template<typename CapT, typename CostT>
+  vector<uint32_t>& Graph<CapT, CostT>::get_source_nodes() {
     if (added_sink_and_source) {
       return single_source_node;
     } else {
@@ -129,7 +705,8 @@ namespace flowlessly {
     }
   }
 
-  vector<uint32_t>& Graph::get_sink_nodes() {
+  template<typename CapT, typename CostT>
+  vector<uint32_t>& Graph<CapT, CostT>::get_sink_nodes() {
     if (added_sink_and_source) {
       return single_sink_node;
     } else {
@@ -137,15 +714,38 @@ namespace flowlessly {
     }
   }
 
-  vector<int32_t>& Graph::get_nodes_demand() {
+  template<typename CapT, typename CostT>
+  vector<CapT>& Graph<CapT, CostT>::get_nodes_demand() {
     return nodes_demand;
   }
 
-  bool Graph::hasSinkAndSource() {
+  template<typename CapT, typename CostT>
+  SolutionQuality& Graph<CapT, CostT>::get_solution_quality() {
+    return solution_quality;
+  }
+
+  template<typename CapT, typename CostT>
+  vector<int64_t>& Graph<CapT, CostT>::get_potentials() {
+    return potentials;
+  }
+
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::get_export_potentials() {
+    return export_potentials;
+  }
+
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::set_export_potentials(bool export_potentials) {
+    this->export_potentials = export_potentials;
+  }
+
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::hasSinkAndSource() {
     return added_sink_and_source;
   }
 
-  void Graph::addSinkAndSource() {
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::addSinkAndSource() {
     added_sink_and_source = true;
     num_nodes += 2;
     arcs.resize(num_nodes + 1);
@@ -154,8 +754,10 @@ namespace flowlessly {
     single_sink_node.push_back(num_nodes);
     for (vector<uint32_t>::iterator it = source_nodes.begin();
          it != source_nodes.end(); ++it) {
-      Arc* arc = new Arc(num_nodes - 1, *it, nodes_demand[*it], 0, NULL);
-      Arc* reverse_arc = new Arc(*it, num_nodes - 1, 0, 0, arc);
+      Arc<CapT, CostT>* arc =
+        new Arc<CapT, CostT>(num_nodes - 1, *it, nodes_demand[*it], 0, NULL);
+      Arc<CapT, CostT>* reverse_arc =
+        new Arc<CapT, CostT>(*it, num_nodes - 1, 0, 0, arc);
       arc->set_reverse_arc(reverse_arc);
       arcs[num_nodes - 1][*it] = arc;
       arcs[*it][num_nodes - 1] = reverse_arc;
@@ -164,8 +766,9 @@ namespace flowlessly {
     }
     for (vector<uint32_t>::iterator it = sink_nodes.begin();
          it != sink_nodes.end(); ++it) {
-      Arc* arc = new Arc(num_nodes, *it, 0, 0, NULL);
-      Arc* reverse_arc = new Arc(*it, num_nodes, -nodes_demand[*it], 0, arc);
+      Arc<CapT, CostT>* arc = new Arc<CapT, CostT>(num_nodes, *it, 0, 0, NULL);
+      Arc<CapT, CostT>* reverse_arc =
+        new Arc<CapT, CostT>(*it, num_nodes, -nodes_demand[*it], 0, arc);
       arc->set_reverse_arc(reverse_arc);
       arcs[num_nodes][*it] = arc;
       arcs[*it][num_nodes] = reverse_arc;
@@ -174,9 +777,12 @@ namespace flowlessly {
     }
   }
 
-  void Graph::removeSinkAndSource() {
-    map<uint32_t, Arc*>::iterator it = arcs[num_nodes - 1].begin();
-    map<uint32_t, Arc*>::iterator end_it = arcs[num_nodes - 1].end();
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::removeSinkAndSource() {
+    typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+      arcs[num_nodes - 1].begin();
+    typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+      arcs[num_nodes - 1].end();
     for (; it != end_it; ++it) {
       nodes_demand[it->first] += it->second->initial_cap - it->second->cap;
     }
@@ -186,10 +792,16 @@ namespace flowlessly {
     }
     for (vector<uint32_t>::iterator it = sink_nodes.begin();
          it != sink_nodes.end(); ++it) {
-      Arc* arc = arcs[*it][num_nodes];
+      Arc<CapT, CostT>* arc = arcs[*it][num_nodes];
       nodes_demand[*it] = -arc->cap;
       arcs[*it].erase(num_nodes);
     }
+    for (uint32_t node_id = num_nodes - 1; node_id <= num_nodes; ++node_id) {
+      for (it = arcs[node_id].begin(); it != arcs[node_id].end(); ++it) {
+        delete it->second->reverse_arc;
+        delete it->second;
+      }
+    }
     added_sink_and_source = false;
     num_nodes -= 2;
     arcs.pop_back();
@@ -201,8 +813,10 @@ namespace flowlessly {
   }
 
   // Construct a topological order of the graph.
-  bool Graph::orderTopologically(vector<int64_t>& potentials,
-                                 vector<uint32_t>& ordered) {
+  template<typename CapT, typename CostT>
+  bool Graph<CapT, CostT>::orderTopologically(vector<int64_t>& potentials,
+                                              int64_t cost_scale,
+                                              vector<uint32_t>& ordered) {
     vector<uint32_t>& source_nodes = get_source_nodes();
     stack<uint32_t> to_visit;
     // 0 - node not visited.
@@ -223,11 +837,13 @@ namespace flowlessly {
       } else {
         marked[node_id] = 1;
         ordered.push_back(node_id);
-        map<uint32_t, Arc*>::const_iterator it = arcs[node_id].begin();
-        map<uint32_t, Arc*>::const_iterator end_it = arcs[node_id].end();
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+          arcs[node_id].begin();
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+          arcs[node_id].end();
         for (; it != end_it; ++it) {
           if (it->second->cap > 0 && marked[it->first] == 0 &&
-              it->second->cost + potentials[node_id] -
+              it->second->cost * cost_scale + potentials[node_id] -
               potentials[it->first] < 0) {
             to_visit.push(it->first);
           }
@@ -238,4 +854,167 @@ namespace flowlessly {
     return true;
   }
 
+  template<typename CapT, typename CostT>
+  uint32_t Graph<CapT, CostT>::get_original_node_id(uint32_t node_id) {
+    // The nodes added by addSinkAndSource are not renumbered.
+    if (node_id < original_node_id.size()) {
+      return original_node_id[node_id];
+    }
+    return node_id;
+  }
+
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::renumberNodes(bool reverse_cuthill_mckee) {
+    CHECK(!added_sink_and_source)
+      << "Nodes must be renumbered before adding the sink and the source";
+    vector<uint32_t> order;
+    if (reverse_cuthill_mckee) {
+      orderNodesRCM(order);
+    } else {
+      orderNodesBFS(order);
+    }
+    permuteNodes(order);
+  }
+
+  // Orders the nodes in BFS order starting from the source nodes. The arcs
+  // are traversed in both directions. Nodes that are not reachable are
+  // ordered by BFS runs started from the lowest unvisited id.
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::orderNodesBFS(vector<uint32_t>& order) {
+    vector<bool> visited(num_nodes + 1, false);
+    queue<uint32_t> to_visit;
+    for (vector<uint32_t>::iterator it = source_nodes.begin();
+         it != source_nodes.end(); ++it) {
+      visited[*it] = true;
+      to_visit.push(*it);
+    }
+    uint32_t next_root = 1;
+    while (order.size() < num_nodes) {
+      if (to_visit.empty()) {
+        for (; visited[next_root]; ++next_root) {
+        }
+        visited[next_root] = true;
+        to_visit.push(next_root);
+      }
+      uint32_t node_id = to_visit.front();
+      to_visit.pop();
+      order.push_back(node_id);
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        if (!visited[it->first]) {
+          visited[it->first] = true;
+          to_visit.push(it->first);
+        }
+      }
+    }
+  }
+
+  // Orders the nodes in reverse Cuthill-McKee order. Every component is
+  // started from its node with the lowest degree and the neighbours of a
+  // node are visited in increasing degree order.
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::orderNodesRCM(vector<uint32_t>& order) {
+    vector<bool> visited(num_nodes + 1, false);
+    vector<pair<size_t, uint32_t> > nodes_by_degree;
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      nodes_by_degree.push_back(make_pair(arcs[node_id].size(), node_id));
+    }
+    sort(nodes_by_degree.begin(), nodes_by_degree.end());
+    vector<pair<size_t, uint32_t> > neighbours;
+    for (vector<pair<size_t, uint32_t> >::iterator root_it =
+           nodes_by_degree.begin();
+         root_it != nodes_by_degree.end(); ++root_it) {
+      if (visited[root_it->second]) {
+        continue;
+      }
+      visited[root_it->second] = true;
+      // The order vector is used as the BFS queue.
+      size_t head = order.size();
+      order.push_back(root_it->second);
+      for (; head < order.size(); ++head) {
+        uint32_t node_id = order[head];
+        neighbours.clear();
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+          arcs[node_id].begin();
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+          arcs[node_id].end();
+        for (; it != end_it; ++it) {
+          if (!visited[it->first]) {
+            visited[it->first] = true;
+            neighbours.push_back(make_pair(arcs[it->first].size(),
+                                           it->first));
+          }
+        }
+        sort(neighbours.begin(), neighbours.end());
+        for (vector<pair<size_t, uint32_t> >::iterator it = neighbours.begin();
+             it != neighbours.end(); ++it) {
+          order.push_back(it->second);
+        }
+      }
+    }
+    reverse(order.begin(), order.end());
+  }
+
+  // order[i] is the old id of the node that gets id i + 1.
+  template<typename CapT, typename CostT>
+  void Graph<CapT, CostT>::permuteNodes(const vector<uint32_t>& order) {
+    vector<uint32_t> new_node_id(num_nodes + 1, 0);
+    vector<uint32_t> old_original_node_id(num_nodes + 1, 0);
+    for (uint32_t node_id = 0; node_id <= num_nodes; ++node_id) {
+      old_original_node_id[node_id] = get_original_node_id(node_id);
+    }
+    original_node_id.resize(num_nodes + 1);
+    for (uint32_t index = 0; index < order.size(); ++index) {
+      new_node_id[order[index]] = index + 1;
+      original_node_id[index + 1] = old_original_node_id[order[index]];
+    }
+    vector<map<uint32_t, Arc<CapT, CostT>*> > new_arcs(num_nodes + 1);
+    vector<CapT> new_nodes_demand(num_nodes + 1, 0);
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      uint32_t new_id = new_node_id[node_id];
+      new_nodes_demand[new_id] = nodes_demand[node_id];
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        it->second->src_node_id = new_id;
+        it->second->dst_node_id = new_node_id[it->first];
+        new_arcs[new_id][new_node_id[it->first]] = it->second;
+      }
+    }
+    for (typename list<Arc<CapT, CostT>*>::iterator it = fixed_arcs.begin();
+         it != fixed_arcs.end(); ++it) {
+      (*it)->src_node_id = new_node_id[(*it)->src_node_id];
+      (*it)->dst_node_id = new_node_id[(*it)->dst_node_id];
+    }
+    for (vector<uint32_t>::iterator it = source_nodes.begin();
+         it != source_nodes.end(); ++it) {
+      *it = new_node_id[*it];
+    }
+    for (vector<uint32_t>::iterator it = sink_nodes.begin();
+         it != sink_nodes.end(); ++it) {
+      *it = new_node_id[*it];
+    }
+    sort(source_nodes.begin(), source_nodes.end());
+    sort(sink_nodes.begin(), sink_nodes.end());
+    arcs.swap(new_arcs);
+    nodes_demand.swap(new_nodes_demand);
+    if (!potentials.empty()) {
+      vector<int64_t> new_potentials(num_nodes + 1, 0);
+      for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+        new_potentials[new_node_id[node_id]] = potentials[node_id];
+      }
+      potentials.swap(new_potentials);
+    }
+  }
+
+  template class Graph<int32_t, int32_t>;
+  template class Graph<int32_t, int64_t>;
+  template class Graph<int64_t, int32_t>;
+  template class Graph<int64_t, int64_t>;
+
 }
@@ -3,8 +3,10 @@
 
 #include <list>
 #include <map>
+#include <stdio.h>
 #include <string>
 #include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 #include "arc.h"
@@ -13,54 +15,166 @@ namespace flowlessly {
 
   using namespace std;
 
+  // Value ranges seen in a DIMACS file. They are used to pick the narrowest
+  // capacity and cost types that can hold the graph.
+  struct GraphValueRanges {
+    uint32_t num_nodes;
+    uint32_t num_arcs;
+    // Parallel arcs become one arc, so their capacities are summed.
+    int64_t max_capacity;
+    int64_t max_abs_cost;
+    int64_t max_abs_demand;
+    int64_t total_supply;
+  };
+
+  // Describes how far the flow held by a graph may be from an optimal one.
+  // Solvers that run out of budget fill it in.
+  struct SolutionQuality {
+    SolutionQuality(): optimal(true), cost_gap(0), unrouted_supply(0),
+      cost_lower_bound(0) {
+    }
+
+    bool optimal;
+    // Upper bound on the cost of the flow minus the optimal cost. It is -1
+    // if the solver can't bound it.
+    int64_t cost_gap;
+    // Supply the flow doesn't route. If it is positive the flow is not
+    // feasible and cost_lower_bound bounds the optimal cost from below.
+    int64_t unrouted_supply;
+    int64_t cost_lower_bound;
+  };
+
+  // Scans the graph file without building the graph.
+  bool scanGraphValueRanges(const string& graph_file,
+                            GraphValueRanges* ranges);
+
+  template<typename CapT, typename CostT>
   class Graph {
 
   public:
     Graph() {
       added_sink_and_source = false;
+      export_potentials = false;
     }
 
-    Graph(Graph& copy) {
-      num_nodes = copy.num_nodes;
-      num_arcs = copy.num_arcs;
-      nodes_demand = copy.nodes_demand;
-      arcs = copy.arcs;
-      source_nodes = copy.source_nodes;
-      sink_nodes = copy.sink_nodes;
-      added_sink_and_source = copy.added_sink_and_source;
-    }
+    // Deep copy. The copy owns clones of all the arcs, including the fixed
+    // ones. Use GraphSnapshot to undo a solve without copying the graph.
+    Graph(const Graph& copy);
+    Graph(Graph&& other) = default;
+    Graph& operator=(const Graph& copy) = delete;
+    // Deletes all the arcs the graph links to.
+    ~Graph();
 
-    void readGraph(const string& graph_file);
+    // Resets the graph to num_nodes nodes without arcs or demand. The arcs
+    // the graph had are deleted.
+    void initNodes(uint32_t num_nodes, uint32_t num_arcs);
+    // Parallel arcs in the file become the segments of one arc with a
+    // convex piecewise linear cost. A compressed file is decompressed
+    // while it is parsed, see openGraphFile.
+    bool readGraph(const string& graph_file);
+    bool readGraph(FILE* graph_file);
+    // Applies DIMACS "a", "n" and "r src dst" lines to the graph. An "a"
+    // line for an existing arc replaces its capacity and cost, including
+    // all its segments, and drops its flow.
+    bool updateGraph(FILE* delta_file);
     void logGraph();
-    void writeGraph(const string& out_graph_file, int64_t scale_down);
+    // Records the flow of every arc in the trace buffer.
+    void traceArcs();
+    void writeGraph(const string& out_graph_file);
+    // Solutions that are not known to be optimal are preceded by comment
+    // lines describing their quality.
+    void writeGraph(FILE* graph_file);
+    // Returns the cost of the flow currently held by the arcs.
+    int64_t getFlowCost();
+    // Loads the "f src dst flow" lines writeGraph wrote for an earlier
+    // version of the graph. Flow above the capacity of an arc is cut down
+    // to it and flow on arcs that no longer exist is dropped, so the flow
+    // respects the capacities but may not meet the demands. Lines other
+    // than "f" lines are skipped. Must be called before the nodes are
+    // renumbered. Returns false on unknown nodes or negative flows.
+    bool readFlow(FILE* flow_file);
+    // "d node_id potential" lines with the original node ids.
+    void writePotentials(FILE* potentials_file);
+    // Nodes without a line get potential 0. Must be called before the
+    // nodes are renumbered. Returns false on unknown nodes.
+    bool readPotentials(FILE* potentials_file);
+    // Returns true if a new arc was added.
+    bool setArc(uint32_t src_node_id, uint32_t dst_node_id, CapT capacity,
+                CostT cost);
+    // Adds an arc or, if the nodes are already connected, a segment to
+    // their arc. Returns false if the capacity of the arc overflows.
+    bool addArcSegment(uint32_t src_node_id, uint32_t dst_node_id,
+                       CapT capacity, CostT cost);
+    bool removeArc(uint32_t src_node_id, uint32_t dst_node_id);
+    void setNodeDemand(uint32_t node_id, CapT demand);
+    // Sets the residual capacity of every arc back to its initial capacity.
+    void resetFlow();
+    // Takes the flow, the solution quality and the potentials of a solved
+    // copy of the graph. The copy must have the same arcs.
+    void copyFlow(Graph& solved);
     uint32_t get_num_nodes();
     uint32_t get_num_arcs();
-    vector<int32_t>& get_nodes_demand();
-    vector<map<uint32_t, Arc*> >& get_arcs();
-    list<Arc*>& get_fixed_arcs();
+    vector<CapT>& get_nodes_demand();
+    SolutionQuality& get_solution_quality();
+    // Node potentials that certify the flow: cost + potential[src] -
+    // potential[dst] is non-negative on every arc with residual capacity.
+    // The min cost flow solvers set them when they reach an optimal flow and
+    // the potentials are exported, and clear them otherwise.
+    vector<int64_t>& get_potentials();
+    // Certifying a flow can take O(nm), so the solvers only export the
+    // potentials if they are asked to. They aren't by default.
+    bool get_export_potentials();
+    void set_export_potentials(bool export_potentials);
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& get_arcs();
+    list<Arc<CapT, CostT>*>& get_fixed_arcs();
     vector<uint32_t>& get_source_nodes();
     vector<uint32_t>& get_sink_nodes();
     bool hasSinkAndSource();
     void removeSinkAndSource();
     void addSinkAndSource();
-    bool orderTopologically(vector<int64_t>& potentials,
+    // Only follows the arcs with a negative reduced cost. The costs are
+    // multiplied by cost_scale, the factor the potentials are scaled by.
+    bool orderTopologically(vector<int64_t>& potentials, int64_t cost_scale,
                             vector<uint32_t>& ordered);
+    // Renumbers the nodes so that neighbours get close ids. The order is
+    // either a BFS from the source nodes or a reverse Cuthill-McKee order.
+    // It must be called before the solver runs. writeGraph maps the nodes
+    // back to their original ids. The flow and the potentials move with
+    // the nodes.
+    void renumberNodes(bool reverse_cuthill_mckee);
+    uint32_t get_original_node_id(uint32_t node_id);
 
   private:
     void allocateGraphMemory(uint32_t num_nodes, uint32_t num_arcs);
+    void deleteArcs();
+    // Frees the segments shared by an arc and its reverse arc.
+    void deleteSegments(Arc<CapT, CostT>* arc);
+    bool parseGraph(FILE* graph_file, bool is_delta);
+    Arc<CapT, CostT>* cloneArc(
+        Arc<CapT, CostT>* arc,
+        unordered_map<Arc<CapT, CostT>*, Arc<CapT, CostT>*>& clones);
+    void orderNodesBFS(vector<uint32_t>& order);
+    void orderNodesRCM(vector<uint32_t>& order);
+    void permuteNodes(const vector<uint32_t>& order);
 
     uint32_t num_nodes;
     uint32_t num_arcs;
     // nodes_demand has a positive value if the node is a supply node and a
     // negative value if the node is a demand one.
-    vector<int32_t> nodes_demand;
-    vector<map<uint32_t, Arc*> > arcs;
-    list<Arc*> fixed_arcs;
+    vector<CapT> nodes_demand;
+    vector<map<uint32_t, Arc<CapT, CostT>*> > arcs;
+    list<Arc<CapT, CostT>*> fixed_arcs;
     vector<uint32_t> source_nodes;
     vector<uint32_t> sink_nodes;
     vector<uint32_t> single_source_node;
     vector<uint32_t> single_sink_node;
     bool added_sink_and_source;
+    // Maps the renumbered node ids to the ids from the input file. It is
+    // empty if the nodes have not been renumbered.
+    vector<uint32_t> original_node_id;
+    SolutionQuality solution_quality;
+    vector<int64_t> potentials;
+    bool export_potentials;
 
   };
 
@@ -0,0 +1,284 @@
+#include "graph_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Collects the nodes and the arcs of a generated graph. There is at most
+  // one arc between two nodes, in either direction, because the graph
+  // stores an arc and its reverse in the same slots.
+  class GeneratedGraph {
+
+  public:
+    explicit GeneratedGraph(uint64_t seed): rng(seed) {
+      // Node ids start at 1.
+      nodes_demand.push_back(0);
+    }
+
+    uint32_t addNode(int64_t demand) {
+      nodes_demand.push_back(demand);
+      return nodes_demand.size() - 1;
+    }
+
+    void addDemand(uint32_t node_id, int64_t demand) {
+      nodes_demand[node_id] += demand;
+    }
+
+    uint32_t get_num_nodes() {
+      return nodes_demand.size() - 1;
+    }
+
+    // Returns false if the nodes are already connected.
+    bool addArc(uint32_t src_node_id, uint32_t dst_node_id, int64_t capacity,
+                int64_t cost) {
+      pair<uint32_t, uint32_t> nodes(min(src_node_id, dst_node_id),
+                                     max(src_node_id, dst_node_id));
+      if (src_node_id == dst_node_id || !linked_nodes.insert(nodes).second) {
+        return false;
+      }
+      GeneratedArc arc = {src_node_id, dst_node_id, capacity, cost};
+      arcs.push_back(arc);
+      return true;
+    }
+
+    // Uniform in [min_value, max_value]. The standard distributions are
+    // not the same on every platform, so they are not used.
+    int64_t uniform(int64_t min_value, int64_t max_value) {
+      uint64_t range = max_value - min_value + 1;
+      return min_value + rng() % range;
+    }
+
+    void shuffle(vector<uint32_t>& values) {
+      for (uint32_t index = values.size(); index > 1; --index) {
+        swap(values[index - 1], values[uniform(0, index - 1)]);
+      }
+    }
+
+    void write(FILE* graph_file) {
+      fprintf(graph_file, "p min %u %zu\n", get_num_nodes(), arcs.size());
+      for (uint32_t node_id = 1; node_id < nodes_demand.size(); ++node_id) {
+        if (nodes_demand[node_id] != 0) {
+          fprintf(graph_file, "n %u %jd\n", node_id,
+                  static_cast<intmax_t>(nodes_demand[node_id]));
+        }
+      }
+      for (vector<GeneratedArc>::iterator it = arcs.begin(); it != arcs.end();
+           ++it) {
+        fprintf(graph_file, "a %u %u 0 %jd %jd\n", it->src_node_id,
+                it->dst_node_id, static_cast<intmax_t>(it->capacity),
+                static_cast<intmax_t>(it->cost));
+      }
+    }
+
+  private:
+    struct GeneratedArc {
+      uint32_t src_node_id;
+      uint32_t dst_node_id;
+      int64_t capacity;
+      int64_t cost;
+    };
+
+    mt19937_64 rng;
+    vector<int64_t> nodes_demand;
+    vector<GeneratedArc> arcs;
+    set<pair<uint32_t, uint32_t> > linked_nodes;
+
+  };
+
+  // Splits total into num_parts positive parts that differ by at most one.
+  int64_t getPart(int64_t total, uint32_t num_parts, uint32_t part) {
+    return total / num_parts + (part < total % num_parts ? 1 : 0);
+  }
+
+  void generateNetgenGraph(const NetgenParams& params, FILE* graph_file) {
+    GeneratedGraph graph(params.seed);
+    uint32_t num_nodes = max(params.num_nodes,
+                             params.num_sources + params.num_sinks);
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      graph.addNode(0);
+    }
+    vector<uint32_t> order;
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      order.push_back(node_id);
+    }
+    graph.shuffle(order);
+    // The first nodes of the random order supply, the last ones demand.
+    for (uint32_t index = 0; index < params.num_sources; ++index) {
+      graph.addDemand(order[index], getPart(params.total_supply,
+                                            params.num_sources, index));
+    }
+    for (uint32_t index = 0; index < params.num_sinks; ++index) {
+      graph.addDemand(order[num_nodes - 1 - index],
+                      -getPart(params.total_supply, params.num_sinks, index));
+    }
+    graph.shuffle(order);
+    for (uint32_t index = 0; index < num_nodes; ++index) {
+      graph.addArc(order[index], order[(index + 1) % num_nodes],
+                   params.total_supply, params.max_cost * 2);
+    }
+    // Gives up on arcs once the graph gets too dense to place them.
+    uint64_t num_attempts = 0;
+    for (uint32_t num_arcs = num_nodes;
+         num_arcs < params.num_arcs && num_attempts < 10 * params.num_arcs;
+         ++num_attempts) {
+      if (graph.addArc(graph.uniform(1, num_nodes),
+                       graph.uniform(1, num_nodes),
+                       graph.uniform(1, params.max_capacity),
+                       graph.uniform(0, params.max_cost))) {
+        num_arcs++;
+      }
+    }
+    graph.write(graph_file);
+  }
+
+  void generateGridGraph(const GridParams& params, FILE* graph_file) {
+    GeneratedGraph graph(params.seed);
+    uint32_t num_rows = params.num_rows;
+    uint32_t num_cols = params.num_cols;
+    for (uint32_t node_id = 1; node_id <= num_rows * num_cols; ++node_id) {
+      graph.addNode(0);
+    }
+    int64_t supply = num_rows * params.max_capacity / 2;
+    uint32_t source_node = graph.addNode(supply);
+    uint32_t sink_node = graph.addNode(-supply);
+    for (uint32_t row = 0; row < num_rows; ++row) {
+      uint32_t row_start = 1 + row * num_cols;
+      graph.addArc(source_node, row_start, params.max_capacity, 0);
+      graph.addArc(row_start + num_cols - 1, sink_node, params.max_capacity,
+                   0);
+      for (uint32_t col = 0; col < num_cols; ++col) {
+        uint32_t node_id = row_start + col;
+        if (col + 1 < num_cols) {
+          graph.addArc(node_id, node_id + 1,
+                       graph.uniform(1, params.max_capacity),
+                       graph.uniform(0, params.max_cost));
+        }
+        // The vertical arcs point down in even columns and up in odd ones.
+        if (row + 1 < num_rows) {
+          uint32_t below_node_id = node_id + num_cols;
+          graph.addArc(col % 2 == 0 ? node_id : below_node_id,
+                       col % 2 == 0 ? below_node_id : node_id,
+                       graph.uniform(1, params.max_capacity),
+                       graph.uniform(0, params.max_cost));
+        }
+      }
+    }
+    graph.addArc(source_node, sink_node, supply,
+                 params.max_cost * (num_rows + num_cols) + 1);
+    graph.write(graph_file);
+  }
+
+  void generateSchedulingGraph(const SchedulingParams& params,
+                               FILE* graph_file) {
+    GeneratedGraph graph(params.seed);
+    uint32_t sink_node = graph.addNode(0);
+    uint32_t cluster_node = graph.addNode(0);
+    uint32_t num_racks = (params.num_machines + params.machines_per_rack - 1) /
+      params.machines_per_rack;
+    vector<uint32_t> rack_nodes;
+    vector<uint32_t> machine_nodes;
+    for (uint32_t rack = 0; rack < num_racks; ++rack) {
+      uint32_t rack_node = graph.addNode(0);
+      rack_nodes.push_back(rack_node);
+      uint32_t rack_slots = 0;
+      for (uint32_t machine = rack * params.machines_per_rack;
+           machine < min(params.num_machines,
+                         (rack + 1) * params.machines_per_rack); ++machine) {
+        uint32_t machine_node = graph.addNode(0);
+        machine_nodes.push_back(machine_node);
+        graph.addArc(rack_node, machine_node, params.slots_per_machine, 0);
+        graph.addArc(machine_node, sink_node, params.slots_per_machine, 0);
+        rack_slots += params.slots_per_machine;
+      }
+      graph.addArc(cluster_node, rack_node, rack_slots, 0);
+    }
+    vector<uint32_t> ec_nodes;
+    for (uint32_t ec = 0; ec < params.num_equivalence_classes; ++ec) {
+      uint32_t ec_node = graph.addNode(0);
+      ec_nodes.push_back(ec_node);
+      for (uint32_t preference = 0; preference < params.preferences_per_task;
+           ++preference) {
+        graph.addArc(ec_node,
+                     machine_nodes[graph.uniform(0, params.num_machines - 1)],
+                     params.slots_per_machine, graph.uniform(0, 10));
+      }
+    }
+    int64_t num_tasks = 0;
+    for (uint32_t job = 0; job < params.num_jobs; ++job) {
+      uint32_t num_job_tasks = graph.uniform(1, params.max_tasks_per_job);
+      uint32_t unscheduled_node = graph.addNode(0);
+      graph.addArc(unscheduled_node, sink_node, num_job_tasks, 0);
+      uint32_t ec_node = ec_nodes[job % ec_nodes.size()];
+      // Tasks that have waited longer are more expensive to leave out.
+      int64_t unscheduled_cost = graph.uniform(100, 200);
+      for (uint32_t task = 0; task < num_job_tasks; ++task) {
+        uint32_t task_node = graph.addNode(1);
+        graph.addArc(task_node, unscheduled_node, 1, unscheduled_cost);
+        graph.addArc(task_node, cluster_node, 1, graph.uniform(40, 60));
+        graph.addArc(task_node, ec_node, 1, graph.uniform(10, 30));
+        for (uint32_t preference = 0;
+             preference < params.preferences_per_task; ++preference) {
+          graph.addArc(task_node,
+                       machine_nodes[graph.uniform(0,
+                                                   params.num_machines - 1)],
+                       1, graph.uniform(0, 15));
+        }
+        graph.addArc(task_node, rack_nodes[graph.uniform(0, num_racks - 1)],
+                     1, graph.uniform(20, 35));
+      }
+      num_tasks += num_job_tasks;
+    }
+    graph.addDemand(sink_node, -num_tasks);
+    graph.write(graph_file);
+  }
+
+  bool generateGraph(const string& generator, uint32_t size, uint64_t seed,
+                     FILE* graph_file) {
+    size = max(size, 4U);
+    if (!generator.compare("netgen")) {
+      NetgenParams params;
+      params.num_nodes = size;
+      params.num_arcs = 8 * size;
+      params.num_sources = max(1U, size / 20);
+      params.num_sinks = max(1U, size / 20);
+      params.total_supply = 10 * size;
+      params.max_capacity = 100;
+      params.max_cost = 1000;
+      params.seed = seed;
+      generateNetgenGraph(params, graph_file);
+    } else if (!generator.compare("grid")) {
+      GridParams params;
+      params.num_rows = sqrt(size);
+      params.num_cols = size / params.num_rows;
+      params.max_capacity = 100;
+      params.max_cost = 100;
+      params.seed = seed;
+      generateGridGraph(params, graph_file);
+    } else if (!generator.compare("scheduling")) {
+      SchedulingParams params;
+      params.num_machines = size;
+      params.machines_per_rack = 40;
+      params.slots_per_machine = 4;
+      // The cluster is a little oversubscribed, so some tasks stay
+      // unscheduled.
+      params.max_tasks_per_job = 40;
+      params.num_jobs = size * params.slots_per_machine * 5 / 4 /
+        (params.max_tasks_per_job / 2) + 1;
+      params.num_equivalence_classes = params.num_jobs / 4 + 1;
+      params.preferences_per_task = 3;
+      params.seed = seed;
+      generateSchedulingGraph(params, graph_file);
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+}
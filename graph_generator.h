@@ -0,0 +1,67 @@
+#ifndef FLOWLESSLY_GRAPH_GENERATOR_H
+#define FLOWLESSLY_GRAPH_GENERATOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Random network in the style of NETGEN. A Hamiltonian cycle of
+  // expensive arcs with the total supply as capacity keeps every instance
+  // feasible; the remaining arcs are random and cheaper.
+  struct NetgenParams {
+    uint32_t num_nodes;
+    uint32_t num_arcs;
+    uint32_t num_sources;
+    uint32_t num_sinks;
+    int64_t total_supply;
+    int64_t max_capacity;
+    int64_t max_cost;
+    uint64_t seed;
+  };
+
+  // rows x cols grid in which flow enters on the left column and leaves on
+  // the right one. A direct source to sink arc that costs more than any
+  // path through the grid takes the flow the grid can't carry.
+  struct GridParams {
+    uint32_t num_rows;
+    uint32_t num_cols;
+    int64_t max_capacity;
+    int64_t max_cost;
+    uint64_t seed;
+  };
+
+  // Quincy/Firmament shaped graph. Every task has one unit of supply and
+  // arcs to its job's unscheduled aggregator, to the cluster aggregator,
+  // to an equivalence class aggregator and to a few preferred machines and
+  // racks. The cluster aggregator feeds the racks, the racks their
+  // machines and the machines and the unscheduled aggregators the sink.
+  struct SchedulingParams {
+    uint32_t num_machines;
+    uint32_t machines_per_rack;
+    uint32_t slots_per_machine;
+    uint32_t num_jobs;
+    uint32_t max_tasks_per_job;
+    uint32_t num_equivalence_classes;
+    uint32_t preferences_per_task;
+    uint64_t seed;
+  };
+
+  // The graphs are written in DIMACS format. The same parameters always
+  // produce the same graph.
+  void generateNetgenGraph(const NetgenParams& params, FILE* graph_file);
+  void generateGridGraph(const GridParams& params, FILE* graph_file);
+  void generateSchedulingGraph(const SchedulingParams& params,
+                               FILE* graph_file);
+  // Writes a graph of the named generator (netgen, grid or scheduling)
+  // with parameters derived from size, which is roughly the number of
+  // nodes for netgen and grid and the number of machines for scheduling.
+  // Returns false if the generator is unknown.
+  bool generateGraph(const string& generator, uint32_t size, uint64_t seed,
+                     FILE* graph_file);
+
+}
+#endif
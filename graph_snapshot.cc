@@ -0,0 +1,59 @@
+#include "graph_snapshot.h"
+
+namespace flowlessly {
+
+  template<typename CapT, typename CostT>
+  GraphSnapshot<CapT, CostT>::GraphSnapshot(Graph<CapT, CostT>& graph):
+    graph_(graph) {
+    capture();
+  }
+
+  template<typename CapT, typename CostT>
+  void GraphSnapshot<CapT, CostT>::capture() {
+    arcs.clear();
+    arcs_cap.clear();
+    arcs_initial_cap.clear();
+    arcs_cost.clear();
+    segment_arcs.clear();
+    segment_arcs_flow.clear();
+    nodes_demand = graph_.get_nodes_demand();
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& graph_arcs = graph_.get_arcs();
+    uint32_t num_nodes = graph_.get_num_nodes();
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        graph_arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        graph_arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        arcs.push_back(it->second);
+        arcs_cap.push_back(it->second->cap);
+        arcs_initial_cap.push_back(it->second->initial_cap);
+        arcs_cost.push_back(it->second->cost);
+        ArcSegments<CapT, CostT>* segments = it->second->get_segments();
+        if (segments != NULL && it->second == segments->forward_arc) {
+          segment_arcs.push_back(it->second);
+          segment_arcs_flow.push_back(segments->flow);
+        }
+      }
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void GraphSnapshot<CapT, CostT>::restore() {
+    for (uint32_t index = 0; index < arcs.size(); ++index) {
+      arcs[index]->cap = arcs_cap[index];
+      arcs[index]->initial_cap = arcs_initial_cap[index];
+      arcs[index]->cost = arcs_cost[index];
+    }
+    for (uint32_t index = 0; index < segment_arcs.size(); ++index) {
+      segment_arcs[index]->set_flow(segment_arcs_flow[index]);
+    }
+    graph_.get_nodes_demand() = nodes_demand;
+  }
+
+  template class GraphSnapshot<int32_t, int32_t>;
+  template class GraphSnapshot<int32_t, int64_t>;
+  template class GraphSnapshot<int64_t, int32_t>;
+  template class GraphSnapshot<int64_t, int64_t>;
+
+}
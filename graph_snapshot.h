@@ -0,0 +1,43 @@
+#ifndef FLOWLESSLY_GRAPH_SNAPSHOT_H
+#define FLOWLESSLY_GRAPH_SNAPSHOT_H
+
+#include "graph.h"
+
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Records the state a solve changes (residual capacities, costs and
+  // demands) so that a tentative "what-if" solve on the graph can be undone
+  // with restore. Only flat arrays of scalars are copied; the Arc objects
+  // and the adjacency maps stay shared with the graph. The arcs must not be
+  // added or removed while the snapshot is in use.
+  template<typename CapT, typename CostT>
+  class GraphSnapshot {
+
+  public:
+    explicit GraphSnapshot(Graph<CapT, CostT>& graph);
+
+    // Records the current state of the graph again. The arrays are reused.
+    void capture();
+    // Puts the graph back in the state it had when the snapshot was taken.
+    // The snapshot can be restored more than once.
+    void restore();
+
+  private:
+    Graph<CapT, CostT>& graph_;
+    vector<Arc<CapT, CostT>*> arcs;
+    vector<CapT> arcs_cap;
+    vector<CapT> arcs_initial_cap;
+    vector<CostT> arcs_cost;
+    // The flow of the piecewise linear arcs is held by their segments.
+    vector<Arc<CapT, CostT>*> segment_arcs;
+    vector<CapT> segment_arcs_flow;
+    vector<CapT> nodes_demand;
+
+  };
+
+}
+#endif
@@ -0,0 +1,260 @@
+#include "memory_policy.h"
+
+#include <atomic>
+#include <errno.h>
+#include <glog/logging.h>
+#include <linux/mempolicy.h>
+#include <map>
+#include <mutex>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace flowlessly {
+
+  // The size of a transparent huge page on x86-64 and of the pool chunks.
+  const size_t kChunkSize = 2 << 20;
+  const size_t kMaxNumaNodes = 1024;
+  const size_t kMaskWords = kMaxNumaNodes / (8 * sizeof(unsigned long));
+
+  struct SizeClass {
+    SizeClass(): next(NULL), end(NULL), free_list(NULL) {
+    }
+
+    // The part of the last chunk that hasn't been handed out yet.
+    char* next;
+    char* end;
+    // Freed objects, linked through their first word.
+    void* free_list;
+  };
+
+  HugePagePolicy huge_page_policy = NO_HUGE_PAGES;
+  NumaPolicy numa_policy = NUMA_DEFAULT;
+  mutex pool_lock;
+  map<size_t, SizeClass> size_classes;
+  atomic<bool> huge_pages_warned(false);
+  atomic<bool> explicit_huge_pages_warned(false);
+  atomic<bool> numa_warned(false);
+
+  void setMemoryPolicy(HugePagePolicy huge_pages, NumaPolicy numa) {
+    huge_page_policy = huge_pages;
+    numa_policy = numa;
+  }
+
+  bool parseMemoryPolicy(const string& huge_pages, const string& numa,
+                         HugePagePolicy* huge_page_policy,
+                         NumaPolicy* numa_policy) {
+    if (!huge_pages.compare("none")) {
+      *huge_page_policy = NO_HUGE_PAGES;
+    } else if (!huge_pages.compare("transparent")) {
+      *huge_page_policy = TRANSPARENT_HUGE_PAGES;
+    } else if (!huge_pages.compare("explicit")) {
+      *huge_page_policy = EXPLICIT_HUGE_PAGES;
+    } else {
+      LOG(ERROR) << "Unknown huge page policy: " << huge_pages;
+      return false;
+    }
+    if (!numa.compare("none")) {
+      *numa_policy = NUMA_DEFAULT;
+    } else if (!numa.compare("local")) {
+      *numa_policy = NUMA_LOCAL;
+    } else if (!numa.compare("interleave")) {
+      *numa_policy = NUMA_INTERLEAVE;
+    } else {
+      LOG(ERROR) << "Unknown NUMA policy: " << numa;
+      return false;
+    }
+    return true;
+  }
+
+  void warnOnce(atomic<bool>& warned, const string& message) {
+    if (!warned.exchange(true)) {
+      LOG(WARNING) << message;
+    }
+  }
+
+  void adviseHugePages(void* data, size_t length) {
+    if (madvise(data, length, MADV_HUGEPAGE) < 0) {
+      warnOnce(huge_pages_warned, string("Transparent huge pages are not "
+                                         "available: ") + strerror(errno));
+    }
+  }
+
+  // The libnuma calls are made directly so that it isn't a dependency.
+  void bindToNumaNodes(void* data, size_t length, uint32_t flags) {
+    unsigned long node_mask[kMaskWords];
+    memset(node_mask, 0, sizeof(node_mask));
+    int mode;
+    if (numa_policy == NUMA_LOCAL) {
+      unsigned int cpu;
+      unsigned int node;
+      if (syscall(SYS_getcpu, &cpu, &node, NULL) < 0 ||
+          node >= kMaxNumaNodes) {
+        warnOnce(numa_warned, "Could not find the NUMA node of the thread");
+        return;
+      }
+      node_mask[node / (8 * sizeof(unsigned long))] =
+        1UL << (node % (8 * sizeof(unsigned long)));
+      mode = MPOL_BIND;
+    } else {
+      if (syscall(SYS_get_mempolicy, NULL, node_mask, kMaxNumaNodes, NULL,
+                  MPOL_F_MEMS_ALLOWED) < 0) {
+        warnOnce(numa_warned, string("NUMA policies are not available: ") +
+                 strerror(errno));
+        return;
+      }
+      mode = MPOL_INTERLEAVE;
+    }
+    // Like libnuma, pass one more node than the mask holds.
+    if (syscall(SYS_mbind, data, length, mode, node_mask, kMaxNumaNodes + 1,
+                flags) < 0) {
+      warnOnce(numa_warned, string("NUMA policies are not available: ") +
+               strerror(errno));
+    }
+  }
+
+  void applyMemoryPolicy(void* data, size_t length) {
+    if (huge_page_policy == NO_HUGE_PAGES && numa_policy == NUMA_DEFAULT) {
+      return;
+    }
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t start = reinterpret_cast<uintptr_t>(data);
+    uintptr_t end = (start + length) & ~(page_size - 1);
+    start = (start + page_size - 1) & ~(page_size - 1);
+    if (start >= end) {
+      return;
+    }
+    // Memory that is already allocated can't move to the huge page pool,
+    // so the explicit policy asks for transparent huge pages here.
+    if (huge_page_policy != NO_HUGE_PAGES) {
+      adviseHugePages(reinterpret_cast<void*>(start), end - start);
+    }
+    if (numa_policy != NUMA_DEFAULT) {
+      bindToNumaNodes(reinterpret_cast<void*>(start), end - start,
+                      MPOL_MF_MOVE);
+    }
+  }
+
+  // Returns a chunk aligned to its size, or NULL if out of memory.
+  char* mapChunk() {
+    if (huge_page_policy == EXPLICIT_HUGE_PAGES) {
+      void* chunk = mmap(NULL, kChunkSize, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (chunk != MAP_FAILED) {
+        if (numa_policy != NUMA_DEFAULT) {
+          bindToNumaNodes(chunk, kChunkSize, 0);
+        }
+        return static_cast<char*>(chunk);
+      }
+      warnOnce(explicit_huge_pages_warned,
+               "No explicit huge pages are left; using transparent ones");
+    }
+    // Twice the size is mapped so that an aligned chunk fits in, which
+    // lets the kernel back it with a single huge page.
+    void* mapping = mmap(NULL, 2 * kChunkSize, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+      return NULL;
+    }
+    char* mapping_start = static_cast<char*>(mapping);
+    char* chunk = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(mapping) + kChunkSize - 1) &
+        ~(kChunkSize - 1));
+    if (chunk > mapping_start) {
+      munmap(mapping_start, chunk - mapping_start);
+    }
+    munmap(chunk + kChunkSize, mapping_start + kChunkSize - chunk);
+    if (huge_page_policy != NO_HUGE_PAGES) {
+      adviseHugePages(chunk, kChunkSize);
+    }
+    if (numa_policy != NUMA_DEFAULT) {
+      bindToNumaNodes(chunk, kChunkSize, 0);
+    }
+    return chunk;
+  }
+
+  // Objects are aligned like the ones malloc returns.
+  size_t roundUpObjectSize(size_t size) {
+    return (size + 15) & ~static_cast<size_t>(15);
+  }
+
+  void* allocatePooled(size_t size) {
+    if (huge_page_policy == NO_HUGE_PAGES && numa_policy == NUMA_DEFAULT) {
+      return ::operator new(size);
+    }
+    size = roundUpObjectSize(size);
+    unique_lock<mutex> lock(pool_lock);
+    SizeClass& size_class = size_classes[size];
+    if (size_class.free_list != NULL) {
+      void* object = size_class.free_list;
+      size_class.free_list = *static_cast<void**>(object);
+      return object;
+    }
+    if (size_class.next + size > size_class.end) {
+      char* chunk = mapChunk();
+      if (chunk == NULL) {
+        throw bad_alloc();
+      }
+      size_class.next = chunk;
+      size_class.end = chunk + kChunkSize;
+    }
+    void* object = size_class.next;
+    size_class.next += size;
+    return object;
+  }
+
+  void freePooled(void* object, size_t size) {
+    if (huge_page_policy == NO_HUGE_PAGES && numa_policy == NUMA_DEFAULT) {
+      ::operator delete(object);
+      return;
+    }
+    if (object == NULL) {
+      return;
+    }
+    unique_lock<mutex> lock(pool_lock);
+    SizeClass& size_class = size_classes[roundUpObjectSize(size)];
+    *static_cast<void**>(object) = size_class.free_list;
+    size_class.free_list = object;
+  }
+
+  // Reads the value in kB of a "<field>: <value> kB" line.
+  uint64_t readMemoryField(FILE* file, const char* field) {
+    char line[256];
+    size_t field_length = strlen(field);
+    uint64_t value = 0;
+    rewind(file);
+    while (fgets(line, sizeof(line), file) != NULL) {
+      if (!strncmp(line, field, field_length) &&
+          line[field_length] == ':') {
+        value += strtoull(line + field_length + 1, NULL, 10);
+      }
+    }
+    return value;
+  }
+
+  uint64_t countHugePages() {
+    FILE* meminfo_file = fopen("/proc/meminfo", "r");
+    if (meminfo_file == NULL) {
+      return 0;
+    }
+    uint64_t huge_page_kb = readMemoryField(meminfo_file, "Hugepagesize");
+    fclose(meminfo_file);
+    FILE* smaps_file = fopen("/proc/self/smaps_rollup", "r");
+    if (smaps_file == NULL || huge_page_kb == 0) {
+      if (smaps_file != NULL) {
+        fclose(smaps_file);
+      }
+      return 0;
+    }
+    uint64_t used_kb = readMemoryField(smaps_file, "AnonHugePages") +
+      readMemoryField(smaps_file, "Shared_Hugetlb") +
+      readMemoryField(smaps_file, "Private_Hugetlb");
+    fclose(smaps_file);
+    return used_kb / huge_page_kb;
+  }
+
+}
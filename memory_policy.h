@@ -0,0 +1,65 @@
+#ifndef FLOWLESSLY_MEMORY_POLICY_H
+#define FLOWLESSLY_MEMORY_POLICY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  enum HugePagePolicy {
+    NO_HUGE_PAGES,
+    // Asks the kernel to back the memory with transparent huge pages.
+    TRANSPARENT_HUGE_PAGES,
+    // Maps the arcs from the reserved huge page pool. Falls back to
+    // transparent huge pages when the pool is empty.
+    EXPLICIT_HUGE_PAGES
+  };
+
+  enum NumaPolicy {
+    NUMA_DEFAULT,
+    // Keeps the memory on the NUMA node of the thread that sets it up.
+    NUMA_LOCAL,
+    // Spreads the memory page by page over all the NUMA nodes, which
+    // suits the parallel modes whose threads run on every socket.
+    NUMA_INTERLEAVE
+  };
+
+  // Where the graphs and the solver scratch arrays are placed. The policy
+  // is process wide and must be set before the first graph is built.
+  // Without it everything goes through the usual allocator. Policies the
+  // system doesn't support are logged once and ignored.
+  void setMemoryPolicy(HugePagePolicy huge_pages, NumaPolicy numa);
+  // Parses the values of the --huge_pages and --numa flags.
+  bool parseMemoryPolicy(const string& huge_pages, const string& numa,
+                         HugePagePolicy* huge_page_policy,
+                         NumaPolicy* numa_policy);
+
+  // Applies the policy to memory that is already allocated. Only the whole
+  // pages inside it are affected and pages that are in use are moved.
+  void applyMemoryPolicy(void* data, size_t length);
+  template<typename T>
+  void applyMemoryPolicy(vector<T>& array) {
+    if (!array.empty()) {
+      applyMemoryPolicy(&array[0], array.size() * sizeof(T));
+    }
+  }
+
+  // Allocates objects of a fixed size, like arcs, from huge page sized
+  // chunks placed by the policy. The chunks are mapped before they are
+  // touched, so explicit huge pages and NUMA binding apply from the
+  // start. Freed objects are reused by later allocations of the same
+  // size; the chunks are never unmapped. Without a policy these are
+  // operator new and delete.
+  void* allocatePooled(size_t size);
+  void freePooled(void* object, size_t size);
+
+  // Number of huge pages the process uses, transparent or explicit, or 0
+  // if the kernel doesn't tell.
+  uint64_t countHugePages();
+
+}
+#endif
@@ -0,0 +1,96 @@
+#include "perf_counters.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+namespace flowlessly {
+
+  PerfCounters::PerfCounters(): group_fd(-1), num_opened(0) {
+    for (uint32_t counter = 0; counter < NUM_HARDWARE_COUNTERS; ++counter) {
+      counter_fd[counter] = -1;
+    }
+  }
+
+  PerfCounters::~PerfCounters() {
+    for (uint32_t counter = 0; counter < NUM_HARDWARE_COUNTERS; ++counter) {
+      if (counter_fd[counter] >= 0) {
+        close(counter_fd[counter]);
+      }
+    }
+  }
+
+#ifdef __linux__
+  bool PerfCounters::open() {
+    const uint32_t types[NUM_HARDWARE_COUNTERS] = {
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+    };
+    const uint64_t configs[NUM_HARDWARE_COUNTERS] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_CACHE_MISSES,
+      PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (uint32_t counter = 0; counter < NUM_HARDWARE_COUNTERS; ++counter) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = types[counter];
+      attr.config = configs[counter];
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP |
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      int fd = syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+      if (fd < 0) {
+        continue;
+      }
+      if (group_fd < 0) {
+        group_fd = fd;
+      }
+      counter_fd[counter] = fd;
+      group_order[num_opened++] = static_cast<HardwareCounter>(counter);
+    }
+    return num_opened > 0;
+  }
+
+  void PerfCounters::read(uint64_t values[NUM_HARDWARE_COUNTERS]) {
+    memset(values, 0, NUM_HARDWARE_COUNTERS * sizeof(uint64_t));
+    if (num_opened == 0) {
+      return;
+    }
+    // nr, time_enabled, time_running and one value per counter.
+    uint64_t buffer[3 + NUM_HARDWARE_COUNTERS];
+    ssize_t expected_size = (3 + num_opened) * sizeof(uint64_t);
+    if (::read(group_fd, buffer, sizeof(buffer)) != expected_size) {
+      return;
+    }
+    double scale = buffer[2] > 0 ?
+      static_cast<double>(buffer[1]) / buffer[2] : 1.0;
+    for (uint32_t index = 0; index < num_opened; ++index) {
+      values[group_order[index]] = buffer[3 + index] * scale;
+    }
+  }
+#else
+  bool PerfCounters::open() {
+    return false;
+  }
+
+  void PerfCounters::read(uint64_t values[NUM_HARDWARE_COUNTERS]) {
+    memset(values, 0, NUM_HARDWARE_COUNTERS * sizeof(uint64_t));
+  }
+#endif
+
+  bool PerfCounters::isAvailable(HardwareCounter counter) {
+    return counter_fd[counter] >= 0;
+  }
+
+}
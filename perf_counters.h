@@ -0,0 +1,49 @@
+#ifndef FLOWLESSLY_PERF_COUNTERS_H
+#define FLOWLESSLY_PERF_COUNTERS_H
+
+#include <stdint.h>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  enum HardwareCounter {
+    CPU_CYCLES,
+    INSTRUCTIONS,
+    L1D_READ_MISSES,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    NUM_HARDWARE_COUNTERS
+  };
+
+  // Hardware counters of the calling thread, read through perf_event_open.
+  // They only count user space and run from the moment they are opened, so
+  // a measurement is the difference between two reads. Counters the kernel
+  // or the CPU doesn't provide are left out; on systems without perf
+  // events none of them is available.
+  class PerfCounters {
+
+  public:
+    PerfCounters();
+    ~PerfCounters();
+
+    // Returns false if no counter could be opened.
+    bool open();
+    bool isAvailable(HardwareCounter counter);
+    // Reads the current values. Counters that are not available read 0.
+    // The values are scaled up if the kernel had to multiplex them.
+    void read(uint64_t values[NUM_HARDWARE_COUNTERS]);
+
+  private:
+    // The first counter that opens leads the group the others join, so
+    // that a single read returns all of them.
+    int group_fd;
+    int counter_fd[NUM_HARDWARE_COUNTERS];
+    // The order in which the counters joined the group.
+    HardwareCounter group_order[NUM_HARDWARE_COUNTERS];
+    uint32_t num_opened;
+
+  };
+
+}
+#endif
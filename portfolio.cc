@@ -0,0 +1,124 @@
+#include "portfolio.h"
+
+#include <atomic>
+#include <chrono>
+#include <glog/logging.h>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Lower is better: optimal flows, flows that meet the demands within a
+  // known gap, flows that meet them without one and flows that don't.
+  uint32_t rankQuality(const SolutionQuality& quality) {
+    if (quality.optimal) {
+      return 0;
+    } else if (quality.unrouted_supply > 0) {
+      return 3;
+    }
+    return quality.cost_gap >= 0 ? 1 : 2;
+  }
+
+  template<typename CapT, typename CostT>
+  bool SolverPortfolio<CapT, CostT>::isBetter(Graph<CapT, CostT>& graph,
+                                              Graph<CapT, CostT>& other) {
+    const SolutionQuality& quality = graph.get_solution_quality();
+    const SolutionQuality& other_quality = other.get_solution_quality();
+    uint32_t rank = rankQuality(quality);
+    uint32_t other_rank = rankQuality(other_quality);
+    if (rank != other_rank) {
+      return rank < other_rank;
+    }
+    if (quality.unrouted_supply != other_quality.unrouted_supply) {
+      return quality.unrouted_supply < other_quality.unrouted_supply;
+    }
+    return graph.getFlowCost() < other.getFlowCost();
+  }
+
+  template<typename CapT, typename CostT>
+  uint32_t SolverPortfolio<CapT, CostT>::solve(
+      const function<void(const string&, Graph<CapT, CostT>&,
+                          SolverWorkspace&, SolveBudget&)>& solve,
+      SolverWorkspace& workspace, SolveBudget& budget) {
+    uint32_t num_algorithms = algorithms_.size();
+    if (num_algorithms == 0) {
+      LOG(ERROR) << "The portfolio has no algorithms to run";
+      SolutionQuality& quality = graph_.get_solution_quality();
+      quality.optimal = false;
+      quality.cost_gap = -1;
+      return 0;
+    }
+    vector<unique_ptr<Graph<CapT, CostT> > > solved(num_algorithms);
+    vector<int64_t> return_time_us(num_algorithms, -1);
+    atomic<bool> stop(false);
+    mutex winner_lock;
+    uint32_t first_optimal = num_algorithms;
+    chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+    for (uint32_t index = 0; index < num_algorithms; ++index) {
+      pool_.schedule([&, index] {
+          // The pool may be smaller than the portfolio.
+          if (stop.load()) {
+            return;
+          }
+          SolverWorkspace own_workspace;
+          own_workspace.set_stats(&workspace.get_stats());
+          SolveBudget own_budget(budget);
+          own_budget.set_stop_flag(&stop);
+          solved[index].reset(new Graph<CapT, CostT>(graph_));
+          solve(algorithms_[index], *solved[index],
+                index == 0 ? workspace : own_workspace, own_budget);
+          unique_lock<mutex> lock(winner_lock);
+          return_time_us[index] =
+            chrono::duration_cast<chrono::microseconds>(
+                chrono::steady_clock::now() - start_time).count();
+          // Nothing beats an optimal flow. Until one is found, the others
+          // run until their own budget runs out.
+          if (first_optimal == num_algorithms &&
+              solved[index]->get_solution_quality().optimal) {
+            first_optimal = index;
+            stop.store(true);
+          }
+        });
+    }
+    pool_.wait();
+    uint32_t winner = num_algorithms;
+    for (uint32_t index = 0; index < num_algorithms; ++index) {
+      if (return_time_us[index] >= 0 &&
+          (winner == num_algorithms ||
+           isBetter(*solved[index], *solved[winner]))) {
+        winner = index;
+      }
+    }
+    graph_.copyFlow(*solved[winner]);
+    LOG(INFO) << algorithms_[winner] << " won the portfolio in "
+              << return_time_us[winner] << " us";
+    if (winner != first_optimal) {
+      return winner;
+    }
+    // The others returned early because they were stopped, so the margin
+    // only bounds how much slower they would have been.
+    int64_t runner_up_time_us = numeric_limits<int64_t>::max();
+    uint32_t runner_up = num_algorithms;
+    for (uint32_t index = 0; index < num_algorithms; ++index) {
+      if (index != winner && return_time_us[index] >= 0 &&
+          return_time_us[index] < runner_up_time_us) {
+        runner_up_time_us = return_time_us[index];
+        runner_up = index;
+      }
+    }
+    if (runner_up < num_algorithms) {
+      LOG(INFO) << "It beat " << algorithms_[runner_up] << " by at least "
+                << runner_up_time_us - return_time_us[winner] << " us";
+    }
+    return winner;
+  }
+
+  template class SolverPortfolio<int32_t, int32_t>;
+  template class SolverPortfolio<int32_t, int64_t>;
+  template class SolverPortfolio<int64_t, int32_t>;
+  template class SolverPortfolio<int64_t, int64_t>;
+
+}
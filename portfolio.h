@@ -0,0 +1,50 @@
+#ifndef FLOWLESSLY_PORTFOLIO_H
+#define FLOWLESSLY_PORTFOLIO_H
+
+#include "graph.h"
+#include "solve_budget.h"
+#include "solver_workspace.h"
+#include "thread_pool.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Races several min cost flow algorithms on the same graph. Every
+  // algorithm solves its own deep copy of the graph on a pool thread. The
+  // first optimal flow stops the others through their budget. The best
+  // flow wins, by solution quality and then by cost, and is copied back
+  // into the graph.
+  template<typename CapT, typename CostT>
+  class SolverPortfolio {
+
+  public:
+  SolverPortfolio(Graph<CapT, CostT>& graph, ThreadPool& pool,
+                  const vector<string>& algorithms):
+    graph_(graph), pool_(pool), algorithms_(algorithms) {
+    }
+
+    // The first algorithm uses the given workspace, the others allocate
+    // their own that feed the same statistics. Every algorithm gets a copy
+    // of the budget. Returns the index of the winning algorithm, or 0 with
+    // the graph left unsolved if there are no algorithms.
+    uint32_t solve(const function<void(const string&, Graph<CapT, CostT>&,
+                                       SolverWorkspace&, SolveBudget&)>& solve,
+                   SolverWorkspace& workspace, SolveBudget& budget);
+
+  private:
+    // Returns true if the flow of graph is better than the one of other.
+    bool isBetter(Graph<CapT, CostT>& graph, Graph<CapT, CostT>& other);
+
+    Graph<CapT, CostT>& graph_;
+    ThreadPool& pool_;
+    vector<string> algorithms_;
+
+  };
+
+}
+#endif
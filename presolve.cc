@@ -0,0 +1,350 @@
+#include "presolve.h"
+
+#include <algorithm>
+#include <glog/logging.h>
+#include <map>
+#include <queue>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  template<typename CapT, typename CostT>
+  void Presolve<CapT, CostT>::reduce() {
+    removeUselessArcs();
+    aggregateEquivalentNodes();
+    contractChains();
+    uint32_t num_aggregated = 0;
+    for (typename vector<AggregatedNodes>::iterator it =
+           aggregated_nodes.begin(); it != aggregated_nodes.end(); ++it) {
+      num_aggregated += it->members.size() - 1;
+    }
+    LOG(INFO) << "Presolve removed " << removed_arcs.size() << " arcs, "
+              << "aggregated " << num_aggregated << " nodes and contracted "
+              << contracted_chains.size() << " chains";
+  }
+
+  // Undoes the reductions in the reverse order in which they were applied.
+  template<typename CapT, typename CostT>
+  void Presolve<CapT, CostT>::expand() {
+    vector<CapT>& nodes_demand = graph_.get_nodes_demand();
+    for (typename vector<ContractedChain>::reverse_iterator it =
+           contracted_chains.rbegin(); it != contracted_chains.rend(); ++it) {
+      CapT flow = it->arc->initial_cap - it->arc->cap;
+      eraseArc(it->arc);
+      it->in_arc->cap -= flow;
+      it->in_arc->reverse_arc->cap += flow;
+      it->out_arc->cap -= flow;
+      it->out_arc->reverse_arc->cap += flow;
+      insertArc(it->in_arc);
+      insertArc(it->out_arc);
+      delete it->arc->reverse_arc;
+      delete it->arc;
+    }
+    contracted_chains.clear();
+    vector<uint32_t>& source_nodes = graph_.get_source_nodes();
+    for (typename vector<AggregatedNodes>::reverse_iterator it =
+           aggregated_nodes.rbegin(); it != aggregated_nodes.rend(); ++it) {
+      vector<Arc<CapT, CostT>*>& rep_arcs = it->member_arcs[0];
+      vector<CapT> flow(rep_arcs.size());
+      for (uint32_t arc_index = 0; arc_index < rep_arcs.size(); ++arc_index) {
+        flow[arc_index] =
+          rep_arcs[arc_index]->initial_cap - rep_arcs[arc_index]->cap;
+        rep_arcs[arc_index]->initial_cap = it->arcs_cap[arc_index];
+      }
+      // Split the flow among the members. Every member first takes the flow
+      // the remaining members could not carry and then fills up to its
+      // demand. This always succeeds because the aggregated flow on an arc
+      // is at most the number of members times the arc capacity.
+      for (uint32_t index = 0; index < it->members.size(); ++index) {
+        CapT num_remaining = it->members.size() - index - 1;
+        vector<CapT> member_flow(rep_arcs.size(), 0);
+        CapT to_route = it->demand;
+        for (uint32_t arc_index = 0; arc_index < rep_arcs.size();
+             ++arc_index) {
+          CapT mandatory =
+            flow[arc_index] - num_remaining * it->arcs_cap[arc_index];
+          if (mandatory > 0) {
+            member_flow[arc_index] = mandatory;
+            to_route -= mandatory;
+          }
+        }
+        for (uint32_t arc_index = 0;
+             arc_index < rep_arcs.size() && to_route > 0; ++arc_index) {
+          CapT extra = min(to_route,
+                           min(it->arcs_cap[arc_index],
+                               flow[arc_index]) - member_flow[arc_index]);
+          member_flow[arc_index] += extra;
+          to_route -= extra;
+        }
+        for (uint32_t arc_index = 0; arc_index < rep_arcs.size();
+             ++arc_index) {
+          Arc<CapT, CostT>* arc = it->member_arcs[index][arc_index];
+          arc->cap = it->arcs_cap[arc_index] - member_flow[arc_index];
+          arc->reverse_arc->cap = member_flow[arc_index];
+          flow[arc_index] -= member_flow[arc_index];
+          if (index > 0) {
+            insertArc(arc);
+          }
+        }
+        nodes_demand[it->members[index]] = it->demand;
+        if (index > 0) {
+          source_nodes.push_back(it->members[index]);
+        }
+      }
+    }
+    aggregated_nodes.clear();
+    sort(source_nodes.begin(), source_nodes.end());
+    for (typename vector<Arc<CapT, CostT>*>::iterator it =
+           removed_arcs.begin(); it != removed_arcs.end(); ++it) {
+      insertArc(*it);
+    }
+    removed_arcs.clear();
+  }
+
+  // Removes the arcs without capacity in either direction. If there are no
+  // negative cost arcs then there are no negative cycles, and an optimal
+  // flow only uses arcs that are on a path from a source to a sink.
+  template<typename CapT, typename CostT>
+  void Presolve<CapT, CostT>::removeUselessArcs() {
+    uint32_t num_nodes = graph_.get_num_nodes();
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    bool has_negative_cost = false;
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        if (it->second->initial_cap > 0 && it->second->cost < 0) {
+          has_negative_cost = true;
+        }
+      }
+    }
+    vector<bool> from_source(num_nodes + 1, true);
+    vector<bool> to_sink(num_nodes + 1, true);
+    if (!has_negative_cost) {
+      markReachable(graph_.get_source_nodes(), true, from_source);
+      markReachable(graph_.get_sink_nodes(), false, to_sink);
+    }
+    vector<Arc<CapT, CostT>*> to_remove;
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        Arc<CapT, CostT>* arc = it->second;
+        if (arc->initial_cap > 0) {
+          if (!from_source[node_id] || !to_sink[it->first]) {
+            to_remove.push_back(arc);
+          }
+        } else if (arc->reverse_arc->initial_cap == 0 &&
+                   node_id < it->first) {
+          to_remove.push_back(arc);
+        }
+      }
+    }
+    for (typename vector<Arc<CapT, CostT>*>::iterator it = to_remove.begin();
+         it != to_remove.end(); ++it) {
+      eraseArc(*it);
+      removed_arcs.push_back(*it);
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void Presolve<CapT, CostT>::aggregateEquivalentNodes() {
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    vector<CapT>& nodes_demand = graph_.get_nodes_demand();
+    vector<uint32_t>& source_nodes = graph_.get_source_nodes();
+    // Group the supply nodes that don't have incoming arcs by their demand
+    // and their outgoing arcs. Nodes with piecewise linear arcs are left
+    // alone.
+    map<vector<int64_t>, vector<uint32_t> > classes;
+    for (vector<uint32_t>::iterator node_it = source_nodes.begin();
+         node_it != source_nodes.end(); ++node_it) {
+      vector<int64_t> signature(1, nodes_demand[*node_it]);
+      bool only_outgoing = !arcs[*node_it].empty();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[*node_it].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[*node_it].end();
+      for (; it != end_it && only_outgoing; ++it) {
+        only_outgoing = it->second->initial_cap > 0 &&
+          !it->second->has_segments;
+        signature.push_back(it->first);
+        signature.push_back(it->second->initial_cap);
+        signature.push_back(it->second->cost);
+      }
+      if (only_outgoing) {
+        classes[signature].push_back(*node_it);
+      }
+    }
+    vector<bool> aggregated(graph_.get_num_nodes() + 1, false);
+    for (map<vector<int64_t>, vector<uint32_t> >::iterator class_it =
+           classes.begin(); class_it != classes.end(); ++class_it) {
+      vector<uint32_t>& members = class_it->second;
+      if (members.size() < 2) {
+        continue;
+      }
+      AggregatedNodes nodes;
+      nodes.representative = members[0];
+      nodes.demand = nodes_demand[members[0]];
+      nodes.members = members;
+      CapT num_members = members.size();
+      CapT total_demand;
+      if (__builtin_mul_overflow(nodes.demand, num_members, &total_demand)) {
+        continue;
+      }
+      bool overflows = false;
+      for (vector<uint32_t>::iterator node_it = members.begin();
+           node_it != members.end(); ++node_it) {
+        vector<Arc<CapT, CostT>*> member_arcs;
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+          arcs[*node_it].begin();
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+          arcs[*node_it].end();
+        for (; it != end_it; ++it) {
+          CapT total_cap;
+          overflows |= __builtin_mul_overflow(it->second->initial_cap,
+                                              num_members, &total_cap);
+          member_arcs.push_back(it->second);
+        }
+        nodes.member_arcs.push_back(member_arcs);
+      }
+      if (overflows) {
+        continue;
+      }
+      vector<Arc<CapT, CostT>*>& rep_arcs = nodes.member_arcs[0];
+      for (uint32_t arc_index = 0; arc_index < rep_arcs.size(); ++arc_index) {
+        nodes.arcs_cap.push_back(rep_arcs[arc_index]->initial_cap);
+        rep_arcs[arc_index]->initial_cap *= num_members;
+        rep_arcs[arc_index]->cap = rep_arcs[arc_index]->initial_cap;
+      }
+      nodes_demand[nodes.representative] = total_demand;
+      for (uint32_t index = 1; index < members.size(); ++index) {
+        nodes_demand[members[index]] = 0;
+        aggregated[members[index]] = true;
+        vector<Arc<CapT, CostT>*>& member_arcs = nodes.member_arcs[index];
+        for (typename vector<Arc<CapT, CostT>*>::iterator it =
+               member_arcs.begin(); it != member_arcs.end(); ++it) {
+          eraseArc(*it);
+        }
+      }
+      aggregated_nodes.push_back(nodes);
+    }
+    vector<uint32_t> remaining_source_nodes;
+    for (vector<uint32_t>::iterator node_it = source_nodes.begin();
+         node_it != source_nodes.end(); ++node_it) {
+      if (!aggregated[*node_it]) {
+        remaining_source_nodes.push_back(*node_it);
+      }
+    }
+    source_nodes.swap(remaining_source_nodes);
+  }
+
+  template<typename CapT, typename CostT>
+  void Presolve<CapT, CostT>::contractChains() {
+    uint32_t num_nodes = graph_.get_num_nodes();
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    vector<CapT>& nodes_demand = graph_.get_nodes_demand();
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      if (nodes_demand[node_id] != 0 || arcs[node_id].size() != 2) {
+        continue;
+      }
+      Arc<CapT, CostT>* in_arc = NULL;
+      Arc<CapT, CostT>* out_arc = NULL;
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        if (it->second->initial_cap > 0) {
+          out_arc = it->second;
+        } else {
+          in_arc = it->second->reverse_arc;
+        }
+      }
+      if (in_arc == NULL || out_arc == NULL || in_arc->has_segments ||
+          out_arc->has_segments) {
+        continue;
+      }
+      uint32_t src_node_id = in_arc->src_node_id;
+      uint32_t dst_node_id = out_arc->dst_node_id;
+      CostT cost;
+      // The map can't hold parallel arcs, so chains that end in a
+      // neighbour of their start are left alone.
+      if (src_node_id == dst_node_id ||
+          arcs[src_node_id].count(dst_node_id) > 0 ||
+          __builtin_add_overflow(in_arc->cost, out_arc->cost, &cost)) {
+        continue;
+      }
+      Arc<CapT, CostT>* arc =
+        new Arc<CapT, CostT>(src_node_id, dst_node_id,
+                             min(in_arc->initial_cap, out_arc->initial_cap),
+                             cost, NULL);
+      Arc<CapT, CostT>* reverse_arc =
+        new Arc<CapT, CostT>(dst_node_id, src_node_id, 0, -cost, arc);
+      arc->set_reverse_arc(reverse_arc);
+      eraseArc(in_arc);
+      eraseArc(out_arc);
+      insertArc(arc);
+      ContractedChain chain;
+      chain.arc = arc;
+      chain.in_arc = in_arc;
+      chain.out_arc = out_arc;
+      contracted_chains.push_back(chain);
+    }
+  }
+
+  // Marks the nodes reachable from start_nodes using arcs that have
+  // capacity. If forward is false then the arcs are followed backwards.
+  template<typename CapT, typename CostT>
+  void Presolve<CapT, CostT>::markReachable(
+      const vector<uint32_t>& start_nodes, bool forward,
+      vector<bool>& reachable) {
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    fill(reachable.begin(), reachable.end(), false);
+    queue<uint32_t> to_visit;
+    for (vector<uint32_t>::const_iterator it = start_nodes.begin();
+         it != start_nodes.end(); ++it) {
+      reachable[*it] = true;
+      to_visit.push(*it);
+    }
+    while (!to_visit.empty()) {
+      uint32_t node_id = to_visit.front();
+      to_visit.pop();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[node_id].end();
+      for (; it != end_it; ++it) {
+        Arc<CapT, CostT>* arc = forward ? it->second : it->second->reverse_arc;
+        if (arc->initial_cap > 0 && !reachable[it->first]) {
+          reachable[it->first] = true;
+          to_visit.push(it->first);
+        }
+      }
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void Presolve<CapT, CostT>::insertArc(Arc<CapT, CostT>* arc) {
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    arcs[arc->src_node_id][arc->dst_node_id] = arc;
+    arcs[arc->dst_node_id][arc->src_node_id] = arc->reverse_arc;
+  }
+
+  template<typename CapT, typename CostT>
+  void Presolve<CapT, CostT>::eraseArc(Arc<CapT, CostT>* arc) {
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    arcs[arc->src_node_id].erase(arc->dst_node_id);
+    arcs[arc->dst_node_id].erase(arc->src_node_id);
+  }
+
+  template class Presolve<int32_t, int32_t>;
+  template class Presolve<int32_t, int64_t>;
+  template class Presolve<int64_t, int32_t>;
+  template class Presolve<int64_t, int64_t>;
+
+}
@@ -0,0 +1,65 @@
+#ifndef FLOWLESSLY_PRESOLVE_H
+#define FLOWLESSLY_PRESOLVE_H
+
+#include "graph.h"
+
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Shrinks a graph before it is handed to a solver and maps the flow found
+  // on the reduced graph back to the original arcs. The reductions are:
+  // 1) arcs that can never carry flow are removed,
+  // 2) supply nodes with identical demand and identical outgoing arcs
+  //    (e.g. the tasks of a job) are aggregated into one node,
+  // 3) nodes with no demand and only one incoming and one outgoing arc are
+  //    contracted into a single arc.
+  // The Arc objects are shared with the graph, so expand must be called
+  // after the solver finished and before the graph is written.
+  template<typename CapT, typename CostT>
+  class Presolve {
+
+  public:
+  Presolve(Graph<CapT, CostT>& graph): graph_(graph) {
+    }
+
+    void reduce();
+    void expand();
+
+  private:
+    // An arc that replaces the in_arc -> out_arc chain.
+    struct ContractedChain {
+      Arc<CapT, CostT>* arc;
+      Arc<CapT, CostT>* in_arc;
+      Arc<CapT, CostT>* out_arc;
+    };
+
+    // Supply nodes merged into representative. member_arcs[i][j] is the arc
+    // of members[i] that corresponds to the j-th arc of the representative.
+    struct AggregatedNodes {
+      uint32_t representative;
+      CapT demand;
+      vector<uint32_t> members;
+      vector<CapT> arcs_cap;
+      vector<vector<Arc<CapT, CostT>*> > member_arcs;
+    };
+
+    Graph<CapT, CostT>& graph_;
+    vector<Arc<CapT, CostT>*> removed_arcs;
+    vector<AggregatedNodes> aggregated_nodes;
+    vector<ContractedChain> contracted_chains;
+
+    void removeUselessArcs();
+    void aggregateEquivalentNodes();
+    void contractChains();
+    void markReachable(const vector<uint32_t>& start_nodes, bool forward,
+                       vector<bool>& reachable);
+    void insertArc(Arc<CapT, CostT>* arc);
+    void eraseArc(Arc<CapT, CostT>* arc);
+
+  };
+
+}
+#endif
@@ -0,0 +1,39 @@
+#include "solve_budget.h"
+
+#include <stddef.h>
+
+namespace flowlessly {
+
+  SolveBudget::SolveBudget(int64_t time_limit_ms, uint64_t max_iterations):
+    time_limit_ms(time_limit_ms), max_iterations(max_iterations),
+    stop_flag(NULL) {
+    restart();
+  }
+
+  void SolveBudget::restart() {
+    deadline = chrono::steady_clock::now() +
+      chrono::milliseconds(time_limit_ms);
+  }
+
+  bool SolveBudget::canInterrupt() {
+    return time_limit_ms > 0 || stop_flag != NULL;
+  }
+
+  bool SolveBudget::isPastDeadline() {
+    return time_limit_ms > 0 && chrono::steady_clock::now() >= deadline;
+  }
+
+  bool SolveBudget::isExhausted(uint64_t iteration) {
+    return (max_iterations > 0 && iteration >= max_iterations) ||
+      isPastDeadline() || isStopped();
+  }
+
+  void SolveBudget::set_stop_flag(const atomic<bool>* stop_flag) {
+    this->stop_flag = stop_flag;
+  }
+
+  bool SolveBudget::isStopped() {
+    return stop_flag != NULL && stop_flag->load(memory_order_relaxed);
+  }
+
+}
@@ -0,0 +1,49 @@
+#ifndef FLOWLESSLY_SOLVE_BUDGET_H
+#define FLOWLESSLY_SOLVE_BUDGET_H
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Limits the time and the number of iterations a solver may spend. An
+  // iteration is a scaling phase for cost scaling, an augmenting path for
+  // successive shortest path and a cancelled cycle for cycle cancelling.
+  // A solver that runs out of budget returns the flow it has and describes
+  // how far it is from optimal in the graph's SolutionQuality.
+  // The budget can be checked from several threads.
+  class SolveBudget {
+
+  public:
+    // A limit of zero means no limit. The clock starts when the budget is
+    // created.
+    SolveBudget(int64_t time_limit_ms, uint64_t max_iterations);
+
+    // Starts the clock again.
+    void restart();
+    // Returns true if a deadline or a stop flag can end an iteration
+    // before it completes.
+    bool canInterrupt();
+    bool isPastDeadline();
+    // Returns true if the deadline passed, if iteration is beyond the
+    // iteration limit or if the solve was stopped.
+    bool isExhausted(uint64_t iteration);
+    // Lets another thread stop the solve by setting the flag. The flag must
+    // outlive the budget.
+    void set_stop_flag(const atomic<bool>* stop_flag);
+    // A stopped solver may return without a feasible flow.
+    bool isStopped();
+
+  private:
+    int64_t time_limit_ms;
+    uint64_t max_iterations;
+    chrono::steady_clock::time_point deadline;
+    const atomic<bool>* stop_flag;
+
+  };
+
+}
+#endif
@@ -0,0 +1,409 @@
+#include "solver_daemon.h"
+
+#include <algorithm>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <chrono>
+#include <errno.h>
+#include <glog/logging.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace flowlessly {
+
+  using boost::algorithm::is_any_of;
+  using boost::lexical_cast;
+  using boost::token_compress_on;
+
+  bool readFromSocket(int socket_fd, char* buffer, size_t length) {
+    while (length > 0) {
+      ssize_t num_read = read(socket_fd, buffer, length);
+      if (num_read < 0 && errno == EINTR) {
+        continue;
+      }
+      if (num_read <= 0) {
+        return false;
+      }
+      buffer += num_read;
+      length -= num_read;
+    }
+    return true;
+  }
+
+  bool writeToSocket(int socket_fd, const char* buffer, size_t length) {
+    while (length > 0) {
+      // MSG_NOSIGNAL keeps a client that went away from killing us.
+      ssize_t num_written = send(socket_fd, buffer, length, MSG_NOSIGNAL);
+      if (num_written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (num_written <= 0) {
+        return false;
+      }
+      buffer += num_written;
+      length -= num_written;
+    }
+    return true;
+  }
+
+  // Reads one byte at a time so that nothing past the newline is consumed.
+  // Only used for the short header lines.
+  bool readLineFromSocket(int socket_fd, size_t max_length, string* line) {
+    line->clear();
+    char cur_char;
+    while (line->size() <= max_length &&
+           readFromSocket(socket_fd, &cur_char, 1)) {
+      if (cur_char == '\n') {
+        return true;
+      }
+      line->push_back(cur_char);
+    }
+    return false;
+  }
+
+  // Unlike lexical_cast, doesn't throw on a malformed count.
+  bool parseCount(const string& value, uint64_t max_count, uint64_t* count) {
+    if (value.empty() ||
+        value.find_first_not_of("0123456789") != string::npos) {
+      return false;
+    }
+    errno = 0;
+    unsigned long long parsed = strtoull(value.c_str(), NULL, 10);
+    if (errno == ERANGE || parsed > max_count) {
+      return false;
+    }
+    *count = parsed;
+    return true;
+  }
+
+  // Returns the node count of the problem line of a DIMACS payload, or 0
+  // if it has none the parser would accept.
+  uint64_t problemLineNodes(const vector<char>& payload) {
+    vector<char>::const_iterator line_it = payload.begin();
+    while (line_it != payload.end()) {
+      vector<char>::const_iterator end_it =
+        find(line_it, payload.end(), '\n');
+      if (*line_it == 'p') {
+        vector<string> vals;
+        string line(line_it, end_it);
+        boost::split(vals, line, is_any_of(" "), token_compress_on);
+        uint64_t num_nodes = 0;
+        if (vals.size() >= 3 &&
+            parseCount(vals[2], numeric_limits<uint64_t>::max(),
+                       &num_nodes)) {
+          return num_nodes;
+        }
+        return 0;
+      }
+      line_it = end_it == payload.end() ? end_it : end_it + 1;
+    }
+    return 0;
+  }
+
+  template<typename CapT, typename CostT>
+  bool SolverDaemon<CapT, CostT>::run() {
+    int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+      LOG(ERROR) << "Could not create socket: " << strerror(errno);
+      return false;
+    }
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path_.size() >= sizeof(address.sun_path)) {
+      LOG(ERROR) << "Socket path is too long: " << socket_path_;
+      close(server_fd);
+      return false;
+    }
+    strcpy(address.sun_path, socket_path_.c_str());
+    unlink(socket_path_.c_str());
+    if (bind(server_fd, reinterpret_cast<struct sockaddr*>(&address),
+             sizeof(address)) < 0 || listen(server_fd, 16) < 0) {
+      LOG(ERROR) << "Could not listen on " << socket_path_ << ": "
+                 << strerror(errno);
+      close(server_fd);
+      return false;
+    }
+    LOG(INFO) << "Listening on " << socket_path_;
+    bool quit = false;
+    while (!quit) {
+      int client_fd = accept(server_fd, NULL, NULL);
+      if (client_fd < 0) {
+        if (errno != EINTR) {
+          LOG(ERROR) << "Failed to accept client: " << strerror(errno);
+        }
+        continue;
+      }
+      // Clients are served one at a time; they all share the graph.
+      while (serveRequest(client_fd, &quit)) {
+      }
+      solver_pool.wait();
+      assignment_writer.flush();
+      reply_failed = false;
+      close(client_fd);
+    }
+    close(server_fd);
+    unlink(socket_path_.c_str());
+    return true;
+  }
+
+  template<typename CapT, typename CostT>
+  bool SolverDaemon<CapT, CostT>::serveRequest(int client_fd, bool* quit) {
+    string header;
+    if (reply_failed ||
+        !readLineFromSocket(client_fd, kMaxHeaderLength, &header)) {
+      return false;
+    }
+    vector<string> vals;
+    boost::split(vals, header, is_any_of(" "), token_compress_on);
+    if (!vals[0].compare("quit")) {
+      *quit = true;
+      solver_pool.wait();
+      sendReply(client_fd, "ok 0\n");
+      return false;
+    }
+    bool is_update = !vals[0].compare("update");
+    string reply_kind = vals.size() == 4 ? vals[3] : "flows";
+    uint64_t payload_bytes = 0;
+    if (vals.size() < 3 || vals.size() > (is_update ? 3 : 4) ||
+        (vals[0].compare("graph") && vals[0].compare("delta") &&
+         !is_update) ||
+        (vals[1].compare("dimacs") && vals[1].compare("binary")) ||
+        (reply_kind.compare("flows") && reply_kind.compare("assignments") &&
+         reply_kind.compare("changes")) ||
+        !parseCount(vals[2], max_payload_bytes_, &payload_bytes)) {
+      // The payload length is unknown, so the stream can't be resumed.
+      solver_pool.wait();
+      sendReply(client_fd, "error malformed request header\n");
+      return false;
+    }
+    GraphUpdate* update = new GraphUpdate();
+    update->is_delta = vals[0].compare("graph");
+    update->is_binary = !vals[1].compare("binary");
+    update->solve = !is_update;
+    update->payload.resize(payload_bytes);
+    if (!update->payload.empty() &&
+        !readFromSocket(client_fd, &update->payload[0],
+                        update->payload.size())) {
+      delete update;
+      return false;
+    }
+    chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+    // The update is applied to the shadow copy right away, even if the
+    // solver is still busy with an earlier request.
+    graphs.push(update);
+    if (is_update) {
+      return true;
+    }
+    solver_pool.schedule(
+        [this, client_fd, update, header, reply_kind, start_time] {
+          solveUpdate(client_fd, update, header, reply_kind, start_time);
+        });
+    return true;
+  }
+
+  template<typename CapT, typename CostT>
+  void SolverDaemon<CapT, CostT>::solveUpdate(
+      int client_fd, GraphUpdate* update, const string& header,
+      const string& reply_kind, chrono::steady_clock::time_point start_time) {
+    // The update belongs to the double buffer, which frees it once the
+    // swap below has happened.
+    bool is_binary = update->is_binary;
+    string error;
+    Graph<CapT, CostT>* graph = graphs.startSolve(update, &error);
+    if (graph == NULL) {
+      if (!sendReply(client_fd, "error " + error + "\n")) {
+        reply_failed = true;
+      }
+      return;
+    }
+    budget_.restart();
+    // The potentials of a solve warm start the next one.
+    graph->set_export_potentials(static_cast<bool>(warm_solve_));
+    if (warm_solve_ && loadSolution(*graph)) {
+      warm_solve_(*graph, workspace, budget_);
+    } else {
+      graph->resetFlow();
+      graph->get_potentials().clear();
+      solve_(*graph, workspace, budget_);
+    }
+    if (warm_solve_) {
+      saveSolution(*graph);
+    }
+    int64_t latency_us = chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now() - start_time).count();
+    LOG(INFO) << "Served " << header << " in " << latency_us << " us";
+    if (reply_kind.compare("flows")) {
+      vector<TaskAssignment> assignments;
+      extractAssignments(*graph, &assignments);
+      string latency_line = is_binary ? "" :
+        "c latency_us " + lexical_cast<string>(latency_us) + "\n";
+      assignment_writer.write(
+          assignments, graph->getFlowCost(),
+          is_binary ? BINARY_ASSIGNMENTS : TEXT_ASSIGNMENTS,
+          !reply_kind.compare("changes"),
+          [client_fd, latency_line](const string& assignments) {
+            string reply = "ok " +
+              lexical_cast<string>(latency_line.size() + assignments.size()) +
+              "\n" + latency_line + assignments;
+            return writeToSocket(client_fd, reply.data(), reply.size());
+          });
+      return;
+    }
+    char* flows = NULL;
+    size_t flows_size = 0;
+    FILE* flows_file = open_memstream(&flows, &flows_size);
+    fprintf(flows_file, "c latency_us %jd\n", latency_us);
+    graph->writeGraph(flows_file);
+    fclose(flows_file);
+    string reply = "ok " + lexical_cast<string>(flows_size) + "\n";
+    reply.append(flows, flows_size);
+    free(flows);
+    if (!sendReply(client_fd, reply)) {
+      reply_failed = true;
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void SolverDaemon<CapT, CostT>::saveSolution(Graph<CapT, CostT>& graph) {
+    char* buffer = NULL;
+    size_t buffer_size = 0;
+    FILE* flow_file = open_memstream(&buffer, &buffer_size);
+    graph.writeGraph(flow_file);
+    fclose(flow_file);
+    previous_flow.assign(buffer, buffer_size);
+    free(buffer);
+    FILE* potentials_file = open_memstream(&buffer, &buffer_size);
+    graph.writePotentials(potentials_file);
+    fclose(potentials_file);
+    previous_potentials.assign(buffer, buffer_size);
+    free(buffer);
+  }
+
+  template<typename CapT, typename CostT>
+  bool SolverDaemon<CapT, CostT>::loadSolution(Graph<CapT, CostT>& graph) {
+    if (previous_flow.empty()) {
+      return false;
+    }
+    // The flow of arcs the updates removed is dropped and the flow of the
+    // arcs they shrank is cut down to their capacity.
+    FILE* flow_file = fmemopen(&previous_flow[0], previous_flow.size(), "r");
+    bool loaded = graph.readFlow(flow_file);
+    fclose(flow_file);
+    if (!loaded) {
+      return false;
+    }
+    if (previous_potentials.empty()) {
+      graph.get_potentials().clear();
+      return true;
+    }
+    FILE* potentials_file = fmemopen(&previous_potentials[0],
+                                     previous_potentials.size(), "r");
+    // Potentials that don't fit the graph are dropped, the flow alone
+    // still warm starts the solve.
+    graph.readPotentials(potentials_file);
+    fclose(potentials_file);
+    return true;
+  }
+
+  template<typename CapT, typename CostT>
+  bool SolverDaemon<CapT, CostT>::applyPayload(Graph<CapT, CostT>& graph,
+                                               GraphUpdate& update,
+                                               string* error) {
+    bool is_delta = update.is_delta;
+    vector<char>& payload = update.payload;
+    if (!is_delta) {
+      // A graph without a problem line must not end up in the old graph.
+      graph.initNodes(0, 0);
+    }
+    if (update.is_binary) {
+      return applyBinaryRecords(graph, is_delta, payload, error);
+    }
+    if (payload.empty()) {
+      *error = "empty graph";
+      return false;
+    }
+    if (!is_delta && problemLineNodes(payload) > max_nodes_) {
+      *error = "too many nodes";
+      return false;
+    }
+    FILE* graph_file = fmemopen(&payload[0], payload.size(), "r");
+    bool applied = is_delta ? graph.updateGraph(graph_file) :
+      graph.readGraph(graph_file);
+    fclose(graph_file);
+    if (!applied) {
+      *error = "invalid DIMACS payload";
+    }
+    return applied;
+  }
+
+  template<typename CapT, typename CostT>
+  bool SolverDaemon<CapT, CostT>::applyBinaryRecords(
+      Graph<CapT, CostT>& graph, bool is_delta, const vector<char>& payload,
+      string* error) {
+    if (payload.size() % sizeof(BinaryGraphRecord) != 0) {
+      *error = "truncated binary record";
+      return false;
+    }
+    uint32_t num_records = payload.size() / sizeof(BinaryGraphRecord);
+    for (uint32_t index = 0; index < num_records; ++index) {
+      BinaryGraphRecord record;
+      memcpy(&record, &payload[index * sizeof(BinaryGraphRecord)],
+             sizeof(BinaryGraphRecord));
+      if (record.type == 'p' && !is_delta) {
+        if (record.src_node_id > max_nodes_) {
+          *error = "too many nodes in record " + lexical_cast<string>(index);
+          return false;
+        }
+        graph.initNodes(record.src_node_id, 0);
+        continue;
+      }
+      uint32_t num_nodes = graph.get_num_nodes();
+      if (record.src_node_id == 0 || record.src_node_id > num_nodes ||
+          (record.type != 'n' &&
+           (record.dst_node_id == 0 || record.dst_node_id > num_nodes))) {
+        *error = "unknown node in record " + lexical_cast<string>(index);
+        return false;
+      }
+      if (record.type == 'a' && is_delta) {
+        graph.setArc(record.src_node_id, record.dst_node_id,
+                     record.capacity, record.cost);
+      } else if (record.type == 'a') {
+        if (!graph.addArcSegment(record.src_node_id, record.dst_node_id,
+                                 record.capacity, record.cost)) {
+          *error = "arc capacity overflows in record " +
+            lexical_cast<string>(index);
+          return false;
+        }
+      } else if (record.type == 'n') {
+        graph.setNodeDemand(record.src_node_id, record.capacity);
+      } else if (record.type == 'r') {
+        graph.removeArc(record.src_node_id, record.dst_node_id);
+      } else {
+        *error = "unknown record type in record " +
+          lexical_cast<string>(index);
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template<typename CapT, typename CostT>
+  bool SolverDaemon<CapT, CostT>::sendReply(int client_fd,
+                                            const string& reply) {
+    if (!assignment_writer.flush()) {
+      return false;
+    }
+    return writeToSocket(client_fd, reply.data(), reply.size());
+  }
+
+  template class SolverDaemon<int32_t, int32_t>;
+  template class SolverDaemon<int32_t, int64_t>;
+  template class SolverDaemon<int64_t, int32_t>;
+  template class SolverDaemon<int64_t, int64_t>;
+
+}
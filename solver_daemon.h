@@ -0,0 +1,154 @@
+#ifndef FLOWLESSLY_SOLVER_DAEMON_H
+#define FLOWLESSLY_SOLVER_DAEMON_H
+
+#include "assignments.h"
+#include "double_buffered_graph.h"
+#include "graph.h"
+#include "solve_budget.h"
+#include "solver_workspace.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <stdint.h>
+#include <string>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Requests are sent over a Unix domain stream socket. A request is a
+  // header line followed by a payload:
+  //   graph <dimacs|binary> <payload bytes> [reply]  replaces the graph
+  //   delta <dimacs|binary> <payload bytes> [reply]  updates the graph
+  //   update <dimacs|binary> <payload bytes>         updates the graph
+  //                                                  without solving it
+  //   quit                                           stops the daemon
+  // Every request but update gets a reply, in the order of the requests.
+  // The reply is "ok <bytes>" followed by the reply payload, or
+  // "error <message>". Like a failed delta, a failed update drops the
+  // graph, so the deltas that follow it fail. The payload depends on the
+  // reply kind:
+  //   flows        the flows and the total cost in the writeGraph format
+  //   assignments  the task to resource assignments
+  //   changes      the assignments that changed since the previous solve
+  // Flows are the default. Assignments are text lines for a DIMACS
+  // request and BinaryAssignmentRecords for a binary one. They are
+  // written by a background thread while the next request is read and
+  // solved.
+  //
+  // A binary payload is a sequence of records with the same meaning as the
+  // DIMACS lines: 'p' (src_node_id = nodes, dst_node_id = arcs), 'n'
+  // (src_node_id, capacity = demand), 'a' (src_node_id, dst_node_id,
+  // capacity, cost) and 'r' (src_node_id, dst_node_id). The records use the
+  // byte order of the host.
+  struct BinaryGraphRecord {
+    uint32_t type;
+    uint32_t src_node_id;
+    uint32_t dst_node_id;
+    uint32_t padding;
+    int64_t capacity;
+    int64_t cost;
+  };
+
+  // Longer header lines of requests and replies are malformed.
+  const size_t kMaxHeaderLength = 256;
+
+  bool readFromSocket(int socket_fd, char* buffer, size_t length);
+  bool writeToSocket(int socket_fd, const char* buffer, size_t length);
+  // Fails on lines longer than max_length.
+  bool readLineFromSocket(int socket_fd, size_t max_length, string* line);
+
+  // Serves solve requests over a Unix domain socket. The graph and the
+  // solver workspace are kept between requests, so a delta only pays for
+  // the arcs it changes and a solve doesn't allocate scratch memory once
+  // the workspace has grown to the size of the graph. Requests are read
+  // while the previous ones are solved: the solves run on a thread of
+  // their own and the graph is double buffered, so the updates are
+  // applied to the shadow copy in the meantime.
+  template<typename CapT, typename CostT>
+  class SolverDaemon {
+
+  public:
+  // The budget is restarted for every request.
+  SolverDaemon(const string& socket_path,
+               const function<void(Graph<CapT, CostT>&, SolverWorkspace&,
+                                   SolveBudget&)>& solve,
+               const SolveBudget& budget):
+    socket_path_(socket_path), solve_(solve), budget_(budget),
+    max_payload_bytes_(numeric_limits<size_t>::max()),
+    max_nodes_(numeric_limits<uint32_t>::max()),
+    graphs([this](Graph<CapT, CostT>& graph, GraphUpdate& update,
+                  string* error) {
+             return applyPayload(graph, update, error);
+           }),
+    solver_pool(1), reply_failed(false) {
+    }
+
+    // Solves the graphs that hold the flow and the potentials of the
+    // previous solve. Without it, every request is solved from scratch.
+    void set_warm_solve(const function<void(Graph<CapT, CostT>&,
+                                            SolverWorkspace&,
+                                            SolveBudget&)>& warm_solve) {
+      warm_solve_ = warm_solve;
+    }
+
+    // Requests with a larger payload get a malformed header error and
+    // graphs with more nodes are rejected before their nodes are
+    // allocated.
+    void set_limits(size_t max_payload_bytes, uint32_t max_nodes) {
+      max_payload_bytes_ = max_payload_bytes;
+      max_nodes_ = max_nodes;
+    }
+
+    // Serves clients until a quit request arrives. Returns false if the
+    // socket could not be set up.
+    bool run();
+
+  private:
+    string socket_path_;
+    function<void(Graph<CapT, CostT>&, SolverWorkspace&,
+                  SolveBudget&)> solve_;
+    // Empty unless set_warm_solve was called.
+    function<void(Graph<CapT, CostT>&, SolverWorkspace&,
+                  SolveBudget&)> warm_solve_;
+    SolveBudget budget_;
+    size_t max_payload_bytes_;
+    uint32_t max_nodes_;
+    // Only used on the solver thread, like the workspace.
+    DoubleBufferedGraph<CapT, CostT> graphs;
+    SolverWorkspace workspace;
+    // The flow and the potentials of the previous solve in the writeGraph
+    // and writePotentials formats. The graphs take turns, so the next
+    // solve loads them into the other copy.
+    string previous_flow;
+    string previous_potentials;
+    AssignmentWriter assignment_writer;
+    // Declared last so that the solves finish before the rest goes away.
+    ThreadPool solver_pool;
+    // Set when a reply of the solver thread could not be sent.
+    atomic<bool> reply_failed;
+
+    // Returns false once the client has disconnected or asked to quit.
+    bool serveRequest(int client_fd, bool* quit);
+    // Runs on the solver thread.
+    void solveUpdate(int client_fd, GraphUpdate* update,
+                     const string& header, const string& reply_kind,
+                     chrono::steady_clock::time_point start_time);
+    void saveSolution(Graph<CapT, CostT>& graph);
+    // Returns false if there is no previous solution that fits the graph.
+    bool loadSolution(Graph<CapT, CostT>& graph);
+    // Runs on the ingestion thread.
+    bool applyPayload(Graph<CapT, CostT>& graph, GraphUpdate& update,
+                      string* error);
+    bool applyBinaryRecords(Graph<CapT, CostT>& graph, bool is_delta,
+                            const vector<char>& payload, string* error);
+    // Waits for the replies that are still being written.
+    bool sendReply(int client_fd, const string& reply);
+
+  };
+
+}
+#endif
@@ -0,0 +1,217 @@
+#include "solver_stats.h"
+
+#include "memory_policy.h"
+
+#include <glog/logging.h>
+#include <sys/resource.h>
+
+namespace flowlessly {
+
+  const char* kCounterNames[NUM_STATS_COUNTERS] = {
+    "pushes", "relabels", "arc_scans", "augmentations", "heap_operations",
+    "cancelled_cycles"
+  };
+
+  const char* kTimerNames[NUM_STATS_TIMERS] = {
+    "parse", "setup", "solve", "refine", "saturation", "global_update",
+    "arc_fixing", "shortest_path", "verify", "output"
+  };
+
+  const char* kHardwareCounterNames[NUM_HARDWARE_COUNTERS] = {
+    "cycles", "instructions", "l1d_read_misses", "llc_misses",
+    "branch_misses"
+  };
+
+  // The counters of a thread are opened the first time one of its timers
+  // starts. Returns NULL if none of them is available.
+  PerfCounters* getThreadPerfCounters() {
+    static thread_local PerfCounters perf_counters;
+    static thread_local bool opened = false;
+    static thread_local bool available = false;
+    static atomic<bool> warned(false);
+    if (!opened) {
+      opened = true;
+      available = perf_counters.open();
+      if (!available && !warned.exchange(true)) {
+        LOG(WARNING) << "Hardware counters are not available";
+      }
+    }
+    return available ? &perf_counters : NULL;
+  }
+
+  SolverStats::SolverStats(): enabled(false), count_hardware(false) {
+    reset();
+  }
+
+  void SolverStats::enable() {
+    enabled = true;
+  }
+
+  bool SolverStats::isEnabled() {
+    return enabled;
+  }
+
+  void SolverStats::enableHardwareCounters() {
+    count_hardware = true;
+  }
+
+  bool SolverStats::isCountingHardware() {
+    return enabled && count_hardware;
+  }
+
+  void SolverStats::reset() {
+    for (uint32_t counter = 0; counter < NUM_STATS_COUNTERS; ++counter) {
+      counters[counter].store(0);
+    }
+    for (uint32_t timer = 0; timer < NUM_STATS_TIMERS; ++timer) {
+      timer_total_us[timer].store(0);
+      timer_count[timer].store(0);
+      for (uint32_t counter = 0; counter < NUM_HARDWARE_COUNTERS;
+           ++counter) {
+        timer_hardware[timer][counter].store(0);
+      }
+    }
+    available_hardware.store(0);
+    unique_lock<mutex> lock(phases_lock);
+    phases.clear();
+  }
+
+  void SolverStats::addCount(StatsCounter counter, uint64_t count) {
+    if (enabled) {
+      counters[counter].fetch_add(count, memory_order_relaxed);
+    }
+  }
+
+  void SolverStats::addTime(StatsTimer timer, int64_t time_us) {
+    if (enabled) {
+      timer_total_us[timer].fetch_add(time_us, memory_order_relaxed);
+      timer_count[timer].fetch_add(1, memory_order_relaxed);
+    }
+  }
+
+  void SolverStats::addHardwareCounts(StatsTimer timer,
+                                      const uint64_t* counts,
+                                      uint32_t available) {
+    for (uint32_t counter = 0; counter < NUM_HARDWARE_COUNTERS; ++counter) {
+      timer_hardware[timer][counter].fetch_add(counts[counter],
+                                               memory_order_relaxed);
+    }
+    available_hardware.fetch_or(available, memory_order_relaxed);
+  }
+
+  void SolverStats::addPhase(int64_t eps, int64_t time_us, uint64_t pushes,
+                             uint64_t relabels) {
+    if (!enabled) {
+      return;
+    }
+    PhaseStats phase;
+    phase.eps = eps;
+    phase.time_us = time_us;
+    phase.pushes = pushes;
+    phase.relabels = relabels;
+    unique_lock<mutex> lock(phases_lock);
+    phases.push_back(phase);
+  }
+
+  void SolverStats::writeJson(FILE* stats_file) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stats_file, "{\n  \"timers\": {");
+    uint32_t available = available_hardware.load();
+    for (uint32_t timer = 0; timer < NUM_STATS_TIMERS; ++timer) {
+      fprintf(stats_file, "%s\n    \"%s\": {\"total_us\": %jd, \"count\": %ju",
+              timer > 0 ? "," : "", kTimerNames[timer],
+              static_cast<intmax_t>(timer_total_us[timer].load()),
+              static_cast<uintmax_t>(timer_count[timer].load()));
+      // Counters no thread could read are left out.
+      for (uint32_t counter = 0; counter < NUM_HARDWARE_COUNTERS;
+           ++counter) {
+        if (available & (1 << counter)) {
+          uint64_t count = timer_hardware[timer][counter].load();
+          fprintf(stats_file, ", \"%s\": %ju",
+                  kHardwareCounterNames[counter],
+                  static_cast<uintmax_t>(count));
+        }
+      }
+      fprintf(stats_file, "}");
+    }
+    fprintf(stats_file, "\n  },\n  \"counters\": {");
+    for (uint32_t counter = 0; counter < NUM_STATS_COUNTERS; ++counter) {
+      fprintf(stats_file, "%s\n    \"%s\": %ju", counter > 0 ? "," : "",
+              kCounterNames[counter],
+              static_cast<uintmax_t>(counters[counter].load()));
+    }
+    fprintf(stats_file, "\n  },\n  \"phases\": [");
+    unique_lock<mutex> lock(phases_lock);
+    for (uint32_t index = 0; index < phases.size(); ++index) {
+      fprintf(stats_file, "%s\n    {\"eps\": %jd, \"time_us\": %jd, "
+              "\"pushes\": %ju, \"relabels\": %ju}", index > 0 ? "," : "",
+              static_cast<intmax_t>(phases[index].eps),
+              static_cast<intmax_t>(phases[index].time_us),
+              static_cast<uintmax_t>(phases[index].pushes),
+              static_cast<uintmax_t>(phases[index].relabels));
+    }
+    // ru_maxrss is in kilobytes on Linux.
+    fprintf(stats_file, "%s],\n  \"peak_rss_kb\": %ld,\n"
+            "  \"huge_pages\": %ju\n}\n", phases.empty() ? "" : "\n  ",
+            usage.ru_maxrss, static_cast<uintmax_t>(countHugePages()));
+  }
+
+  bool SolverStats::writeJson(const string& stats_file_path) {
+    FILE* stats_file = fopen(stats_file_path.c_str(), "w");
+    if (stats_file == NULL) {
+      return false;
+    }
+    writeJson(stats_file);
+    fclose(stats_file);
+    return true;
+  }
+
+  ScopedStatsTimer::ScopedStatsTimer(SolverStats& stats, StatsTimer timer):
+    stats_(stats), timer_(timer), enabled_(stats.isEnabled()),
+    perf_counters(NULL) {
+    if (enabled_) {
+      if (stats.isCountingHardware()) {
+        perf_counters = getThreadPerfCounters();
+      }
+      if (perf_counters) {
+        perf_counters->read(start_counts);
+      }
+      start_time = chrono::steady_clock::now();
+    }
+  }
+
+  ScopedStatsTimer::~ScopedStatsTimer() {
+    stop();
+  }
+
+  void ScopedStatsTimer::stop() {
+    if (enabled_) {
+      stats_.addTime(timer_, get_elapsed_us());
+      if (perf_counters) {
+        uint64_t counts[NUM_HARDWARE_COUNTERS];
+        perf_counters->read(counts);
+        uint32_t available = 0;
+        for (uint32_t counter = 0; counter < NUM_HARDWARE_COUNTERS;
+             ++counter) {
+          counts[counter] -= start_counts[counter];
+          if (perf_counters->isAvailable(
+                  static_cast<HardwareCounter>(counter))) {
+            available |= 1 << counter;
+          }
+        }
+        stats_.addHardwareCounts(timer_, counts, available);
+      }
+      enabled_ = false;
+    }
+  }
+
+  int64_t ScopedStatsTimer::get_elapsed_us() {
+    if (!enabled_) {
+      return 0;
+    }
+    return chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now() - start_time).count();
+  }
+
+}
@@ -0,0 +1,115 @@
+#ifndef FLOWLESSLY_SOLVER_STATS_H
+#define FLOWLESSLY_SOLVER_STATS_H
+
+#include "perf_counters.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  enum StatsCounter {
+    PUSHES,
+    RELABELS,
+    ARC_SCANS,
+    AUGMENTATIONS,
+    HEAP_OPERATIONS,
+    CANCELLED_CYCLES,
+    NUM_STATS_COUNTERS
+  };
+
+  enum StatsTimer {
+    PARSE_TIMER,
+    SETUP_TIMER,
+    SOLVE_TIMER,
+    REFINE_TIMER,
+    SATURATION_TIMER,
+    GLOBAL_UPDATE_TIMER,
+    ARC_FIXING_TIMER,
+    SHORTEST_PATH_TIMER,
+    VERIFY_TIMER,
+    OUTPUT_TIMER,
+    NUM_STATS_TIMERS
+  };
+
+  // Counters and monotonic timers fed by the solvers. The statistics are
+  // disabled by default, in which case the timers don't read the clock.
+  // The timers can also measure the hardware counters of their thread.
+  // The solvers add their counts once per run rather than on every event,
+  // so the counters cost nothing in the inner loops. Several threads may
+  // feed the same statistics.
+  class SolverStats {
+
+  public:
+    SolverStats();
+
+    void enable();
+    bool isEnabled();
+    // Only takes effect if the statistics are enabled.
+    void enableHardwareCounters();
+    bool isCountingHardware();
+    void reset();
+    void addCount(StatsCounter counter, uint64_t count);
+    void addTime(StatsTimer timer, int64_t time_us);
+    // counts has NUM_HARDWARE_COUNTERS entries. available has a bit set for
+    // every counter the thread could read.
+    void addHardwareCounts(StatsTimer timer, const uint64_t* counts,
+                           uint32_t available);
+    // Records one cost scaling phase.
+    void addPhase(int64_t eps, int64_t time_us, uint64_t pushes,
+                  uint64_t relabels);
+    // Writes the statistics, the peak resident memory and the number of
+    // huge pages in use as JSON.
+    void writeJson(FILE* stats_file);
+    bool writeJson(const string& stats_file_path);
+
+  private:
+    struct PhaseStats {
+      int64_t eps;
+      int64_t time_us;
+      uint64_t pushes;
+      uint64_t relabels;
+    };
+
+    bool enabled;
+    bool count_hardware;
+    atomic<uint64_t> counters[NUM_STATS_COUNTERS];
+    atomic<int64_t> timer_total_us[NUM_STATS_TIMERS];
+    atomic<uint64_t> timer_count[NUM_STATS_TIMERS];
+    atomic<uint64_t> timer_hardware[NUM_STATS_TIMERS][NUM_HARDWARE_COUNTERS];
+    atomic<uint32_t> available_hardware;
+    mutex phases_lock;
+    vector<PhaseStats> phases;
+
+  };
+
+  // Adds the time between its construction and its destruction to a timer.
+  class ScopedStatsTimer {
+
+  public:
+    ScopedStatsTimer(SolverStats& stats, StatsTimer timer);
+    ~ScopedStatsTimer();
+    // Adds the time now rather than on destruction.
+    void stop();
+    // Returns the time elapsed so far, or 0 if the statistics are disabled.
+    int64_t get_elapsed_us();
+
+  private:
+    SolverStats& stats_;
+    StatsTimer timer_;
+    bool enabled_;
+    chrono::steady_clock::time_point start_time;
+    PerfCounters* perf_counters;
+    uint64_t start_counts[NUM_HARDWARE_COUNTERS];
+
+  };
+
+}
+#endif
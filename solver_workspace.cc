@@ -0,0 +1,139 @@
+#include "solver_workspace.h"
+
+#include "memory_policy.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace flowlessly {
+
+  SolverWorkspace::SolverWorkspace(): mark_generation(1),
+    bucket_generation(1), stats(&own_stats) {
+  }
+
+  void SolverWorkspace::reserveNodes(uint32_t num_nodes) {
+    if (distance.size() > num_nodes) {
+      return;
+    }
+    distance.resize(num_nodes + 1, numeric_limits<int64_t>::max());
+    predecessor.resize(num_nodes + 1, 0);
+    node_mark.resize(num_nodes + 1, 0);
+    bucket_prev.resize(num_nodes + 1, 0);
+    bucket_next.resize(num_nodes + 1, 0);
+    rank.resize(num_nodes + 1, 0);
+    potentials.resize(num_nodes + 1, 0);
+    path_capacity.resize(num_nodes + 1, 0);
+    applyMemoryPolicy(distance);
+    applyMemoryPolicy(predecessor);
+    applyMemoryPolicy(node_mark);
+    applyMemoryPolicy(bucket_prev);
+    applyMemoryPolicy(bucket_next);
+    applyMemoryPolicy(rank);
+    applyMemoryPolicy(potentials);
+    applyMemoryPolicy(path_capacity);
+  }
+
+  void SolverWorkspace::reserveBuckets(uint32_t max_rank) {
+    if (bucket.size() > max_rank) {
+      return;
+    }
+    bucket.resize(max_rank + 1, 0);
+    bucket_mark.resize(max_rank + 1, 0);
+  }
+
+  void SolverWorkspace::startSearch() {
+    for (vector<uint32_t>::iterator it = touched_nodes.begin();
+         it != touched_nodes.end(); ++it) {
+      distance[*it] = numeric_limits<int64_t>::max();
+    }
+    touched_nodes.clear();
+  }
+
+  const vector<int64_t>& SolverWorkspace::get_distance() {
+    return distance;
+  }
+
+  void SolverWorkspace::set_distance(uint32_t node_id, int64_t node_distance,
+                                     uint32_t predecessor_id) {
+    if (distance[node_id] == numeric_limits<int64_t>::max()) {
+      touched_nodes.push_back(node_id);
+    }
+    distance[node_id] = node_distance;
+    predecessor[node_id] = predecessor_id;
+  }
+
+  vector<uint32_t>& SolverWorkspace::get_predecessor() {
+    return predecessor;
+  }
+
+  void SolverWorkspace::clearMarks() {
+    mark_generation++;
+    // The stamps have to be cleared once every 2^32 generations.
+    if (mark_generation == 0) {
+      fill(node_mark.begin(), node_mark.end(), 0);
+      mark_generation = 1;
+    }
+  }
+
+  bool SolverWorkspace::isMarked(uint32_t node_id) {
+    return node_mark[node_id] == mark_generation;
+  }
+
+  void SolverWorkspace::mark(uint32_t node_id) {
+    node_mark[node_id] = mark_generation;
+  }
+
+  void SolverWorkspace::clearBuckets() {
+    bucket_generation++;
+    if (bucket_generation == 0) {
+      fill(bucket_mark.begin(), bucket_mark.end(), 0);
+      bucket_generation = 1;
+    }
+  }
+
+  uint32_t SolverWorkspace::get_bucket(uint32_t rank) {
+    return bucket_mark[rank] == bucket_generation ? bucket[rank] : 0;
+  }
+
+  void SolverWorkspace::set_bucket(uint32_t rank, uint32_t node_id) {
+    bucket_mark[rank] = bucket_generation;
+    bucket[rank] = node_id;
+  }
+
+  vector<uint32_t>& SolverWorkspace::get_bucket_prev() {
+    return bucket_prev;
+  }
+
+  vector<uint32_t>& SolverWorkspace::get_bucket_next() {
+    return bucket_next;
+  }
+
+  vector<int64_t>& SolverWorkspace::get_rank() {
+    return rank;
+  }
+
+  vector<int64_t>& SolverWorkspace::get_potentials() {
+    return potentials;
+  }
+
+  vector<int64_t>& SolverWorkspace::get_path_capacity() {
+    return path_capacity;
+  }
+
+  vector<uint32_t>& SolverWorkspace::get_node_queue() {
+    return node_queue;
+  }
+
+  vector<pair<int64_t, uint32_t> >& SolverWorkspace::get_heap() {
+    return heap;
+  }
+
+  SolverStats& SolverWorkspace::get_stats() {
+    return *stats;
+  }
+
+  void SolverWorkspace::set_stats(SolverStats* stats) {
+    this->stats = stats;
+  }
+
+}
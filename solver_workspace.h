@@ -0,0 +1,87 @@
+#ifndef FLOWLESSLY_SOLVER_WORKSPACE_H
+#define FLOWLESSLY_SOLVER_WORKSPACE_H
+
+#include "solver_stats.h"
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Owns the scratch arrays of the shortest path, max flow and cost scaling
+  // algorithms. The arrays are sized to the largest graph seen and never
+  // shrink, so a workspace kept across solves stops allocating once it has
+  // warmed up. Distances, node marks and bucket heads are not cleared
+  // eagerly: distances are reset in O(touched) and marks and buckets are
+  // invalidated by bumping a generation counter.
+  // A workspace must only be used by one thread at a time.
+  class SolverWorkspace {
+
+  public:
+    SolverWorkspace();
+    SolverWorkspace(const SolverWorkspace& copy) = delete;
+
+    // Makes room for the nodes 0..num_nodes.
+    void reserveNodes(uint32_t num_nodes);
+    // Makes room for the buckets 0..max_rank.
+    void reserveBuckets(uint32_t max_rank);
+
+    // Resets the distances set since the previous search to INF.
+    void startSearch();
+    const vector<int64_t>& get_distance();
+    void set_distance(uint32_t node_id, int64_t distance,
+                      uint32_t predecessor_id);
+    // The predecessor of a node is only meaningful if the node has a finite
+    // distance or was reached by the current search.
+    vector<uint32_t>& get_predecessor();
+
+    void clearMarks();
+    bool isMarked(uint32_t node_id);
+    void mark(uint32_t node_id);
+
+    // Empties all the buckets. Node id 0 denotes the end of a bucket.
+    void clearBuckets();
+    uint32_t get_bucket(uint32_t rank);
+    void set_bucket(uint32_t rank, uint32_t node_id);
+    vector<uint32_t>& get_bucket_prev();
+    vector<uint32_t>& get_bucket_next();
+
+    vector<int64_t>& get_rank();
+    vector<int64_t>& get_potentials();
+    vector<int64_t>& get_path_capacity();
+    // Scratch node list. It is up to the user to clear it.
+    vector<uint32_t>& get_node_queue();
+    // Scratch (distance, node id) heap for std::push_heap and std::pop_heap.
+    vector<pair<int64_t, uint32_t> >& get_heap();
+
+    // The statistics the solvers using the workspace feed. A workspace has
+    // its own disabled statistics until it is given others to feed.
+    SolverStats& get_stats();
+    void set_stats(SolverStats* stats);
+
+  private:
+    vector<int64_t> distance;
+    vector<uint32_t> predecessor;
+    vector<uint32_t> touched_nodes;
+    vector<uint32_t> node_mark;
+    uint32_t mark_generation;
+    vector<uint32_t> bucket;
+    vector<uint32_t> bucket_mark;
+    uint32_t bucket_generation;
+    vector<uint32_t> bucket_prev;
+    vector<uint32_t> bucket_next;
+    vector<int64_t> rank;
+    vector<int64_t> potentials;
+    vector<int64_t> path_capacity;
+    vector<uint32_t> node_queue;
+    vector<pair<int64_t, uint32_t> > heap;
+    SolverStats own_stats;
+    SolverStats* stats;
+
+  };
+
+}
+#endif
@@ -1,5 +1,6 @@
 #include "successive_shortest.h"
 
+#include "trace.h"
 #include "utils.h"
 
 #include <limits>
@@ -8,113 +9,170 @@ namespace flowlessly {
 
   using namespace std;
 
-  void SuccessiveShortest::reduceCost(vector<int64_t>& potential) {
-    uint32_t num_nodes = graph_.get_num_nodes() + 1;
-    vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
-    for (uint32_t node_id = 1; node_id < num_nodes; ++node_id) {
-      map<uint32_t, Arc*>::const_iterator it = arcs[node_id].begin();
-      map<uint32_t, Arc*>::const_iterator end_it = arcs[node_id].end();
-      for (; it != end_it; ++it) {
-        Arc* arc = it->second;
-        if (arc->cap > 0) {
-          arc->cost += potential[node_id] - potential[it->first];
-        } else {
-          arc->cost = 0;
-        }
-      }
+  template<typename CapT, typename CostT>
+  void SuccessiveShortest<CapT, CostT>::set_shortest_path_pool(
+      ThreadPool* pool) {
+    delta_stepping_.reset(pool == NULL ? NULL :
+                          new DeltaStepping<CapT, CostT>(graph_, *pool));
+  }
+
+  template<typename CapT, typename CostT>
+  void SuccessiveShortest<CapT, CostT>::findShortestPaths(
+      const vector<uint32_t>& source_nodes,
+      const vector<int64_t>* potentials) {
+    if (delta_stepping_ && potentials) {
+      delta_stepping_->findShortestPaths(source_nodes, *potentials,
+                                         workspace_);
+    } else if (delta_stepping_) {
+      delta_stepping_->findShortestPaths(source_nodes, workspace_);
+    } else if (potentials) {
+      DijkstraOptimized(graph_, source_nodes, *potentials, workspace_);
+    } else {
+      BellmanFord(graph_, source_nodes, workspace_);
+    }
+  }
+
+  // Augments the path found by the last shortest path search.
+  template<typename CapT, typename CostT>
+  void SuccessiveShortest<CapT, CostT>::augmentPath(uint32_t source_node,
+                                                    uint32_t sink_node) {
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph_.get_arcs();
+    vector<CapT>& nodes_demand = graph_.get_nodes_demand();
+    const vector<uint32_t>& predecessor = workspace_.get_predecessor();
+    CapT min_flow = numeric_limits<CapT>::max();
+    for (uint32_t cur_node = sink_node; cur_node != source_node;
+         cur_node = predecessor[cur_node]) {
+      Arc<CapT, CostT>* arc = arcs[predecessor[cur_node]][cur_node];
+      min_flow = min(min_flow, arc->cap);
+    }
+    for (uint32_t cur_node = sink_node; cur_node != source_node;
+         cur_node = predecessor[cur_node]) {
+      Arc<CapT, CostT>* arc = arcs[predecessor[cur_node]][cur_node];
+      arc->pushFlow(min_flow);
+      nodes_demand[predecessor[cur_node]] -= min_flow;
+      nodes_demand[cur_node] += min_flow;
     }
   }
 
-  void SuccessiveShortest::successiveShortestPath() {
+  // The flow is a min cost flow for the supply it routes and the shortest
+  // paths never get shorter, so every unit that is left costs at least
+  // path_cost. That gives a lower bound on the optimal cost.
+  template<typename CapT, typename CostT>
+  void SuccessiveShortest<CapT, CostT>::recordUnroutedSupply(
+      uint32_t source_node, int64_t path_cost) {
+    SolutionQuality& quality = graph_.get_solution_quality();
+    quality.optimal = false;
+    quality.unrouted_supply = graph_.get_nodes_demand()[source_node];
+    quality.cost_lower_bound =
+      graph_.getFlowCost() + quality.unrouted_supply * path_cost;
+    LOG(ERROR) << "Out of budget with " << quality.unrouted_supply
+               << " supply left to route";
+  }
+
+  template<typename CapT, typename CostT>
+  void SuccessiveShortest<CapT, CostT>::successiveShortestPath() {
     //    Transform network G by adding source and sink
     //    Initial flow x is zero
     //        while ( Gx contains a path from s to t ) do
     //        Find any shortest path P from s to t
     //        Augment current flow x along P
     //        update Gx
-    if (!graph_.hasSinkAndSource()) {
+    // Adding the sink and the source changes the demands. They are restored
+    // once the flow has been computed.
+    vector<CapT> input_nodes_demand = graph_.get_nodes_demand();
+    graph_.get_solution_quality() = SolutionQuality();
+    bool add_sink_and_source = !graph_.hasSinkAndSource();
+    if (add_sink_and_source) {
       graph_.addSinkAndSource();
     }
-    uint32_t num_nodes = graph_.get_num_nodes() + 1;
-    vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
-    vector<int32_t>& nodes_demand = graph_.get_nodes_demand();
-    vector<int64_t> distance(num_nodes, numeric_limits<int64_t>::max());
-    vector<uint32_t> predecessor(num_nodes, 0);
+    const vector<int64_t>& distance = workspace_.get_distance();
     // Works with the assumption that there's only a sink and a source node.
     vector<uint32_t> source_node = graph_.get_source_nodes();
     uint32_t sink_node = graph_.get_sink_nodes()[0];
+    uint64_t num_augmentations = 0;
     do {
-      fill(distance.begin(), distance.end(), numeric_limits<int64_t>::max());
-      fill(predecessor.begin(), predecessor.end(), 0);
-      BellmanFord(graph_, source_node, distance, predecessor);
+      findShortestPaths(source_node, NULL);
       if (distance[sink_node] < numeric_limits<int64_t>::max()) {
-        int32_t min_flow = numeric_limits<int32_t>::max();
-        for (uint32_t cur_node = sink_node; cur_node != source_node[0];
-             cur_node = predecessor[cur_node]) {
-          Arc* arc = arcs[predecessor[cur_node]][cur_node];
-          min_flow = min(min_flow, arc->cap);
-        }
-        for (uint32_t cur_node = sink_node; cur_node != source_node[0];
-             cur_node = predecessor[cur_node]) {
-          Arc* arc = arcs[predecessor[cur_node]][cur_node];
-          arc->cap -= min_flow;
-          arc->reverse_arc->cap += min_flow;
-          nodes_demand[predecessor[cur_node]] -= min_flow;
-          nodes_demand[cur_node] += min_flow;
+        if (budget_.isExhausted(num_augmentations)) {
+          recordUnroutedSupply(source_node[0], distance[sink_node]);
+          break;
         }
+        augmentPath(source_node[0], sink_node);
+        num_augmentations++;
       }
     } while (distance[sink_node] < numeric_limits<int64_t>::max());
+    workspace_.get_stats().addCount(AUGMENTATIONS, num_augmentations);
+    if (add_sink_and_source) {
+      graph_.removeSinkAndSource();
+    }
+    graph_.get_nodes_demand() = input_nodes_demand;
+    exportPotentials(graph_, vector<int64_t>());
   }
 
-  void SuccessiveShortest::successiveShortestPathPotentials() {
+  template<typename CapT, typename CostT>
+  void SuccessiveShortest<CapT, CostT>::successiveShortestPathPotentials() {
     //    Transform network G by adding source and sink
     //    Initial flow x is zero
     //    Use Bellman-Ford's algorithm to establish potentials PI
-    //    Reduce Cost ( PI )
     //    while ( Gx contains a path from s to t ) do
-    //        Find any shortest path P from s to t
-    //        Reduce Cost ( PI )
+    //        Find any shortest path P from s to t using the reduced costs
+    //        Add the distances to PI
     //        Augment current flow x along P
     //        update Gx
-    if (!graph_.hasSinkAndSource()) {
+    // Adding the sink and the source changes the demands. They are restored
+    // once the flow has been computed.
+    vector<CapT> input_nodes_demand = graph_.get_nodes_demand();
+    graph_.get_solution_quality() = SolutionQuality();
+    bool add_sink_and_source = !graph_.hasSinkAndSource();
+    if (add_sink_and_source) {
       graph_.addSinkAndSource();
     }
-    uint32_t num_nodes = graph_.get_num_nodes() + 1;
-    vector<int64_t> distance(num_nodes, numeric_limits<int64_t>::max());
-    vector<uint32_t> predecessor(num_nodes, 0);
-    vector<map<uint32_t, Arc*> >& arcs = graph_.get_arcs();
-    vector<int32_t>& nodes_demand = graph_.get_nodes_demand();
+    uint32_t num_nodes = graph_.get_num_nodes();
+    const vector<int64_t>& distance = workspace_.get_distance();
+    vector<int64_t>& potentials = workspace_.get_potentials();
     // Works with the assumption that there's only a source and sink node.
     vector<uint32_t>& source_node = graph_.get_source_nodes();
     uint32_t sink_node = graph_.get_sink_nodes()[0];
-    BellmanFord(graph_, source_node, distance, predecessor);
-    reduceCost(distance);
-    uint32_t iteration_cnt = 0;
+    findShortestPaths(source_node, NULL);
+    // A node that can't be reached from the source is never reached later
+    // on, so its potential doesn't matter.
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      potentials[node_id] = distance[node_id] < numeric_limits<int64_t>::max() ?
+        distance[node_id] : 0;
+    }
+    uint64_t num_augmentations = 0;
     do {
-      iteration_cnt++;
-      fill(distance.begin(), distance.end(), numeric_limits<int64_t>::max());
-      fill(predecessor.begin(), predecessor.end(), 0);
-      graph_.logGraph();
-      DijkstraOptimized(graph_, source_node, distance, predecessor);
-      logCosts(distance, predecessor);
+      TRACE_CALL(TRACE_ITERATION, graph_.traceArcs());
+      findShortestPaths(source_node, &potentials);
+      TRACE_CALL(TRACE_ITERATION, traceCosts(workspace_, num_nodes));
       if (distance[sink_node] < numeric_limits<int64_t>::max()) {
-        reduceCost(distance);
-        int32_t min_flow = numeric_limits<int32_t>::max();
-        for (uint32_t cur_node = sink_node; cur_node != source_node[0];
-             cur_node = predecessor[cur_node]) {
-          Arc* arc = arcs[predecessor[cur_node]][cur_node];
-          min_flow = min(min_flow, arc->cap);
+        // The reduced costs stay non-negative once the distances are added
+        // to the potentials.
+        for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+          if (distance[node_id] < numeric_limits<int64_t>::max()) {
+            potentials[node_id] += distance[node_id];
+          }
         }
-        for (uint32_t cur_node = sink_node; cur_node != source_node[0];
-             cur_node = predecessor[cur_node]) {
-          Arc* arc = arcs[predecessor[cur_node]][cur_node];
-          arc->cap -= min_flow;
-          arc->reverse_arc->cap += min_flow;
-          nodes_demand[predecessor[cur_node]] -= min_flow;
-          nodes_demand[cur_node] += min_flow;
+        if (budget_.isExhausted(num_augmentations)) {
+          recordUnroutedSupply(source_node[0], potentials[sink_node] -
+                               potentials[source_node[0]]);
+          break;
         }
+        augmentPath(source_node[0], sink_node);
+        num_augmentations++;
       }
     } while (distance[sink_node] < numeric_limits<int64_t>::max());
+    workspace_.get_stats().addCount(AUGMENTATIONS, num_augmentations);
+    if (add_sink_and_source) {
+      graph_.removeSinkAndSource();
+    }
+    graph_.get_nodes_demand() = input_nodes_demand;
+    exportPotentials(graph_, potentials);
   }
 
+  template class SuccessiveShortest<int32_t, int32_t>;
+  template class SuccessiveShortest<int32_t, int64_t>;
+  template class SuccessiveShortest<int64_t, int32_t>;
+  template class SuccessiveShortest<int64_t, int64_t>;
+
 }
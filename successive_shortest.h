@@ -1,23 +1,43 @@
 #ifndef FLOWLESSLY_SUCCESSIVE_SHORTEST_H
 #define FLOWLESSLY_SUCCESSIVE_SHORTEST_H
 
+#include "delta_stepping.h"
 #include "graph.h"
+#include "solve_budget.h"
+#include "solver_workspace.h"
+#include "thread_pool.h"
+
+#include <memory>
 
 namespace flowlessly {
 
+  template<typename CapT, typename CostT>
   class SuccessiveShortest {
 
   public:
-  SuccessiveShortest(Graph graph): graph_(graph) {
+  SuccessiveShortest(Graph<CapT, CostT>& graph, SolverWorkspace& workspace,
+                     SolveBudget& budget):
+    graph_(graph), workspace_(workspace), budget_(budget) {
     }
 
     void successiveShortestPath();
     void successiveShortestPathPotentials();
+    // Runs the shortest path searches with delta-stepping on the pool
+    // instead of Bellman-Ford and Dijkstra.
+    void set_shortest_path_pool(ThreadPool* pool);
 
   private:
-    Graph graph_;
-
-    void reduceCost(vector<int64_t>& potential);
+    Graph<CapT, CostT>& graph_;
+    SolverWorkspace& workspace_;
+    SolveBudget& budget_;
+    unique_ptr<DeltaStepping<CapT, CostT> > delta_stepping_;
+
+    // Uses Dijkstra if there are potentials and Bellman-Ford otherwise,
+    // unless there is a pool.
+    void findShortestPaths(const vector<uint32_t>& source_nodes,
+                           const vector<int64_t>* potentials);
+    void augmentPath(uint32_t source_node, uint32_t sink_node);
+    void recordUnroutedSupply(uint32_t source_node, int64_t path_cost);
 
   };
 
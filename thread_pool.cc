@@ -0,0 +1,71 @@
+#include "thread_pool.h"
+
+namespace flowlessly {
+
+  ThreadPool::ThreadPool(uint32_t num_threads): num_pending_tasks(0),
+    stopping(false) {
+    if (num_threads == 0) {
+      num_threads = 1;
+    }
+    for (uint32_t index = 0; index < num_threads; ++index) {
+      workers.push_back(thread(&ThreadPool::runWorker, this));
+    }
+  }
+
+  ThreadPool::~ThreadPool() {
+    {
+      unique_lock<mutex> lock(tasks_lock);
+      stopping = true;
+    }
+    task_available.notify_all();
+    for (vector<thread>::iterator it = workers.begin(); it != workers.end();
+         ++it) {
+      it->join();
+    }
+  }
+
+  void ThreadPool::schedule(const function<void()>& task) {
+    {
+      unique_lock<mutex> lock(tasks_lock);
+      tasks.push(task);
+      num_pending_tasks++;
+    }
+    task_available.notify_one();
+  }
+
+  void ThreadPool::wait() {
+    unique_lock<mutex> lock(tasks_lock);
+    while (num_pending_tasks > 0) {
+      tasks_done.wait(lock);
+    }
+  }
+
+  uint32_t ThreadPool::get_num_threads() {
+    return workers.size();
+  }
+
+  void ThreadPool::runWorker() {
+    while (true) {
+      function<void()> task;
+      {
+        unique_lock<mutex> lock(tasks_lock);
+        while (tasks.empty() && !stopping) {
+          task_available.wait(lock);
+        }
+        if (tasks.empty()) {
+          return;
+        }
+        task = tasks.front();
+        tasks.pop();
+      }
+      task();
+      {
+        unique_lock<mutex> lock(tasks_lock);
+        if (--num_pending_tasks == 0) {
+          tasks_done.notify_all();
+        }
+      }
+    }
+  }
+
+}
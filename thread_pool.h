@@ -0,0 +1,43 @@
+#ifndef FLOWLESSLY_THREAD_POOL_H
+#define FLOWLESSLY_THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // Fixed size pool of worker threads that run scheduled tasks in FIFO
+  // order.
+  class ThreadPool {
+
+  public:
+    explicit ThreadPool(uint32_t num_threads);
+    ~ThreadPool();
+
+    void schedule(const function<void()>& task);
+    // Blocks until all the scheduled tasks have finished.
+    void wait();
+    uint32_t get_num_threads();
+
+  private:
+    void runWorker();
+
+    vector<thread> workers;
+    queue<function<void()> > tasks;
+    mutex tasks_lock;
+    condition_variable task_available;
+    condition_variable tasks_done;
+    uint32_t num_pending_tasks;
+    bool stopping;
+
+  };
+
+}
+#endif
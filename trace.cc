@@ -0,0 +1,58 @@
+#include "trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+namespace flowlessly {
+
+  const uint64_t kTraceBufferRecords = 1 << 18;
+
+  atomic<uint64_t> num_trace_records(0);
+
+  // Only allocated once the first record is added.
+  vector<TraceRecord>& getTraceBuffer() {
+    static vector<TraceRecord> trace_buffer(kTraceBufferRecords);
+    return trace_buffer;
+  }
+
+  void traceRecord(TraceEvent event, int64_t arg0, int64_t arg1,
+                   int64_t arg2) {
+    vector<TraceRecord>& trace_buffer = getTraceBuffer();
+    uint64_t index = num_trace_records.fetch_add(1, memory_order_relaxed);
+    TraceRecord& record = trace_buffer[index % kTraceBufferRecords];
+    record.time_ns = chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+    record.event = event;
+    record.padding = 0;
+    record.args[0] = arg0;
+    record.args[1] = arg1;
+    record.args[2] = arg2;
+  }
+
+  bool dumpTrace(const string& trace_file_path) {
+    FILE* trace_file = fopen(trace_file_path.c_str(), "wb");
+    if (trace_file == NULL) {
+      return false;
+    }
+    uint64_t num_records = num_trace_records.load();
+    uint64_t first_record = 0;
+    if (num_records > kTraceBufferRecords) {
+      first_record = num_records - kTraceBufferRecords;
+    }
+    uint64_t num_kept = num_records - first_record;
+    fwrite("FLTRACE1", 1, 8, trace_file);
+    fwrite(&num_kept, sizeof(num_kept), 1, trace_file);
+    if (num_kept > 0) {
+      vector<TraceRecord>& trace_buffer = getTraceBuffer();
+      for (uint64_t index = first_record; index < num_records; ++index) {
+        fwrite(&trace_buffer[index % kTraceBufferRecords],
+               sizeof(TraceRecord), 1, trace_file);
+      }
+    }
+    fclose(trace_file);
+    return true;
+  }
+
+}
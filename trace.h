@@ -0,0 +1,69 @@
+#ifndef FLOWLESSLY_TRACE_H
+#define FLOWLESSLY_TRACE_H
+
+#include <stdint.h>
+#include <string>
+
+// The trace level is fixed at compile time, e.g. make TRACE_LEVEL=2. At the
+// default level every trace point compiles out, including the evaluation
+// of its arguments.
+#ifndef FLOWLESSLY_TRACE_LEVEL
+#define FLOWLESSLY_TRACE_LEVEL 0
+#endif
+
+// Once per scaling phase, augmentation, cancelled cycle or search.
+#define TRACE_ITERATION 1
+// Once per scanned arc, push, relabel or popped node.
+#define TRACE_ARC 2
+
+#define TRACE(level, event, arg0, arg1, arg2)                           \
+  do {                                                                  \
+    if (FLOWLESSLY_TRACE_LEVEL >= (level)) {                            \
+      ::flowlessly::traceRecord((event), (arg0), (arg1), (arg2));       \
+    }                                                                   \
+  } while (0)
+
+// Runs a statement that records traces, e.g. a graph dump.
+#define TRACE_CALL(level, statement)                                    \
+  do {                                                                  \
+    if (FLOWLESSLY_TRACE_LEVEL >= (level)) {                            \
+      statement;                                                        \
+    }                                                                   \
+  } while (0)
+
+namespace flowlessly {
+
+  using namespace std;
+
+  // The meaning of the three arguments is given next to each event.
+  enum TraceEvent {
+    TRACE_PHASE,            // eps
+    TRACE_ARC_SCAN,         // src, dst, reduced cost
+    TRACE_PUSH,             // src, dst, flow
+    TRACE_RELABEL,          // node, potential
+    TRACE_NODE_POP,         // node, distance
+    TRACE_AUGMENT_ARC,      // src, dst, flow
+    TRACE_CYCLE_ARC,        // src, dst, flow
+    TRACE_GRAPH_ARC,        // src, dst, flow
+    TRACE_NODE_DISTANCE     // node, distance, predecessor
+  };
+
+  // The traces go to a ring buffer that keeps the most recent records. A
+  // dump is the 8 bytes "FLTRACE1", the number of records as a uint64_t
+  // and the records from the oldest to the newest, in host byte order.
+  struct TraceRecord {
+    // Nanoseconds on the monotonic clock.
+    int64_t time_ns;
+    uint32_t event;
+    uint32_t padding;
+    int64_t args[3];
+  };
+
+  // Records may be added from several threads. A record that is being
+  // overwritten while the buffer wraps around can be torn.
+  void traceRecord(TraceEvent event, int64_t arg0, int64_t arg1,
+                   int64_t arg2);
+  bool dumpTrace(const string& trace_file_path);
+
+}
+#endif
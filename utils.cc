@@ -1,184 +1,373 @@
 #include "utils.h"
 
-#include <boost/heap/binomial_heap.hpp>
+#include "trace.h"
+
+#include <algorithm>
+#include <functional>
 #include <limits>
-#include <queue>
 
 namespace flowlessly {
 
-  using namespace boost::heap;
   using namespace std;
 
-  void logCosts(const vector<int64_t>& distance,
-                const vector<uint32_t>& predecessor) {
+  void logCosts(SolverWorkspace& workspace, uint32_t num_nodes) {
+    const vector<int64_t>& distance = workspace.get_distance();
+    vector<uint32_t>& predecessor = workspace.get_predecessor();
     LOG(INFO) << "Logging graph costs";
-    for (uint32_t node_id = 1; node_id < distance.size(); ++node_id) {
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
       LOG(INFO) << node_id << " " << distance[node_id] << " "
                 << predecessor[node_id] << endl;
     }
   }
 
+  void traceCosts(SolverWorkspace& workspace, uint32_t num_nodes) {
+    const vector<int64_t>& distance = workspace.get_distance();
+    vector<uint32_t>& predecessor = workspace.get_predecessor();
+    for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+      traceRecord(TRACE_NODE_DISTANCE, node_id, distance[node_id],
+                  predecessor[node_id]);
+    }
+  }
+
+  template<typename CapT, typename CostT>
+  void exportPotentials(Graph<CapT, CostT>& graph,
+                        const vector<int64_t>& start_potentials) {
+    uint32_t num_nodes = graph.get_num_nodes();
+    const vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph.get_arcs();
+    vector<int64_t>& potentials = graph.get_potentials();
+    potentials.clear();
+    if (!graph.get_export_potentials() ||
+        !graph.get_solution_quality().optimal) {
+      return;
+    }
+    if (start_potentials.empty()) {
+      potentials.assign(num_nodes + 1, 0);
+    } else {
+      potentials.assign(start_potentials.begin(),
+                        start_potentials.begin() + num_nodes + 1);
+    }
+    bool relaxed = true;
+    // Without a negative cycle no shortest path has more than num_nodes
+    // arcs, so the last pass must not relax anything.
+    for (uint32_t pass = 0; pass <= num_nodes && relaxed; ++pass) {
+      relaxed = false;
+      for (uint32_t node_id = 1; node_id <= num_nodes; ++node_id) {
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+          arcs[node_id].begin();
+        typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+          arcs[node_id].end();
+        for (; it != end_it; ++it) {
+          if (it->second->cap > 0 &&
+              potentials[node_id] + it->second->cost < potentials[it->first]) {
+            potentials[it->first] = potentials[node_id] + it->second->cost;
+            relaxed = true;
+          }
+        }
+      }
+    }
+    if (relaxed) {
+      LOG(ERROR) << "The residual graph has a negative cycle, the flow is "
+                 << "not optimal";
+      potentials.clear();
+    }
+  }
+
   // Computes max flow over the graph using the Ford-Fulkerson algorithm.
   // The Complexity of the algorithm is O(E * F). Where F is the max flow value.
   // NOTE: This method changes the graph.
-  void maxFlow(Graph& graph) {
-    uint32_t num_nodes = graph.get_num_nodes() + 1;
-    vector<map<uint32_t, Arc*> >& arcs = graph.get_arcs();
-    vector<int32_t>& nodes_demand = graph.get_nodes_demand();
-    vector<int32_t> visited(num_nodes, 0);
-    vector<uint32_t> predecessor(num_nodes, 0);
+  template<typename CapT, typename CostT>
+  void maxFlow(Graph<CapT, CostT>& graph, SolverWorkspace& workspace) {
+    workspace.reserveNodes(graph.get_num_nodes());
+    vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph.get_arcs();
+    vector<CapT>& nodes_demand = graph.get_nodes_demand();
+    // The capacity of the path on which a node was reached.
+    vector<int64_t>& path_capacity = workspace.get_path_capacity();
+    vector<uint32_t>& predecessor = workspace.get_predecessor();
+    vector<uint32_t>& to_visit = workspace.get_node_queue();
     // Works with the assumption that there is only a sink and a source node.
     uint32_t source_node = graph.get_source_nodes()[0];
     uint32_t sink_node = graph.get_sink_nodes()[0];
     bool has_path = true;
     while (has_path) {
       has_path = false;
-      queue<uint32_t> to_visit;
-      fill(visited.begin(), visited.end(), 0);
-      fill(predecessor.begin(), predecessor.end(), 0);
-      to_visit.push(source_node);
-      visited[source_node] = nodes_demand[source_node];
-      while (!to_visit.empty() && !has_path) {
-        uint32_t cur_node = to_visit.front();
-        LOG(INFO) << "Max flow node popped: " << cur_node;
-        to_visit.pop();
-        map<uint32_t, Arc*>::iterator it = arcs[cur_node].begin();
-        map<uint32_t, Arc*>::iterator end_it = arcs[cur_node].end();
+      workspace.clearMarks();
+      to_visit.clear();
+      to_visit.push_back(source_node);
+      workspace.mark(source_node);
+      path_capacity[source_node] = nodes_demand[source_node];
+      for (uint32_t head = 0; head < to_visit.size() && !has_path; ++head) {
+        uint32_t cur_node = to_visit[head];
+        TRACE(TRACE_ARC, TRACE_NODE_POP, cur_node, path_capacity[cur_node], 0);
+        typename map<uint32_t, Arc<CapT, CostT>*>::iterator it =
+          arcs[cur_node].begin();
+        typename map<uint32_t, Arc<CapT, CostT>*>::iterator end_it =
+          arcs[cur_node].end();
         for (; it != end_it; ++it) {
-          if (!visited[it->first] && it->second->cap > 0) {
-            visited[it->first] = min(it->second->cap, visited[cur_node]);
-            to_visit.push(it->first);
+          if (!workspace.isMarked(it->first) && it->second->cap > 0) {
+            workspace.mark(it->first);
+            path_capacity[it->first] = min(
+                static_cast<int64_t>(it->second->cap), path_capacity[cur_node]);
+            to_visit.push_back(it->first);
             predecessor[it->first] = cur_node;
             if (it->first == sink_node) {
               has_path = true;
-              int32_t min_aux_flow = visited[it->first];
-              for (uint32_t cur_node = it->first; predecessor[cur_node] > 0;
+              CapT min_aux_flow = path_capacity[it->first];
+              for (uint32_t cur_node = it->first; cur_node != source_node;
                    cur_node = predecessor[cur_node]) {
-                Arc* arc = arcs[predecessor[cur_node]][cur_node];
-                arc->cap -= min_aux_flow;
-                arc->reverse_arc->cap += min_aux_flow;
+                Arc<CapT, CostT>* arc = arcs[predecessor[cur_node]][cur_node];
+                arc->pushFlow(min_aux_flow);
                 nodes_demand[predecessor[cur_node]] -= min_aux_flow;
                 nodes_demand[cur_node] += min_aux_flow;
-                LOG(INFO) << "Flow path: (" << predecessor[cur_node] << ", "
-                          << cur_node << ") " << min_aux_flow;
+                TRACE(TRACE_ARC, TRACE_AUGMENT_ARC,
+                      predecessor[cur_node], cur_node, min_aux_flow);
               }
               break;
             }
           }
         }
       }
-      LOG(INFO) << "The graph after another iteration of max flow.";
-      graph.logGraph();
+      TRACE_CALL(TRACE_ITERATION, graph.traceArcs());
     }
   }
 
-  void BellmanFord(Graph& graph, const vector<uint32_t>& source_nodes,
-                   vector<int64_t>& distance, vector<uint32_t>& predecessor) {
+  template<typename CapT, typename CostT>
+  void BellmanFord(Graph<CapT, CostT>& graph,
+                   const vector<uint32_t>& source_nodes,
+                   SolverWorkspace& workspace) {
     uint32_t num_nodes = graph.get_num_nodes() + 1;
-    const vector<map<uint32_t, Arc*> >& arcs = graph.get_arcs();
+    const vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph.get_arcs();
+    ScopedStatsTimer timer(workspace.get_stats(), SHORTEST_PATH_TIMER);
+    uint64_t num_arc_scans = 0;
+    workspace.reserveNodes(graph.get_num_nodes());
+    workspace.startSearch();
+    const vector<int64_t>& distance = workspace.get_distance();
     for (vector<uint32_t>::const_iterator it = source_nodes.begin();
          it != source_nodes.end(); ++it) {
-      distance[*it] = 0;
+      workspace.set_distance(*it, 0, 0);
     }
     bool relaxed = true;
     for (uint32_t iter = 1; iter < num_nodes && relaxed; ++iter) {
       relaxed = false;
       for (uint32_t node_id = 1; node_id < num_nodes; ++node_id) {
-        if (distance[node_id] < numeric_limits<int32_t>::max()) {
-          map<uint32_t, Arc*>::const_iterator it = arcs[node_id].begin();
-          map<uint32_t, Arc*>::const_iterator end_it = arcs[node_id].end();
+        if (distance[node_id] < numeric_limits<int64_t>::max()) {
+          num_arc_scans += arcs[node_id].size();
+          typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+            arcs[node_id].begin();
+          typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+            arcs[node_id].end();
           for (; it != end_it; ++it) {
             if (it->second->cap > 0 &&
                 distance[node_id] + it->second->cost < distance[it->first]) {
-              distance[it->first] = distance[node_id] + it->second->cost;
-              predecessor[it->first] = node_id;
+              workspace.set_distance(it->first,
+                                     distance[node_id] + it->second->cost,
+                                     node_id);
               relaxed = true;
             }
           }
         }
       }
     }
+    workspace.get_stats().addCount(ARC_SCANS, num_arc_scans);
   }
 
-  void DijkstraSimple(Graph& graph, const vector<uint32_t>& source_nodes,
-                      vector<int64_t>& distance,
-                      vector<uint32_t>& predecessor) {
+  template<typename CapT, typename CostT>
+  void DijkstraSimple(Graph<CapT, CostT>& graph,
+                      const vector<uint32_t>& source_nodes,
+                      SolverWorkspace& workspace) {
     uint32_t num_nodes = graph.get_num_nodes() + 1;
-    vector<bool> node_used(num_nodes, false);
-    const vector<map<uint32_t, Arc*> >& arcs = graph.get_arcs();
-    // Works with the assumption that all the elements of distance are
-    // already set to INF.
+    const vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph.get_arcs();
+    ScopedStatsTimer timer(workspace.get_stats(), SHORTEST_PATH_TIMER);
+    uint64_t num_arc_scans = 0;
+    workspace.reserveNodes(graph.get_num_nodes());
+    workspace.startSearch();
+    // A node is marked once it has been used.
+    workspace.clearMarks();
+    const vector<int64_t>& distance = workspace.get_distance();
     for (vector<uint32_t>::const_iterator it = source_nodes.begin();
          it != source_nodes.end(); ++it) {
-      distance[*it] = 0;
+      workspace.set_distance(*it, 0, 0);
     }
     for (uint32_t iter = 1; iter < num_nodes - 1; ++iter) {
-      int64_t min_node_distance = numeric_limits<int32_t>::max();
+      int64_t min_node_distance = numeric_limits<int64_t>::max();
       uint32_t min_node_id = 0;
-      // Get the closest unused vertex.
+      // Get the closest unused vertex. Unreached vertices are never picked,
+      // their distance would overflow once an arc cost is added to it.
       for (uint32_t node_id = 1; node_id < num_nodes; ++node_id) {
-        if (!node_used[node_id] && distance[node_id] <= min_node_distance) {
+        if (!workspace.isMarked(node_id) &&
+            distance[node_id] < min_node_distance) {
           min_node_distance = distance[node_id];
           min_node_id = node_id;
         }
       }
-      node_used[min_node_id] = true;
-      map<uint32_t, Arc*>::const_iterator it = arcs[min_node_id].begin();
-      map<uint32_t, Arc*>::const_iterator end_it = arcs[min_node_id].end();
+      if (min_node_id == 0) {
+        break;
+      }
+      workspace.mark(min_node_id);
+      num_arc_scans += arcs[min_node_id].size();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[min_node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[min_node_id].end();
       for (; it != end_it; ++it) {
         if (it->second->cap > 0 &&
             distance[min_node_id] + it->second->cost < distance[it->first]) {
-          distance[it->first] = distance[min_node_id] + it->second->cost;
-          predecessor[it->first] = min_node_id;
+          workspace.set_distance(it->first,
+                                 distance[min_node_id] + it->second->cost,
+                                 min_node_id);
         }
       }
     }
+    workspace.get_stats().addCount(ARC_SCANS, num_arc_scans);
   }
 
-  void DijkstraOptimized(Graph& graph, const vector<uint32_t>& source_nodes,
-                         vector<int64_t>& distance,
-                         vector<uint32_t>& predecessor) {
-    uint32_t num_nodes = graph.get_num_nodes() + 1;
-    const vector<map<uint32_t, Arc*> >& arcs = graph.get_arcs();
-    vector<bool> visited(num_nodes, false);
-    binomial_heap<pair<int64_t, uint32_t>,
-                  compare<greater<pair<int64_t, uint32_t> > > > dist_heap;
-    binomial_heap<pair<int64_t, uint32_t>,
-                  compare<greater<pair<int64_t, uint32_t> > > >::handle_type
-    handles[num_nodes];
-    // Works with the assumption that all the elements of distance are
-    // already set to INF.
+  // Uses a binary heap with lazy deletion: a node is pushed again every time
+  // its distance decreases and the outdated entries are skipped when popped.
+  // The heap lives in the workspace, so no memory is allocated per node.
+  // potentials may be NULL.
+  template<typename CapT, typename CostT>
+  void DijkstraHeap(Graph<CapT, CostT>& graph,
+                    const vector<uint32_t>& source_nodes,
+                    const vector<int64_t>* potentials,
+                    SolverWorkspace& workspace) {
+    const vector<map<uint32_t, Arc<CapT, CostT>*> >& arcs = graph.get_arcs();
+    ScopedStatsTimer timer(workspace.get_stats(), SHORTEST_PATH_TIMER);
+    uint64_t num_arc_scans = 0;
+    uint64_t num_heap_pops = 0;
+    workspace.reserveNodes(graph.get_num_nodes());
+    workspace.startSearch();
+    const vector<int64_t>& distance = workspace.get_distance();
+    vector<pair<int64_t, uint32_t> >& dist_heap = workspace.get_heap();
+    greater<pair<int64_t, uint32_t> > heap_compare;
+    dist_heap.clear();
     for (vector<uint32_t>::const_iterator it = source_nodes.begin();
          it != source_nodes.end(); ++it) {
-      distance[*it] = 0;
-      visited[*it] = true;
-      handles[*it] = dist_heap.push(make_pair(0, *it));
+      workspace.set_distance(*it, 0, 0);
+      dist_heap.push_back(make_pair(0, *it));
+      push_heap(dist_heap.begin(), dist_heap.end(), heap_compare);
     }
     while (!dist_heap.empty()) {
-      pair<int64_t, uint32_t> min_dist = dist_heap.top();
-      int32_t min_cost = min_dist.first;
+      pop_heap(dist_heap.begin(), dist_heap.end(), heap_compare);
+      pair<int64_t, uint32_t> min_dist = dist_heap.back();
+      dist_heap.pop_back();
+      num_heap_pops++;
       uint32_t min_node_id = min_dist.second;
-      LOG(INFO) << min_node_id;
-      dist_heap.pop();
-      map<uint32_t, Arc*>::const_iterator it = arcs[min_node_id].begin();
-      map<uint32_t, Arc*>::const_iterator end_it = arcs[min_node_id].end();
+      if (min_dist.first > distance[min_node_id]) {
+        // The node has been pushed again with a smaller distance.
+        continue;
+      }
+      TRACE(TRACE_ARC, TRACE_NODE_POP, min_node_id, min_dist.first, 0);
+      num_arc_scans += arcs[min_node_id].size();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator it =
+        arcs[min_node_id].begin();
+      typename map<uint32_t, Arc<CapT, CostT>*>::const_iterator end_it =
+        arcs[min_node_id].end();
       for (; it != end_it; ++it) {
-        if (it->second->cap > 0 &&
-            distance[min_node_id] + it->second->cost < distance[it->first]) {
-          distance[it->first] = distance[min_node_id] + it->second->cost;
-          if (!visited[it->first]) {
-            visited[it->first] = true;
-            predecessor[it->first] = min_node_id;
-            handles[it->first] =
-              dist_heap.push(make_pair(distance[it->first], it->first));
-          } else {
-            predecessor[it->first] = min_node_id;
-            dist_heap.increase(handles[it->first],
-                               make_pair(distance[it->first], it->first));
-          }
+        if (it->second->cap <= 0) {
+          continue;
+        }
+        int64_t cost = it->second->cost;
+        if (potentials) {
+          cost += (*potentials)[min_node_id] - (*potentials)[it->first];
+        }
+        if (distance[min_node_id] + cost < distance[it->first]) {
+          workspace.set_distance(it->first, distance[min_node_id] + cost,
+                                 min_node_id);
+          dist_heap.push_back(make_pair(distance[it->first], it->first));
+          push_heap(dist_heap.begin(), dist_heap.end(), heap_compare);
         }
       }
     }
+    // Every entry is pushed once and popped once.
+    workspace.get_stats().addCount(HEAP_OPERATIONS, 2 * num_heap_pops);
+    workspace.get_stats().addCount(ARC_SCANS, num_arc_scans);
   }
 
+  template<typename CapT, typename CostT>
+  void DijkstraOptimized(Graph<CapT, CostT>& graph,
+                         const vector<uint32_t>& source_nodes,
+                         SolverWorkspace& workspace) {
+    DijkstraHeap<CapT, CostT>(graph, source_nodes, NULL, workspace);
+  }
+
+  template<typename CapT, typename CostT>
+  void DijkstraOptimized(Graph<CapT, CostT>& graph,
+                         const vector<uint32_t>& source_nodes,
+                         const vector<int64_t>& potentials,
+                         SolverWorkspace& workspace) {
+    DijkstraHeap(graph, source_nodes, &potentials, workspace);
+  }
+
+  template void exportPotentials(Graph<int32_t, int32_t>& graph,
+                                 const vector<int64_t>& start_potentials);
+  template void exportPotentials(Graph<int32_t, int64_t>& graph,
+                                 const vector<int64_t>& start_potentials);
+  template void exportPotentials(Graph<int64_t, int32_t>& graph,
+                                 const vector<int64_t>& start_potentials);
+  template void exportPotentials(Graph<int64_t, int64_t>& graph,
+                                 const vector<int64_t>& start_potentials);
+
+  template void maxFlow(Graph<int32_t, int32_t>& graph,
+                        SolverWorkspace& workspace);
+  template void maxFlow(Graph<int32_t, int64_t>& graph,
+                        SolverWorkspace& workspace);
+  template void maxFlow(Graph<int64_t, int32_t>& graph,
+                        SolverWorkspace& workspace);
+  template void maxFlow(Graph<int64_t, int64_t>& graph,
+                        SolverWorkspace& workspace);
+
+  template void BellmanFord(Graph<int32_t, int32_t>& graph,
+                            const vector<uint32_t>& source_nodes,
+                            SolverWorkspace& workspace);
+  template void BellmanFord(Graph<int32_t, int64_t>& graph,
+                            const vector<uint32_t>& source_nodes,
+                            SolverWorkspace& workspace);
+  template void BellmanFord(Graph<int64_t, int32_t>& graph,
+                            const vector<uint32_t>& source_nodes,
+                            SolverWorkspace& workspace);
+  template void BellmanFord(Graph<int64_t, int64_t>& graph,
+                            const vector<uint32_t>& source_nodes,
+                            SolverWorkspace& workspace);
+
+  template void DijkstraSimple(Graph<int32_t, int32_t>& graph,
+                               const vector<uint32_t>& source_nodes,
+                               SolverWorkspace& workspace);
+  template void DijkstraSimple(Graph<int32_t, int64_t>& graph,
+                               const vector<uint32_t>& source_nodes,
+                               SolverWorkspace& workspace);
+  template void DijkstraSimple(Graph<int64_t, int32_t>& graph,
+                               const vector<uint32_t>& source_nodes,
+                               SolverWorkspace& workspace);
+  template void DijkstraSimple(Graph<int64_t, int64_t>& graph,
+                               const vector<uint32_t>& source_nodes,
+                               SolverWorkspace& workspace);
+
+  template void DijkstraOptimized(Graph<int32_t, int32_t>& graph,
+                                  const vector<uint32_t>& source_nodes,
+                                  SolverWorkspace& workspace);
+  template void DijkstraOptimized(Graph<int32_t, int32_t>& graph,
+                                  const vector<uint32_t>& source_nodes,
+                                  const vector<int64_t>& potentials,
+                                  SolverWorkspace& workspace);
+  template void DijkstraOptimized(Graph<int32_t, int64_t>& graph,
+                                  const vector<uint32_t>& source_nodes,
+                                  SolverWorkspace& workspace);
+  template void DijkstraOptimized(Graph<int32_t, int64_t>& graph,
+                                  const vector<uint32_t>& source_nodes,
+                                  const vector<int64_t>& potentials,
+                                  SolverWorkspace& workspace);
+  template void DijkstraOptimized(Graph<int64_t, int32_t>& graph,
+                                  const vector<uint32_t>& source_nodes,
+                                  SolverWorkspace& workspace);
+  template void DijkstraOptimized(Graph<int64_t, int32_t>& graph,
+                                  const vector<uint32_t>& source_nodes,
+                                  const vector<int64_t>& potentials,
+                                  SolverWorkspace& workspace);
+  template void DijkstraOptimized(Graph<int64_t, int64_t>& graph,
+                                  const vector<uint32_t>& source_nodes,
+                                  SolverWorkspace& workspace);
+  template void DijkstraOptimized(Graph<int64_t, int64_t>& graph,
+                                  const vector<uint32_t>& source_nodes,
+                                  const vector<int64_t>& potentials,
+                                  SolverWorkspace& workspace);
+
 }
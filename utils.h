@@ -2,6 +2,7 @@
 #define FLOWLESSLY_UTILS_H
 
 #include "graph.h"
+#include "solver_workspace.h"
 
 #include <glog/logging.h>
 #include <gflags/gflags.h>
@@ -11,16 +12,42 @@ namespace flowlessly {
 
   using namespace std;
 
-  void logCosts(const vector<int64_t>& distance,
-                const vector<uint32_t>& predecessor);
-  void maxFlow(Graph& graph);
-  void BellmanFord(Graph& graph, const vector<uint32_t>& source_nodes,
-                   vector<int64_t>& distance, vector<uint32_t>& predecessor);
-  void DijkstraSimple(Graph& graph, const vector<uint32_t>& source_node,
-                      vector<int64_t>& distance, vector<uint32_t>& predecessor);
-  void DijkstraOptimized(Graph& graph, const vector<uint32_t>& source_node,
-                         vector<int64_t>& distance,
-                         vector<uint32_t>& predecessor);
+  void logCosts(SolverWorkspace& workspace, uint32_t num_nodes);
+  // Records the distances and the predecessors in the trace buffer.
+  void traceCosts(SolverWorkspace& workspace, uint32_t num_nodes);
+  // Sets the potentials of the graph to ones that certify its flow. They
+  // start from start_potentials, or from zero if it is empty, and are
+  // lowered by Bellman-Ford passes until no arc with residual capacity has
+  // a negative reduced cost, so exact start potentials cost a single pass.
+  // The potentials of the graph are cleared if it doesn't export them, if
+  // its solution is not optimal or if its residual graph has a negative
+  // cycle.
+  template<typename CapT, typename CostT>
+  void exportPotentials(Graph<CapT, CostT>& graph,
+                        const vector<int64_t>& start_potentials);
+  template<typename CapT, typename CostT>
+  void maxFlow(Graph<CapT, CostT>& graph, SolverWorkspace& workspace);
+  // The shortest path algorithms leave the distances and the predecessors
+  // in the workspace.
+  template<typename CapT, typename CostT>
+  void BellmanFord(Graph<CapT, CostT>& graph,
+                   const vector<uint32_t>& source_nodes,
+                   SolverWorkspace& workspace);
+  template<typename CapT, typename CostT>
+  void DijkstraSimple(Graph<CapT, CostT>& graph,
+                      const vector<uint32_t>& source_node,
+                      SolverWorkspace& workspace);
+  template<typename CapT, typename CostT>
+  void DijkstraOptimized(Graph<CapT, CostT>& graph,
+                         const vector<uint32_t>& source_node,
+                         SolverWorkspace& workspace);
+  // Runs on the reduced costs cost + potential[src] - potential[dst], which
+  // must not be negative on the arcs with capacity.
+  template<typename CapT, typename CostT>
+  void DijkstraOptimized(Graph<CapT, CostT>& graph,
+                         const vector<uint32_t>& source_node,
+                         const vector<int64_t>& potentials,
+                         SolverWorkspace& workspace);
 
 }
 #endif